@@ -7,9 +7,17 @@ extern "C" {
 
 #include "live2d/Displayer.hpp"
 #include "live2d/Util.hpp"
+#include "live2d/PixelKernels.hpp"
+#include "live2d/ModelBundle.hpp"
+#include "live2d/Definitions.hpp"
+#include "live2d/StartupProfiler.hpp"
+#include "live2d/Logger.hpp"
 
 #include <opencv2/highgui.hpp>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <sstream>
 
 static void help(const char **argv) {
 std::cout << "Program usage: " << argv[0] << " {OPTIONS}\n"
@@ -24,9 +32,84 @@ std::cout << "Program usage: " << argv[0] << " {OPTIONS}\n"
 "                            face detection\n"
 "--eyes-cascade=<path>     : (Default: \"data/haarcascades/haarcascade_eye_tree_eyeglasses.xml\")\n"
 "                            Controls which Haar cascade config file to use for\n"
-"                            eye detection within the face\n" << std::endl;
+"                            eye detection within the face\n"
+"--vsync=<mode>            : (Default: \"on\") How frames are paced against the display.\n"
+"                            One of \"on\", \"adaptive\", \"low-latency\" or \"off\"\n"
+"--stats                   : Periodically print frame time statistics\n"
+"--startup-report          : Print how long each phase of startup took\n"
+"--startup-json=<file>     : Write how long each phase of startup took to a JSON\n"
+"                            file, for comparing cold starts across releases\n"
+"--model-fps=<fps>         : (Default: 0) Simulate and redraw the model at most this\n"
+"                            many times per second, compositing a cached copy in\n"
+"                            between. 0 redraws the model every frame\n"
+"--models=<names>          : Comma separated models to show side by side, out of\n"
+"                            Haru, Hiyori, Mark, Natori and Rice (Default: Haru)\n"
+"--sim-thread              : Simulate the models on a worker thread while the previous\n"
+"                            step is drawn, adding a frame of model latency\n"
+"--sim-rate=<hz>           : (Default: 0) Advance the models in fixed steps of this\n"
+"                            rate, drawing an interpolation between the last two.\n"
+"                            0 steps once per frame by the frame time\n"
+"--virtual-clock=<fps>     : Advance the models by exactly 1/fps seconds every frame,\n"
+"                            however long frames actually take. With --vsync=off\n"
+"                            runs render faster than real time\n"
+"--seed=<n>                : Seed the random motion choices and advance models in a\n"
+"                            fixed order, so runs can be reproduced\n"
+"--no-lod                  : Always simulate every model in full detail, instead of\n"
+"                            less often and without breathing, blinking or physics\n"
+"                            when they're small, off screen, hidden or frames run\n"
+"                            long. Implied by --seed and --virtual-clock\n"
+"--frame-budget=<ms>       : (Default: refresh period) CPU time per frame above which\n"
+"                            models are simulated in less detail\n"
+"--motion-cache=<MiB>      : (Default: 8) Parsed motions each model keeps in memory\n"
+"                            once they stop playing, least recently used dropped\n"
+"                            first. Motions are loaded when first played\n"
+"--allocator=<mode>        : (Default: malloc) How the Cubism framework allocates\n"
+"                            memory: malloc, pool (small objects from size class\n"
+"                            pools) or arena (pool, plus each model's moc and model\n"
+"                            data from one arena). Reported with --stats\n"
+"--alloc-guard=<mode>      : (Default: off) After 300 frames of warm-up, report heap\n"
+"                            allocations made per frame by model updates, view\n"
+"                            rendering or cv_tick: off, warn or abort. Needs a build\n"
+"                            with FACESTUFF_TRACK_ALLOCATIONS, which also adds\n"
+"                            allocation counts to --stats\n"
+"--no-texture-compression  : Upload model textures uncompressed instead of caching\n"
+"                            them compressed for the GPU under cache/textures/\n"
+"--texture-budget=<MiB>    : (Default: 0) VRAM textures no model uses any more may\n"
+"                            keep, least recently used freed first. 0 frees them\n"
+"                            as soon as their last model goes\n"
+"--watch                   : Reload a model's motions, expressions, physics and\n"
+"                            textures when their files are written\n"
+"--headless                : Render without a window into an EGL/OSMesa framebuffer.\n"
+"                            A missing camera is replaced by a blank frame\n"
+"--width=<px>              : (Default: 640) Initial width of the rendered frame\n"
+"--height=<px>             : (Default: 480) Initial height of the rendered frame\n"
+"--frames=<count>          : (Default: 0) Exit after rendering this many frames,\n"
+"                            0 runs until the window is closed\n"
+"--dump-dir=<path>         : Write every rendered frame as a PNG into this directory\n"
+"--shm=<name>              : Publish every rendered frame into a shared memory ring\n"
+"                            buffer with this name, for other processes to read\n"
+"--shm-slots=<count>       : (Default: 3) Number of frames in the shared memory ring\n"
+"--shm-max-size=<W>x<H>    : (Default: drawable size) Largest frame the shared memory\n"
+"                            ring has room for, bigger frames are skipped\n"
+"--record=<path>           : Encode rendered frames into this file in the background.\n"
+"                            \".y4m\" files are raw 4:4:4 video, anything else goes\n"
+"                            through OpenCV's VideoWriter. Frames are dropped, not\n"
+"                            waited on, if the encoder falls behind\n"
+"--record-fps=<fps>        : (Default: 60) Frame rate written into the recording\n"
+"--record-queue=<count>    : (Default: 8) Frames that may wait for the encoder\n"
+"--record-camera=<path>    : Also record the raw camera feed into this file (needs\n"
+"                            --record). Each recording gets a <path>.frames.csv\n"
+"                            listing render frame IDs, for lining them up\n"
+"--bench-kernels           : Check the SIMD pixel kernels against the scalar ones,\n"
+"                            print their throughput and exit\n"
+"--pack-bundle=<model>     : Pack every file of a model's directory under Resources/\n"
+"                            into Resources/<model>.bundle, which is then loaded\n"
+"                            instead of the directory, and exit\n" << std::endl;
 }
 
+// Only detect face every quarter second (for less GPU stress)
+static const Uint32 CV_TICK_MS = 250;
+
 enum KEY_CODES {
   KEY_ESC,
   NUM_KEY_CODES
@@ -44,16 +127,16 @@ public:
 
   ACGL_ih_eventdata_t* evdata;
   ACGL_ih_keybinds_t* keybinds;
+  bool has_camera;
 
   enum UserEvents {
-    RefreshRequest,
     NewCVFrame,
   };
 
   /**
    * Custom constructor/destructor
    */
-  MainState() : disp(NULL), evdata(NULL), keybinds(NULL) {}
+  MainState() : disp(NULL), evdata(NULL), keybinds(NULL), has_camera(true) {}
   ~MainState() { release(); }
 
   void init(Displayer* init_disp) {
@@ -67,23 +150,10 @@ public:
     ACGL_ih_register_windowevent(evdata, Displayer::check_resize, disp);
   }
 
-  static bool graphics_tick(void* obj) {
-    MainState* state = reinterpret_cast<MainState*>(obj);
-    return state->graphics_tick();
-  }
-
-  bool graphics_tick() {
-    // Nothing here to be done really
-
-    // Request that the display be redrawn
-    SDL_Event ev;
-    SDL_zero(ev);
-    ev.type = SDL_USEREVENT;
-    ev.user.code = MainState::RefreshRequest;
-    ev.user.data1 = NULL;
-    ev.user.data2 = NULL;
-    SDL_PushEvent(&ev);
-
+  static bool cv_setup(void* obj) {
+    (void)obj;
+    // Its log ring now, so capturing never allocates one or waits on the logger's lock
+    Logger::register_thread();
     return true;
   }
 
@@ -93,12 +163,15 @@ public:
   }
 
   bool cv_tick() {
+    AllocTracker::FrameScope frame_scope("cv_tick");
     cap.read(_frame);
     if (_frame.empty()) {
       std::cout << "Blank frame encountered (hit end of video)" << std::endl;
       return false;
     }
 
+    disp->record_camera(_frame);
+
     dct.detect_face(_frame);
     if (dct.has_detected()) {
       dct.draw_face(_frame);
@@ -138,86 +211,127 @@ private:
   }
 };
 
-void mainloop(MainState* state) {
-  ACGL_thread_t* graphics_thread = ACGL_thread_create(
-    NULL, // No setup required
-    MainState::graphics_tick,
-    NULL, // No cleanup required
-    16, // 16ms roughly equals 60fps
-    state,
-    NULL
-  );
-
-  if (graphics_thread == NULL) {
-    fprintf(stderr, "Error, could not start main_thread: %s\n", SDL_GetError());
-    return;
-  }
-  if (ACGL_thread_start(graphics_thread, "graphics_thread") != 0) {
-    fprintf(stderr, "Error while starting graphics_thread: %s\n", SDL_GetError());
-    return;
+static void handle_event(MainState* state, SDL_Event& e) {
+  switch (e.type) {
+  case SDL_QUIT:
+    state->disp->app_end();
+    break;
+  case SDL_WINDOWEVENT:
+    ACGL_ih_handle_windowevent(e, state->evdata);
+    break;
+  case SDL_KEYUP:
+  case SDL_KEYDOWN:
+    ACGL_ih_handle_keyevent(e, state->keybinds, state->evdata);
+    break;
+  case SDL_USEREVENT:
+    // Custom handlers, more to be added later
+    switch (e.user.code) {
+    case MainState::NewCVFrame:
+      state->update_cv();
+      break;
+    default:
+      break;
+    }
+    break;
   }
+}
 
-  ACGL_thread_t* cv_thread = ACGL_thread_create(
-    NULL, // No setup required
-    MainState::cv_tick,
-    NULL, // No cleanup required
-    250, // Only detect face every quarter second (for less GPU stress)
-    state,
-    NULL
-  );
-
-  if (cv_thread == NULL) {
-    fprintf(stderr, "Error, could not start cv_thread: %s\n", SDL_GetError());
-    return;
-  }
-  if (ACGL_thread_start(cv_thread, "cv_thread") != 0) {
-    fprintf(stderr, "Error while starting cv_thread: %s\n", SDL_GetError());
-    return;
+void mainloop(MainState* state) {
+  ACGL_thread_t* cv_thread = NULL;
+  if (state->has_camera) {
+    cv_thread = ACGL_thread_create(
+      MainState::cv_setup,
+      MainState::cv_tick,
+      NULL, // No cleanup required
+      CV_TICK_MS,
+      state,
+      NULL
+    );
+
+    if (cv_thread == NULL) {
+      fprintf(stderr, "Error, could not start cv_thread: %s\n", SDL_GetError());
+      return;
+    }
+    if (ACGL_thread_start(cv_thread, "cv_thread") != 0) {
+      fprintf(stderr, "Error while starting cv_thread: %s\n", SDL_GetError());
+      return;
+    }
   }
 
+  // Rendering is paced by the buffer swap rather than a separate timer thread:
+  // with vsync on, `render` blocks until the display has consumed the previous
+  // frame, so every iteration lines up with a vblank.
   SDL_Event e;
-  while (!state->disp->get_is_end() && SDL_WaitEvent(&e) != 0) {
-    switch (e.type) {
-    case SDL_QUIT:
-      state->disp->app_end();
-      break;
-    case SDL_WINDOWEVENT:
-      ACGL_ih_handle_windowevent(e, state->evdata);
-      break;
-    case SDL_KEYUP:
-    case SDL_KEYDOWN:
-      ACGL_ih_handle_keyevent(e, state->keybinds, state->evdata);
-      break;
-    case SDL_USEREVENT:
-      // Custom handlers, more to be added later
-      switch (e.user.code) {
-      case MainState::RefreshRequest:
-        LAppUtil::update_time();
-
-        state->disp->render();
-        break;
-      case MainState::NewCVFrame:
-        state->update_cv();
-        break;
-      default:
-        break;
+  while (!state->disp->get_is_end()) {
+    if (state->disp->is_hidden()) {
+      // Swaps may return immediately while minimized, don't spin
+      state->disp->idle();
+      if (SDL_WaitEventTimeout(&e, 100) != 0) {
+        handle_event(state, e);
       }
+      continue;
+    }
+
+    while (SDL_PollEvent(&e) != 0) {
+      handle_event(state, e);
+    }
+    if (state->disp->get_is_end()) {
       break;
     }
+
+    LAppUtil::update_time();
+    state->disp->render();
+  }
+
+  if (cv_thread != NULL) {
+    if (ACGL_thread_stop(cv_thread) != 0) {
+      fprintf(stderr, "Error stopping cv_thread: %s\n", SDL_GetError());
+    }
+
+    ACGL_thread_destroy(cv_thread);
+  }
+}
+
+static std::vector<std::string> parse_list(const cv::String& list) {
+  std::vector<std::string> items;
+  std::stringstream stream(list);
+  std::string item;
+  while (std::getline(stream, item, ',')) {
+    if (!item.empty()) {
+      items.push_back(item);
+    }
   }
+  return items;
+}
 
-  if (ACGL_thread_stop(graphics_thread) != 0) {
-    fprintf(stderr, "Error stopping graphics_thread: %s\n", SDL_GetError());
+static bool parse_swap_mode(const cv::String& name, Displayer::SwapMode* mode) {
+  if (name == "on") {
+    *mode = Displayer::Vsync;
+  }
+  else if (name == "adaptive") {
+    *mode = Displayer::AdaptiveVsync;
+  }
+  else if (name == "low-latency") {
+    *mode = Displayer::LowLatency;
   }
-  if (ACGL_thread_stop(cv_thread) != 0) {
-    fprintf(stderr, "Error stopping cv_thread: %s\n", SDL_GetError());
+  else if (name == "off") {
+    *mode = Displayer::Immediate;
   }
+  else {
+    return false;
+  }
+  return true;
+}
 
-  ACGL_thread_destroy(graphics_thread);
-  ACGL_thread_destroy(cv_thread);
+static bool parse_frame_size(const cv::String& value, int* width, int* height) {
+  char rest;
+  return sscanf(value.c_str(), "%dx%d%c", width, height, &rest) == 2 && *width > 0 && *height > 0;
 }
 
 int main(int argc, const char** argv) {
+  // Also registers this thread, which renders, so it never allocates a ring mid-frame
+  Logger::start();
+  StartupProfiler::start();
   cv::CommandLineParser parser(argc, argv,
       "{help h||}"
       "{cam|0|}"
@@ -225,6 +339,38 @@ int main(int argc, const char** argv) {
       "{gd|1.6|}"
       "{face-cascade|data/haarcascades/haarcascade_frontalface_alt.xml|}"
       "{eyes-cascade|data/haarcascades/haarcascade_eye_tree_eyeglasses.xml|}"
+      "{vsync|on|}"
+      "{stats||}"
+      "{startup-report||}"
+      "{startup-json||}"
+      "{model-fps|0|}"
+      "{models||}"
+      "{sim-thread||}"
+      "{sim-rate|0|}"
+      "{virtual-clock|0|}"
+      "{seed||}"
+      "{no-lod||}"
+      "{frame-budget|0|}"
+      "{no-texture-compression||}"
+      "{texture-budget|0|}"
+      "{watch||}"
+      "{motion-cache|8|}"
+      "{allocator|malloc|}"
+      "{alloc-guard|off|}"
+      "{headless||}"
+      "{width|0|}"
+      "{height|0|}"
+      "{frames|0|}"
+      "{dump-dir||}"
+      "{shm||}"
+      "{shm-slots|3|}"
+      "{shm-max-size||}"
+      "{record||}"
+      "{record-fps|60|}"
+      "{record-queue|8|}"
+      "{record-camera||}"
+      "{bench-kernels||}"
+      "{pack-bundle||}"
   );
 
   if (parser.has("help")) {
@@ -232,29 +378,104 @@ int main(int argc, const char** argv) {
     return 0;
   }
 
+  if (parser.has("bench-kernels")) {
+    return PixelKernels::run_benchmark() ? 0 : 1;
+  }
+
+  if (parser.has("pack-bundle")) {
+    const std::string model_dir = std::string(LAppDefinitions::ResourcesPath) + parser.get<cv::String>("pack-bundle");
+    return ModelBundle::pack(model_dir, model_dir + LAppDefinitions::BundleExtension) ? 0 : 1;
+  }
+
   cv::String face_cascade_name = cv::samples::findFileOrKeep(parser.get<cv::String>("face-cascade"));
   cv::String eyes_cascade_name = cv::samples::findFileOrKeep(parser.get<cv::String>("eyes-cascade"));
 
+  Displayer::Options display_options;
+  if (!parse_swap_mode(parser.get<cv::String>("vsync"), &display_options.swap_mode)) {
+    std::cerr << "Error: unknown vsync mode \"" << parser.get<cv::String>("vsync") << "\"." << std::endl;
+    help(argv);
+    return 1;
+  }
+  if (!LAppAllocator::parse_mode(parser.get<cv::String>("allocator"), &display_options.allocator)) {
+    std::cerr << "Error: unknown allocator \"" << parser.get<cv::String>("allocator") << "\"." << std::endl;
+    help(argv);
+    return 1;
+  }
+  if (!AllocTracker::parse_guard_mode(parser.get<cv::String>("alloc-guard"), &display_options.alloc_guard)) {
+    std::cerr << "Error: unknown allocation guard mode \"" << parser.get<cv::String>("alloc-guard") << "\"." << std::endl;
+    help(argv);
+    return 1;
+  }
+  if (parser.has("shm-max-size") &&
+      !parse_frame_size(parser.get<cv::String>("shm-max-size"), &display_options.shm_max_width, &display_options.shm_max_height)) {
+    std::cerr << "Error: invalid shared memory frame size \"" << parser.get<cv::String>("shm-max-size") << "\"." << std::endl;
+    help(argv);
+    return 1;
+  }
+  display_options.print_stats = parser.has("stats");
+  display_options.model_fps = parser.get<float>("model-fps");
+  display_options.models = parse_list(parser.get<cv::String>("models"));
+  display_options.threaded_simulation = parser.has("sim-thread");
+  display_options.sim_rate = parser.get<float>("sim-rate");
+  display_options.virtual_fps = parser.get<double>("virtual-clock");
+  if (parser.has("seed")) {
+    srand(parser.get<unsigned int>("seed"));
+    display_options.deterministic = true;
+  }
+  display_options.lod = !parser.has("no-lod");
+  display_options.frame_budget_ms = parser.get<double>("frame-budget");
+  display_options.compress_textures = !parser.has("no-texture-compression");
+  display_options.motion_cache_mb = parser.get<double>("motion-cache");
+  display_options.texture_budget_mb = parser.get<double>("texture-budget");
+  display_options.hot_reload = parser.has("watch");
+  display_options.backend = parser.has("headless") ? Displayer::Headless : Displayer::Window;
+  display_options.width = parser.get<int>("width");
+  display_options.height = parser.get<int>("height");
+  display_options.max_frames = parser.get<unsigned int>("frames");
+  display_options.dump_dir = parser.get<cv::String>("dump-dir");
+  display_options.shm_name = parser.get<cv::String>("shm");
+  display_options.shm_slots = parser.get<int>("shm-slots");
+  display_options.record_path = parser.get<cv::String>("record");
+  display_options.record_fps = parser.get<double>("record-fps");
+  display_options.record_queue = parser.get<int>("record-queue");
+  display_options.record_camera_path = parser.get<cv::String>("record-camera");
+  display_options.record_camera_fps = 1000.0 / CV_TICK_MS;
+
   MainState* state = new MainState();
 
-  if (!state->dct.load_classifiers(face_cascade_name, eyes_cascade_name)) {
-    std::cerr << "Error: cannot open face and eyes cascade files \"" \
-      << face_cascade_name << "\" and \"" \
-      << eyes_cascade_name << "\"." \
-      << std::endl;
-    return 1;
+  {
+    StartupProfiler::Scope scope("load cascades");
+    if (!state->dct.load_classifiers(face_cascade_name, eyes_cascade_name)) {
+      std::cerr << "Error: cannot open face and eyes cascade files \"" \
+        << face_cascade_name << "\" and \"" \
+        << eyes_cascade_name << "\"." \
+        << std::endl;
+      return 1;
+    }
   }
 
   int camera_id = parser.get<int>("cam");
-  state->cap.open(camera_id);
+  cv::Mat frame;
+  {
+    StartupProfiler::Scope scope("open camera");
+    state->cap.open(camera_id);
+  }
   if (!state->cap.isOpened()) {
-    std::cerr << "Error: cannot open camera \"" \
-      << camera_id << "\"" \
-      << std::endl;
-    return 1;
+    if (display_options.backend != Displayer::Headless) {
+      std::cerr << "Error: cannot open camera \"" \
+        << camera_id << "\"" \
+        << std::endl;
+      return 1;
+    }
+    // Build servers don't have cameras, render a blank feed instead
+    std::cout << "No camera, using a blank frame." << std::endl;
+    state->has_camera = false;
+    frame = cv::Mat::zeros(480, 640, CV_8UC3);
+  }
+  else {
+    StartupProfiler::Scope scope("read first frame");
+    state->cap.read(frame);
   }
-  cv::Mat frame;
-  state->cap.read(frame);
   if (frame.empty()) {
     std::cout << "Blank frame encountered (hit end of video)" << std::endl;
     return false;
@@ -263,17 +484,36 @@ int main(int argc, const char** argv) {
   const int height = frame.rows;
   std::cout << "Camera Opened." << std::endl;
 
-  bg_input_init();
+  {
+    StartupProfiler::Scope scope("init keyboard hook");
+    bg_input_init();
+  }
   std::cout << "Background keyboard hook initialized." << std::endl;
 
   Displayer* disp = new Displayer();
-  if (!disp->initialize(width, height)) {
+  bool display_initialized;
+  {
+    StartupProfiler::Scope scope("init display");
+    display_initialized = disp->initialize(width, height, display_options);
+  }
+  if (!display_initialized) {
     std::cout << "Failed to open display, exiting early" << std::endl;
     goto main_cleanup;
   }
   std::cout << "Display opened with OpenGL." << std::endl;
 
   state->init(disp);
+  if (!state->has_camera) {
+    disp->update_cv(frame);
+  }
+
+  StartupProfiler::finish();
+  if (parser.has("startup-report")) {
+    StartupProfiler::report("startup");
+  }
+  if (!parser.get<cv::String>("startup-json").empty()) {
+    StartupProfiler::write_json(parser.get<cv::String>("startup-json"));
+  }
   mainloop(state);
 
   std::cout << "Done!" << std::endl;
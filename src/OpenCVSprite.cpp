@@ -1,5 +1,7 @@
 #include "OpenCVSprite.hpp"
-#include <iostream>
+
+#include "live2d/PixelKernels.hpp"
+#include "live2d/Logger.hpp"
 
 OpenCVSprite::OpenCVSprite(TextureManager* texture_manager, GLuint program_id, const int frame_width, const int frame_height)
   : width(frame_width),
@@ -24,11 +26,21 @@ OpenCVSprite::~OpenCVSprite() {
 
 void OpenCVSprite::update(cv::Mat& frame) {
   if (frame.cols != width || frame.rows != height) {
-    std::cerr << "Input image is " << frame.cols << " x " << frame.rows \
-      << ", but OpenCVSprite is " << width << " x " << height << std::endl;
+    APP_LOG_ERROR("Input image is %d x %d, but OpenCVSprite is %d x %d", frame.cols, frame.rows, width, height);
+    return;
+  }
+  if (frame.type() != CV_8UC3) {
+    APP_LOG_ERROR("Input image has OpenCV type %d, but OpenCVSprite expects 8 bit BGR", frame.type());
     return;
   }
-  std::cerr << "OpenGL Error Before OpenCVSprite::update: " << gluErrorString(glGetError()) << std::endl;
+
+  // Drivers copy 4 byte pixels straight through, 3 byte ones get converted on the CPU
+  _uploadBuffer.resize(static_cast<size_t>(width) * height * 4);
+  for (int y = 0; y < height; y++) {
+    PixelKernels::expand_to_four_channels(frame.ptr(y), _uploadBuffer.data() + static_cast<size_t>(y) * width * 4, width);
+  }
+
+  APP_LOG_VERBOSE("OpenGL Error Before OpenCVSprite::update: %s", reinterpret_cast<const char*>(gluErrorString(glGetError())));
   glActiveTexture(GL_TEXTURE0);
   glBindTexture(GL_TEXTURE_2D, _textureId);
   glTexSubImage2D(GL_TEXTURE_2D,
@@ -37,10 +49,10 @@ void OpenCVSprite::update(cv::Mat& frame) {
     0, // y offset
     width,
     height,
-    GL_BGR, // Input OpenCV format
+    GL_BGRA, // OpenCV's BGR with an opaque alpha
     GL_UNSIGNED_BYTE, // Input OpenCV data type
-    frame.data // Pointer to frame's buffer
+    _uploadBuffer.data()
   );
   glBindTexture(GL_TEXTURE_2D, 0);
-  std::cerr << "OpenGL Error After OpenCVSprite::update: " << gluErrorString(glGetError()) << std::endl;
+  APP_LOG_VERBOSE("OpenGL Error After OpenCVSprite::update: %s", reinterpret_cast<const char*>(gluErrorString(glGetError())));
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef DISPLAY_OPENCV_HPP
 #define DISPLAY_OPENCV_HPP
 
+#include <vector>
 #include <gl/glew.h>
 #include <opencv2/core.hpp>
 #include <SDL2/SDL.h>
@@ -34,6 +35,9 @@ public:
   void update(cv::Mat& frame);
 
   // This inherits from the main Sprite, and so contains it's `render` function
+
+private:
+  std::vector<uint8_t> _uploadBuffer; ///< The frame expanded to BGRA, reused between updates
 };
 
 #endif /* DISPLAY_OPENCV_HPP */
\ No newline at end of file
@@ -0,0 +1,218 @@
+#include "AllocTracker.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <new>
+#ifdef _WIN32
+#include <malloc.h>
+#elif defined(__APPLE__)
+#include <malloc/malloc.h>
+#else
+#include <malloc.h>
+#endif
+
+#include "Util.hpp"
+
+static std::atomic<int> phase{ AllocTracker::Startup };
+static std::atomic<int> guard_mode{ AllocTracker::GuardOff };
+static std::atomic<bool> guard_armed{ false };
+static thread_local const char* frame_scope = NULL; ///< Innermost scope on this thread
+
+#ifdef FACESTUFF_TRACK_ALLOCATIONS
+// Flagged allocations printed in GuardWarn mode before going quiet
+static const size_t MAX_GUARD_WARNINGS = 16;
+
+/**
+ * @brief Totals for one phase and source, relaxed since they're only read for reports
+ */
+struct Counters {
+  std::atomic<size_t> allocations{ 0 };
+  std::atomic<size_t> frees{ 0 };
+  std::atomic<size_t> bytes{ 0 }; ///< Allocated, never decreases
+};
+
+static Counters counters[AllocTracker::NUM_PHASES][AllocTracker::NUM_SOURCES];
+static std::atomic<long long> live_allocations{ 0 };
+static std::atomic<long long> live_bytes{ 0 };
+static std::atomic<long long> peak_bytes{ 0 };
+static std::atomic<size_t> flagged{ 0 };
+static thread_local bool in_guard = false; ///< Printing a warning, which may allocate itself
+#endif
+
+AllocTracker::FrameScope::FrameScope(const char* name) :
+  _previous(frame_scope)
+{
+  frame_scope = name;
+}
+
+AllocTracker::FrameScope::~FrameScope() {
+  frame_scope = _previous;
+}
+
+void AllocTracker::set_phase(Phase new_phase) {
+  phase.store(new_phase, std::memory_order_relaxed);
+}
+
+AllocTracker::Phase AllocTracker::get_phase() {
+  return static_cast<Phase>(phase.load(std::memory_order_relaxed));
+}
+
+const char* AllocTracker::get_phase_name(Phase phase) {
+  switch (phase) {
+  case Startup:
+    return "startup";
+  case ModelLoad:
+    return "model load";
+  case Frame:
+    return "frame";
+  case Shutdown:
+    return "shutdown";
+  default:
+    return "unknown";
+  }
+}
+
+void AllocTracker::set_guard_mode(GuardMode mode) {
+#ifndef FACESTUFF_TRACK_ALLOCATIONS
+  if (mode != GuardOff) {
+    LAppUtil::print_log("[APP] built without FACESTUFF_TRACK_ALLOCATIONS, the allocation guard does nothing");
+  }
+#endif
+  guard_mode.store(mode);
+}
+
+bool AllocTracker::parse_guard_mode(const std::string& name, GuardMode* mode) {
+  static const char* names[NUM_GUARD_MODES] = { "off", "warn", "abort" };
+  for (int i = 0; i < NUM_GUARD_MODES; i++) {
+    if (name == names[i]) {
+      *mode = static_cast<GuardMode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void AllocTracker::arm_guard() {
+  guard_armed.store(true);
+}
+
+void AllocTracker::report(const char* label) {
+#ifdef FACESTUFF_TRACK_ALLOCATIONS
+  for (int i = 0; i < NUM_PHASES; i++) {
+    const Counters& cubism = counters[i][Cubism];
+    const Counters& cxx = counters[i][New];
+    LAppUtil::print_log("[%s] allocations during %s: %zu cubism (%.2f MB), %zu new (%.2f MB), %zu frees",
+      label, get_phase_name(static_cast<Phase>(i)),
+      cubism.allocations.load(), cubism.bytes.load() / (1024.0 * 1024.0),
+      cxx.allocations.load(), cxx.bytes.load() / (1024.0 * 1024.0),
+      cubism.frees.load() + cxx.frees.load());
+  }
+  LAppUtil::print_log("[%s] allocations live: %lld (%.2f MB), peak %.2f MB",
+    label, live_allocations.load(), live_bytes.load() / (1024.0 * 1024.0), peak_bytes.load() / (1024.0 * 1024.0));
+  if (guard_mode.load() != GuardOff) {
+    LAppUtil::print_log("[%s] allocations in frame scopes after warm-up: %zu", label, flagged.load());
+  }
+#else
+  (void)label;
+#endif
+}
+
+#ifdef FACESTUFF_TRACK_ALLOCATIONS
+
+static size_t block_size(void* block) {
+#ifdef _WIN32
+  return _msize(block);
+#elif defined(__APPLE__)
+  return malloc_size(block);
+#else
+  return malloc_usable_size(block);
+#endif
+}
+
+static void check_guard(size_t bytes) {
+  const int mode = guard_mode.load(std::memory_order_relaxed);
+  if (mode == AllocTracker::GuardOff || frame_scope == NULL || in_guard ||
+      !guard_armed.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  in_guard = true;
+  const size_t count = ++flagged;
+  if (mode == AllocTracker::GuardAbort) {
+    fprintf(stderr, "[alloc guard] %zu byte allocation in %s after warm-up, aborting\n", bytes, frame_scope);
+    abort();
+  }
+  if (count <= MAX_GUARD_WARNINGS) {
+    fprintf(stderr, "[alloc guard] %zu byte allocation in %s after warm-up%s\n",
+      bytes, frame_scope, count == MAX_GUARD_WARNINGS ? ", not reporting any more" : "");
+  }
+  in_guard = false;
+}
+
+void AllocTracker::on_allocate(Source source, size_t bytes) {
+  Counters& c = counters[phase.load(std::memory_order_relaxed)][source];
+  c.allocations.fetch_add(1, std::memory_order_relaxed);
+  c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+  live_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  const long long live = live_bytes.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  long long peak = peak_bytes.load(std::memory_order_relaxed);
+  while (live > peak && !peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+  }
+
+  check_guard(bytes);
+}
+
+void AllocTracker::on_free(Source source, size_t bytes) {
+  counters[phase.load(std::memory_order_relaxed)][source].frees.fetch_add(1, std::memory_order_relaxed);
+  live_allocations.fetch_sub(1, std::memory_order_relaxed);
+  live_bytes.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+void AllocTracker::on_malloc(Source source, void* block) {
+  if (block != NULL) {
+    on_allocate(source, block_size(block));
+  }
+}
+
+void AllocTracker::on_malloc_free(Source source, void* block) {
+  if (block != NULL) {
+    on_free(source, block_size(block));
+  }
+}
+
+// Replacements for the global allocation functions. The nothrow, array and
+// sized forms all end up here by default; aligned new is left alone.
+
+void* operator new(size_t size) {
+  void* block = malloc(size == 0 ? 1 : size);
+  if (block == NULL) {
+    throw std::bad_alloc();
+  }
+  AllocTracker::on_malloc(AllocTracker::New, block);
+  return block;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* block) noexcept {
+  AllocTracker::on_malloc_free(AllocTracker::New, block);
+  free(block);
+}
+
+void operator delete[](void* block) noexcept {
+  operator delete(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+  operator delete(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+  operator delete(block);
+}
+
+#endif /* FACESTUFF_TRACK_ALLOCATIONS */
@@ -0,0 +1,88 @@
+#ifndef LIVE2D_ALLOC_TRACKER_HPP
+#define LIVE2D_ALLOC_TRACKER_HPP
+
+#include <stddef.h>
+#include <string>
+
+/**
+ * @brief Counts heap allocations by phase of the run, and flags the ones made inside frame scopes
+ *
+ * Cubism allocations are reported by LAppAllocator, everything else by the
+ * global operator new and delete. Only compiled in with
+ * FACESTUFF_TRACK_ALLOCATIONS, otherwise every hook is a no-op.
+ */
+class AllocTracker {
+public:
+  enum Phase {
+    Startup,
+    ModelLoad,
+    Frame,    ///< Steady state, once frames are being rendered
+    Shutdown,
+    NUM_PHASES
+  };
+
+  enum Source {
+    Cubism, ///< Through LAppAllocator
+    New,    ///< Through the global operator new
+    NUM_SOURCES
+  };
+
+  enum GuardMode {
+    GuardOff,
+    GuardWarn,  ///< Print the first few allocations made in a frame scope
+    GuardAbort, ///< Print the first allocation made in a frame scope, then abort
+    NUM_GUARD_MODES
+  };
+
+  /**
+   * @brief Marks the calling thread as being in the per-frame path for as long as it lives
+   *
+   * Scopes nest. Once the guard is armed, allocations made inside one are flagged.
+   */
+  class FrameScope {
+  public:
+    explicit FrameScope(const char* name);
+    ~FrameScope();
+
+  private:
+    const char* _previous;
+  };
+
+  /**
+   * @brief Attribute allocations from now on to a phase, on every thread
+   */
+  static void set_phase(Phase phase);
+  static Phase get_phase();
+  static const char* get_phase_name(Phase phase);
+
+  static void set_guard_mode(GuardMode mode);
+  static bool parse_guard_mode(const std::string& name, GuardMode* mode);
+
+  /**
+   * @brief Start flagging allocations in frame scopes, once caches have warmed up
+   */
+  static void arm_guard();
+
+  /**
+   * @brief Print counts per phase and source, live and peak bytes and how many allocations were flagged
+   */
+  static void report(const char* label);
+
+#ifdef FACESTUFF_TRACK_ALLOCATIONS
+  static void on_allocate(Source source, size_t bytes);
+  static void on_free(Source source, size_t bytes);
+
+  /**
+   * @brief Same as on_allocate/on_free, sized by what the C library reserved for a malloc'd block
+   */
+  static void on_malloc(Source source, void* block);
+  static void on_malloc_free(Source source, void* block);
+#else
+  static void on_allocate(Source, size_t) {}
+  static void on_free(Source, size_t) {}
+  static void on_malloc(Source, void*) {}
+  static void on_malloc_free(Source, void*) {}
+#endif
+};
+
+#endif /* LIVE2D_ALLOC_TRACKER_HPP */
@@ -1,43 +1,306 @@
 #include "Allocator.hpp"
 
-void* LAppAllocator::Allocate(const Csm::csmSizeType size) {
-  return malloc(size);
+#include <stdlib.h>
+#include <algorithm>
+
+#include "Util.hpp"
+#include "AllocTracker.hpp"
+
+// Payload sizes of the pools, anything larger goes to malloc
+static const size_t CLASS_SIZES[] = { 16, 32, 64, 128, 256 };
+static const size_t NUM_CLASSES = sizeof(CLASS_SIZES) / sizeof(CLASS_SIZES[0]);
+static const size_t POOL_CHUNK_SIZE = 64 * 1024;
+static const size_t ARENA_CHUNK_SIZE = 1024 * 1024;
+
+/**
+ * @brief Precedes every allocation outside Malloc mode, 16 bytes to keep payloads aligned
+ */
+struct BlockHeader {
+  uint32_t size_class; ///< NUM_CLASSES if the block came from malloc
+  uint32_t reserved;
+  uint64_t size;
+};
+static_assert(sizeof(BlockHeader) == 16, "BlockHeader must keep payloads 16 byte aligned");
+
+static thread_local LAppArena* current_arena = NULL;
+static std::mutex arenas_mutex;
+static std::vector<LAppArena*> arenas; ///< Every live arena, to tell their memory apart on free
+
+static void* aligned_malloc(size_t size, size_t alignment) {
+  alignment = std::max(alignment, sizeof(void*));
+#ifdef _WIN32
+  return _aligned_malloc(size, alignment);
+#else
+  // aligned_alloc wants a multiple of the alignment
+  return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
 }
 
-void LAppAllocator::Deallocate(void* memory) {
+static void aligned_free(void* memory) {
+#ifdef _WIN32
+  _aligned_free(memory);
+#else
   free(memory);
+#endif
 }
 
-void* LAppAllocator::AllocateAligned(const Csm::csmSizeType size, const Csm::csmUint32 alignment)
+LAppArena::LAppArena() :
+  _used(0),
+  _size(0)
 {
-  size_t offset, shift, alignedAddress;
-  void* allocation;
-  void** preamble;
-
-  offset = alignment - 1 + sizeof(void*);
+  std::lock_guard<std::mutex> lock(arenas_mutex);
+  arenas.push_back(this);
+}
 
-  allocation = Allocate(size + static_cast<Csm::csmUint32>(offset));
+LAppArena::~LAppArena() {
+  {
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+    arenas.erase(std::remove(arenas.begin(), arenas.end(), this), arenas.end());
+  }
+  if (current_arena == this) {
+    current_arena = NULL;
+  }
 
-  alignedAddress = reinterpret_cast<size_t>(allocation) + sizeof(void*);
+  for (size_t i = 0; i < _chunks.size(); i++) {
+    free(_chunks[i].data);
+  }
+  _chunks.clear();
+}
 
-  shift = alignedAddress % alignment;
+void* LAppArena::allocate(size_t size, size_t alignment) {
+  if (!_chunks.empty()) {
+    const Chunk& chunk = _chunks.back();
+    const uintptr_t start = reinterpret_cast<uintptr_t>(chunk.data) + _used;
+    const size_t padding = (alignment - start % alignment) % alignment;
+    if (_used + padding + size <= chunk.size) {
+      _used += padding + size;
+      _size += padding + size;
+      return reinterpret_cast<void*>(start + padding);
+    }
+  }
 
-  if (shift)
+  // What's left of the last chunk is abandoned, models only make a handful of these allocations
+  Chunk chunk;
+  chunk.size = std::max(ARENA_CHUNK_SIZE, size + alignment);
+  chunk.data = static_cast<uint8_t*>(malloc(chunk.size));
+  if (chunk.data == NULL) {
+    return NULL;
+  }
   {
-    alignedAddress += (alignment - shift);
+    // owns() may be walking the chunks from another thread
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+    _chunks.push_back(chunk);
   }
+  _used = 0;
+  return allocate(size, alignment);
+}
 
-  preamble = reinterpret_cast<void**>(alignedAddress);
-  preamble[-1] = allocation;
+bool LAppArena::owns(const void* memory) const {
+  const uint8_t* address = static_cast<const uint8_t*>(memory);
+  for (size_t i = 0; i < _chunks.size(); i++) {
+    if (address >= _chunks[i].data && address < _chunks[i].data + _chunks[i].size) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void LAppArena::set_current(LAppArena* arena) {
+  current_arena = arena;
+}
 
-  return reinterpret_cast<void*>(alignedAddress);
+LAppArena* LAppArena::get_current() {
+  return current_arena;
 }
 
-void LAppAllocator::DeallocateAligned(void* alignedMemory)
+LAppAllocator::LAppAllocator() :
+  _mode(Malloc),
+  _allocations(0),
+  _classes(NUM_CLASSES),
+  _bytesInUse(0),
+  _peakBytes(0)
 {
-  void** preamble;
+}
+
+LAppAllocator::~LAppAllocator() {
+  for (size_t i = 0; i < _chunks.size(); i++) {
+    free(_chunks[i]);
+  }
+}
+
+void LAppAllocator::set_mode(Mode mode) {
+  _mode = mode;
+}
+
+const char* LAppAllocator::get_mode_name(Mode mode) {
+  switch (mode) {
+  case Malloc:
+    return "malloc";
+  case Pool:
+    return "pool";
+  case Arena:
+    return "arena";
+  default:
+    return "unknown";
+  }
+}
+
+bool LAppAllocator::parse_mode(const std::string& name, Mode* mode) {
+  for (int i = 0; i < NUM_MODES; i++) {
+    if (name == get_mode_name(static_cast<Mode>(i))) {
+      *mode = static_cast<Mode>(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void LAppAllocator::report(const char* label) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  LAppUtil::print_log("[%s] allocator %s: %zu allocations", label, get_mode_name(_mode), _allocations.load());
+  if (_mode == Malloc) {
+    return;
+  }
 
-  preamble = static_cast<void**>(alignedMemory);
+  size_t carved = 0;
+  size_t used = 0;
+  for (size_t i = 0; i < NUM_CLASSES; i++) {
+    carved += _classes[i].blocks * (sizeof(BlockHeader) + CLASS_SIZES[i]);
+    used += _classes[i].used * (sizeof(BlockHeader) + CLASS_SIZES[i]);
+  }
+  LAppUtil::print_log("[%s] allocator peak %.2f MB requested, pools %.2f of %.2f MB in use",
+    label, _peakBytes / (1024.0 * 1024.0), used / (1024.0 * 1024.0), carved / (1024.0 * 1024.0));
+
+  if (_mode == Arena) {
+    std::lock_guard<std::mutex> arenas_lock(arenas_mutex);
+    size_t arena_bytes = 0;
+    for (size_t i = 0; i < arenas.size(); i++) {
+      arena_bytes += arenas[i]->get_size();
+    }
+    LAppUtil::print_log("[%s] allocator %zu arenas holding %.2f MB", label, arenas.size(), arena_bytes / (1024.0 * 1024.0));
+  }
+}
+
+void* LAppAllocator::Allocate(const Csm::csmSizeType size) {
+  _allocations++;
+  if (_mode == Malloc) {
+    void* memory = malloc(size);
+    AllocTracker::on_malloc(AllocTracker::Cubism, memory);
+    return memory;
+  }
+
+  size_t size_class = 0;
+  while (size_class < NUM_CLASSES && CLASS_SIZES[size_class] < size) {
+    size_class++;
+  }
 
-  Deallocate(preamble[-1]);
-}
\ No newline at end of file
+  BlockHeader* header = NULL;
+  if (size_class == NUM_CLASSES) {
+    header = static_cast<BlockHeader*>(malloc(sizeof(BlockHeader) + size));
+    if (header == NULL) {
+      return NULL;
+    }
+  }
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  if (header == NULL) {
+    SizeClass& pool = _classes[size_class];
+    if (pool.free_list == NULL) {
+      // Carve a new chunk into blocks, threading them onto the free list
+      const size_t block_size = sizeof(BlockHeader) + CLASS_SIZES[size_class];
+      uint8_t* chunk = static_cast<uint8_t*>(malloc(POOL_CHUNK_SIZE));
+      if (chunk == NULL) {
+        return NULL;
+      }
+      _chunks.push_back(chunk);
+      for (size_t offset = 0; offset + block_size <= POOL_CHUNK_SIZE; offset += block_size) {
+        void* block = chunk + offset;
+        *static_cast<void**>(block) = pool.free_list;
+        pool.free_list = block;
+        pool.blocks++;
+      }
+    }
+
+    header = static_cast<BlockHeader*>(pool.free_list);
+    pool.free_list = *static_cast<void**>(pool.free_list);
+    pool.used++;
+  }
+
+  header->size_class = static_cast<uint32_t>(size_class);
+  header->reserved = 0;
+  header->size = size;
+  _bytesInUse += size;
+  _peakBytes = std::max(_peakBytes, _bytesInUse);
+  AllocTracker::on_allocate(AllocTracker::Cubism, size);
+  return header + 1;
+}
+
+void LAppAllocator::Deallocate(void* memory) {
+  if (_mode == Malloc) {
+    AllocTracker::on_malloc_free(AllocTracker::Cubism, memory);
+    free(memory);
+    return;
+  }
+  if (memory == NULL) {
+    return;
+  }
+
+  BlockHeader* header = static_cast<BlockHeader*>(memory) - 1;
+  AllocTracker::on_free(AllocTracker::Cubism, header->size);
+  std::lock_guard<std::mutex> lock(_mutex);
+  _bytesInUse -= header->size;
+  if (header->size_class == NUM_CLASSES) {
+    free(header);
+    return;
+  }
+
+  SizeClass& pool = _classes[header->size_class];
+  *reinterpret_cast<void**>(header) = pool.free_list;
+  pool.free_list = header;
+  pool.used--;
+}
+
+void* LAppAllocator::AllocateAligned(const Csm::csmSizeType size, const Csm::csmUint32 alignment) {
+  _allocations++;
+  // The framework only allocates aligned for mocs and models, which live exactly as long as their model
+  LAppArena* arena = LAppArena::get_current();
+  void* memory = _mode == Arena && arena != NULL ? arena->allocate(size, alignment) : aligned_malloc(size, alignment);
+
+#ifdef FACESTUFF_TRACK_ALLOCATIONS
+  if (memory != NULL) {
+    // Neither arenas nor _aligned_malloc can tell the size again on free
+    std::lock_guard<std::mutex> lock(_mutex);
+    _alignedSizes[memory] = size;
+    AllocTracker::on_allocate(AllocTracker::Cubism, size);
+  }
+#endif
+  return memory;
+}
+
+void LAppAllocator::DeallocateAligned(void* aligned_memory) {
+  if (aligned_memory == NULL) {
+    return;
+  }
+
+#ifdef FACESTUFF_TRACK_ALLOCATIONS
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    auto allocation = _alignedSizes.find(aligned_memory);
+    if (allocation != _alignedSizes.end()) {
+      AllocTracker::on_free(AllocTracker::Cubism, allocation->second);
+      _alignedSizes.erase(allocation);
+    }
+  }
+#endif
+
+  if (_mode == Arena) {
+    // Arena memory goes when its arena does
+    std::lock_guard<std::mutex> lock(arenas_mutex);
+    for (size_t i = 0; i < arenas.size(); i++) {
+      if (arenas[i]->owns(aligned_memory)) {
+        return;
+      }
+    }
+  }
+  aligned_free(aligned_memory);
+}
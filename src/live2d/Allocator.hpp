@@ -1,18 +1,112 @@
 #ifndef LIVE2D_APP_ALLOCATOR_HPP
 #define LIVE2D_APP_ALLOCATOR_HPP
 
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
 #include <CubismFramework.hpp>
 #include <ICubismAllocator.hpp>
 
+/**
+ * @brief Memory a model's moc and model data are carved out of, freed all at once when it's deleted
+ *
+ * Only used while the allocator is in LAppAllocator::Arena mode.
+ */
+class LAppArena {
+public:
+  LAppArena();
+  ~LAppArena();
+
+  void* allocate(size_t size, size_t alignment);
+  bool owns(const void* memory) const;
+
+  /**
+   * @brief Bytes handed out, padding included
+   */
+  size_t get_size() const { return _size; }
+
+  /**
+   * @brief Aligned allocations on the calling thread go into this arena until it's reset to NULL
+   *
+   * @param[in] arena
+   */
+  static void set_current(LAppArena* arena);
+  static LAppArena* get_current();
+
+private:
+  struct Chunk {
+    uint8_t* data;
+    size_t size;
+  };
+
+  std::vector<Chunk> _chunks;
+  size_t _used; ///< Bytes used of the last chunk
+  size_t _size;
+};
+
 /**
 * @brief Custom allocator for Live2D memory
 */
 class LAppAllocator : public Csm::ICubismAllocator {
+public:
+  enum Mode {
+    Malloc, ///< Straight to the C library
+    Pool,   ///< Small allocations from size class pools
+    Arena,  ///< Pool, plus moc and model data from a per-model LAppArena
+    NUM_MODES
+  };
+
+  LAppAllocator();
+  ~LAppAllocator();
+
+  /**
+   * @brief Choose how memory is allocated, before the framework starts up
+   *
+   * @param[in] mode
+   */
+  void set_mode(Mode mode);
+  Mode get_mode() const { return _mode; }
+  static const char* get_mode_name(Mode mode);
+
+  /**
+   * @brief Parse a mode from its name
+   *
+   * @return false if the name is unknown
+   */
+  static bool parse_mode(const std::string& name, Mode* mode);
+
+  /**
+   * @brief Print allocation counts and how much memory the pools and arenas hold
+   */
+  void report(const char* label);
+
+private:
   void* Allocate(const Csm::csmSizeType size);
   void Deallocate(void* memory);
 
   void* AllocateAligned(const Csm::csmSizeType size, const Csm::csmUint32 alignment);
   void DeallocateAligned(void* aligned_memory);
+
+  /**
+   * @brief Free blocks of one size, carved out of chunks that live as long as the allocator
+   */
+  struct SizeClass {
+    void* free_list = NULL;
+    size_t blocks = 0; ///< Carved so far
+    size_t used = 0;
+  };
+
+  Mode _mode;
+  std::atomic<size_t> _allocations;
+  std::mutex _mutex; ///< Guards everything below, models allocate from the simulation thread too
+  std::vector<SizeClass> _classes;
+  std::vector<void*> _chunks;
+  std::unordered_map<void*, size_t> _alignedSizes; ///< Only kept with FACESTUFF_TRACK_ALLOCATIONS
+  size_t _bytesInUse; ///< Requested bytes, only counted outside Malloc mode
+  size_t _peakBytes;
 };
 
-#endif /* LIVE2D_APP_ALLOCATOR_HPP */
\ No newline at end of file
+#endif /* LIVE2D_APP_ALLOCATOR_HPP */
@@ -0,0 +1,22 @@
+#include "Clock.hpp"
+
+#include "Util.hpp"
+
+double RealClock::now() const {
+  return LAppUtil::get_time_seconds();
+}
+
+VirtualClock::VirtualClock(double frame_rate) :
+  _step(frame_rate > 0.0 ? 1.0 / frame_rate : 0.0),
+  _time(0.0)
+{
+  // Pass
+}
+
+void VirtualClock::tick() {
+  _time += _step;
+}
+
+double VirtualClock::now() const {
+  return _time;
+}
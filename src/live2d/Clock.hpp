@@ -0,0 +1,55 @@
+#ifndef LIVE2D_CLOCK_HPP
+#define LIVE2D_CLOCK_HPP
+
+/**
+ * @brief Source of the frame time that drives model simulation
+ *
+ * Only affects how far models are advanced between frames. Frame statistics
+ * and profiling always measure real time.
+ */
+class Clock {
+public:
+  virtual ~Clock() {}
+
+  /**
+   * @brief Called once per frame, before the time is read
+   */
+  virtual void tick() {}
+
+  /**
+   * @brief Current time in seconds, from an arbitrary fixed point
+   */
+  virtual double now() const = 0;
+};
+
+/**
+ * @brief Wall clock time from the high resolution performance counter
+ */
+class RealClock : public Clock {
+public:
+  virtual double now() const;
+};
+
+/**
+ * @brief A clock that advances by exactly the same amount every frame
+ *
+ * Makes a run independent of how fast frames actually render, so benchmarks
+ * and replays can run faster than real time and still produce identical
+ * results.
+ */
+class VirtualClock : public Clock {
+public:
+  /**
+   * @param[in] frame_rate Frames per simulated second
+   */
+  explicit VirtualClock(double frame_rate);
+
+  virtual void tick();
+  virtual double now() const;
+
+private:
+  double _step;
+  double _time;
+};
+
+#endif /* LIVE2D_CLOCK_HPP */
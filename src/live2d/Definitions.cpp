@@ -63,13 +63,27 @@ namespace LAppDefinitions {
   const csmInt32 PriorityForce = 3;
 
   // デバッグ用ログの表示オプション
-  const csmBool DebugLogEnable = true;
   const csmBool DebugTouchLogEnable = false;
 
   // Frameworkから出力するログのレベル設定
-  const CubismFramework::Option::LogLevel CubismLoggingLevel = CubismFramework::Option::LogLevel::LogLevel_Verbose;
+  // Records below FACESTUFF_LOG_LEVEL would be compiled out anyway, so Cubism needn't format them
+  const CubismFramework::Option::LogLevel CubismLoggingLevel = static_cast<CubismFramework::Option::LogLevel>(FACESTUFF_LOG_LEVEL);
+  static_assert(static_cast<int>(CubismFramework::Option::LogLevel_Verbose) == Logger::Verbose &&
+    static_cast<int>(CubismFramework::Option::LogLevel_Off) == Logger::Off, "Logger levels must match Cubism's");
 
   // デフォルトのレンダーターゲットサイズ
   const csmInt32 RenderTargetWidth = 1900;
   const csmInt32 RenderTargetHeight = 1000;
+
+  // Parsed motions kept per model once they stop playing, in bytes of motion3.json
+  const csmSizeType MotionCacheBudget = 8 * 1024 * 1024;
+
+  // Appended to a model's directory to find its bundle, made with --pack-bundle
+  const csmChar* BundleExtension = ".bundle";
+
+  // Compiled shader programs, keyed by source and driver
+  const csmChar* ShaderCachePath = "cache/shaders/";
+
+  // Compressed model textures, keyed by image path
+  const csmChar* TextureCachePath = "cache/textures/";
 }
\ No newline at end of file
@@ -9,6 +9,8 @@
 
 #include <CubismFramework.hpp>
 
+#include "Logger.hpp"
+
  /**
  * @brief  Sample Appで使用する定数
  *
@@ -55,7 +57,7 @@ namespace LAppDefinitions {
   extern const csmInt32 PriorityForce;            ///< モーションの優先度定数: 3
 
                                                   // デバッグ用ログの表示
-  extern const csmBool DebugLogEnable;            ///< デバッグ用ログ表示の有効・無効
+  constexpr csmBool DebugLogEnable = FACESTUFF_LOG_LEVEL <= Logger::Debug; ///< デバッグ用ログ表示の有効・無効
   extern const csmBool DebugTouchLogEnable;       ///< タッチ処理のデバッグ用ログ表示の有効・無効
 
   // Frameworkから出力するログのレベル設定
@@ -64,4 +66,16 @@ namespace LAppDefinitions {
   // デフォルトのレンダーターゲットサイズ
   extern const csmInt32 RenderTargetWidth;
   extern const csmInt32 RenderTargetHeight;
+
+  // Parsed motions kept per model once they stop playing, in bytes of motion3.json
+  extern const csmSizeType MotionCacheBudget;
+
+  // Appended to a model's directory to find its bundle, made with --pack-bundle
+  extern const csmChar* BundleExtension;
+
+  // Compiled shader programs, keyed by source and driver
+  extern const csmChar* ShaderCachePath;
+
+  // Compressed model textures, keyed by image path
+  extern const csmChar* TextureCachePath;
 }
\ No newline at end of file
@@ -6,15 +6,66 @@
 #include <SDL_opengl.h>
 #include <gl/GLU.h>
 #include <Utils/CubismDebug.hpp>
+#include <opencv2/imgcodecs.hpp>
 
 #include "Util.hpp"
 #include "Definitions.hpp"
+#include "SharedMemorySink.hpp"
+#include "StartupProfiler.hpp"
 
 static const char* DEFAULT_NAME = "FaceStuff";
 static const int DEFAULT_WIDTH = 640;
 static const int DEFAULT_HEIGHT = 480;
 
-bool Displayer::initialize(const int cv_width, const int cv_height) {
+// Load pressure goes up above the high mark and down below the low one, as a share of the budget
+static const double LOAD_HIGH_MARK = 0.9;
+static const double LOAD_LOW_MARK = 0.5;
+// Seconds between load pressure changes, so one change can take effect before the next
+static const double LOAD_HOLD_TIME = 1.0;
+// Weight of the newest frame in the moving average
+static const double LOAD_SMOOTHING = 0.1;
+static const double DEFAULT_FRAME_BUDGET_MS = 1000.0 / 60.0;
+
+bool Displayer::initialize(const int cv_width, const int cv_height, const Options& options) {
+  _options = options;
+  AllocTracker::set_guard_mode(_options.alloc_guard);
+  // Levels follow frame times and the window, which would make reproducible runs differ
+  if (_options.deterministic || _options.virtual_fps > 0.0) {
+    _options.lod = false;
+  }
+
+  bool initialized;
+  {
+    StartupProfiler::Scope scope(_options.backend == Headless ? "create headless context" : "create window");
+    initialized = _options.backend == Headless ? initialize_headless() : initialize_window();
+  }
+  if (!initialized) {
+    return false;
+  }
+
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+  glEnable(GL_BLEND);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  SDL_GL_GetDrawableSize(_window, &_windowWidth, &_windowHeight);
+
+  if (_options.virtual_fps > 0.0) {
+    _clock = new VirtualClock(_options.virtual_fps);
+    LAppUtil::set_clock(_clock);
+  }
+
+  initialize_cubism(cv_width, cv_height);
+  {
+    StartupProfiler::Scope scope("open frame sinks");
+    initialize_sinks();
+  }
+
+  return true;
+}
+
+bool Displayer::initialize_window() {
   if (SDL_Init(SDL_INIT_VIDEO) < 0) {
     fprintf(stderr, "Error initializing SDL: %s\n", SDL_GetError());
     return false;
@@ -23,12 +74,12 @@ bool Displayer::initialize(const int cv_width, const int cv_height) {
   _window = SDL_CreateWindow(
     DEFAULT_NAME,
     SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
-    DEFAULT_WIDTH, DEFAULT_HEIGHT,
+    _options.width > 0 ? _options.width : DEFAULT_WIDTH,
+    _options.height > 0 ? _options.height : DEFAULT_HEIGHT,
     SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE | SDL_WINDOW_ALLOW_HIGHDPI | SDL_WINDOW_OPENGL
   );
   if (_window == NULL) {
     fprintf(stderr, "Error creating SDL window: %s\n", SDL_GetError());
-    SDL_Quit();
     return false;
   }
 
@@ -36,7 +87,6 @@ bool Displayer::initialize(const int cv_width, const int cv_height) {
   _context = SDL_GL_CreateContext(_window);
   if (_context == NULL) {
     fprintf(stderr, "Error initializing GL context: %s\n", SDL_GetError());
-    SDL_Quit();
     return false;
   }
 
@@ -44,38 +94,108 @@ bool Displayer::initialize(const int cv_width, const int cv_height) {
   GLenum glewError = glewInit();
   if (glewError != GLEW_OK) {
     fprintf(stderr, "Error initializing GLEW: %s\n", glewGetErrorString(glewError));
-    SDL_DestroyWindow(_window);
-    SDL_Quit();
     return false;
   }
 
-  // Set VSync
-  if (SDL_GL_SetSwapInterval(1) < 0) {
-    fprintf(stderr, "Warning: unable to set VSync: %s\n", SDL_GetError());
+  apply_swap_mode();
+
+  return true;
+}
+
+bool Displayer::initialize_headless() {
+  if (!HeadlessContext::is_supported()) {
+    fprintf(stderr, "Error: this build has no headless rendering backend\n");
+    return false;
   }
 
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  // The offscreen video driver works without any display server. The window
+  // never gets a GL context of its own, it only carries the drawable size that
+  // the view, sprites and GUI layout query through SDL.
+  SDL_setenv("SDL_VIDEODRIVER", "offscreen", 1);
+  if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+    fprintf(stderr, "Error initializing SDL offscreen driver: %s\n", SDL_GetError());
+    return false;
+  }
 
-  glEnable(GL_BLEND);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+  const int width = _options.width > 0 ? _options.width : DEFAULT_WIDTH;
+  const int height = _options.height > 0 ? _options.height : DEFAULT_HEIGHT;
+  _window = SDL_CreateWindow(
+    DEFAULT_NAME,
+    SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+    width, height,
+    SDL_WINDOW_HIDDEN
+  );
+  if (_window == NULL) {
+    fprintf(stderr, "Error creating offscreen SDL window: %s\n", SDL_GetError());
+    return false;
+  }
 
-  SDL_GL_GetDrawableSize(_window, &_windowWidth, &_windowHeight);
+  _headless = new HeadlessContext();
+  if (!_headless->initialize(width, height)) {
+    return false;
+  }
 
-  initialize_cubism(cv_width, cv_height);
+  // Nothing to sync against, frames are only limited by how fast they render
+  _frameStats.set_refresh_period(0.0);
 
   return true;
 }
 
 void Displayer::release() {
-  SDL_DestroyWindow(_window);
-  SDL_Quit();
+  AllocTracker::set_phase(AllocTracker::Shutdown);
+  if (_options.print_stats) {
+    _frameStats.report("frame stats");
+    _gpuProfiler.report("frame stats");
+    _view->report_lod("frame stats");
+    _cubismAllocator.report("frame stats");
+    _textureManager->report("frame stats");
+    if (_sinks.GetSize() > 0) {
+      LAppUtil::print_log("[frame stats] readback dropped %llu frames", _readback.get_dropped_frames());
+    }
+  }
 
+  // Deleting the recorder waits for its queue to be written out
+  for (Csm::csmUint32 i = 0; i < _sinks.GetSize(); i++) {
+    delete _sinks[i];
+  }
+  _sinks.Clear();
+  _recorder = NULL;
+
+  // GL resources go first, while their context is still alive
+  _readback.release();
+  _gpuProfiler.release();
+  delete _view;
+  _view = NULL;
   delete _textureManager;
+  _textureManager = NULL;
   delete _shaderManager;
-  delete _view;
+  _shaderManager = NULL;
 
   Csm::CubismFramework::Dispose();
+  if (_options.print_stats) {
+    // Anything still live by now has leaked
+    AllocTracker::report("frame stats");
+  }
+
+  if (_clock != NULL) {
+    LAppUtil::set_clock(NULL);
+    delete _clock;
+    _clock = NULL;
+  }
+
+  if (_headless != NULL) {
+    delete _headless;
+    _headless = NULL;
+  }
+  if (_context != NULL) {
+    SDL_GL_DeleteContext(_context);
+    _context = NULL;
+  }
+  if (_window != NULL) {
+    SDL_DestroyWindow(_window);
+    _window = NULL;
+  }
+  SDL_Quit();
 }
 
 int Displayer::check_resize(SDL_Event, void* obj) {
@@ -100,13 +220,236 @@ void Displayer::check_resize() {
 }
 
 void Displayer::render() {
+  const double frame_start = LAppUtil::get_time_seconds();
+  AllocTracker::set_phase(AllocTracker::Frame);
+
+  _gpuProfiler.begin_frame();
+  const int frame_scope = _gpuProfiler.begin(_gpuFrameSection);
+
   glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glClearDepth(1.0);
 
   _view->render();
 
-  SDL_GL_SwapWindow(_window);
+  if (!_options.dump_dir.empty()) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/frame_%06llu.png", _options.dump_dir.c_str(), _frameCount.load());
+    if (!dump_frame(path)) {
+      fprintf(stderr, "Error writing frame dump %s\n", path);
+    }
+  }
+
+  if (_sinks.GetSize() > 0) {
+    publish_frame(frame_start);
+  }
+
+  _gpuProfiler.end(frame_scope);
+
+  const double swap_start = LAppUtil::get_time_seconds();
+  const int swap_scope = _gpuProfiler.begin(_gpuSwapSection);
+  if (_headless != NULL) {
+    _headless->present();
+  }
+  else {
+    SDL_GL_SwapWindow(_window);
+  }
+  if (_options.swap_mode == LowLatency && _headless == NULL) {
+    // Drivers are free to return from the swap before it happens and let the
+    // CPU run frames ahead. Waiting here means the next frame starts right
+    // after the vblank, with the freshest possible input.
+    glFinish();
+  }
+  _gpuProfiler.end(swap_scope);
+  const double swap_end = LAppUtil::get_time_seconds();
+
+  record_frame(frame_start, swap_start, swap_end);
+
+  const unsigned long long frame_count = ++_frameCount;
+  if (frame_count == _options.alloc_guard_warmup) {
+    // Caches, pools and buffers have had time to fill, so anything allocating from here on does it every frame
+    AllocTracker::arm_guard();
+  }
+  if (_options.max_frames > 0 && frame_count >= _options.max_frames) {
+    app_end();
+  }
+}
+
+void Displayer::initialize_sinks() {
+  if (!_options.shm_name.empty()) {
+    SharedMemorySink* sink = new SharedMemorySink();
+    const int max_width = _options.shm_max_width > 0 ? _options.shm_max_width : _windowWidth;
+    const int max_height = _options.shm_max_height > 0 ? _options.shm_max_height : _windowHeight;
+    if (sink->initialize(_options.shm_name, _options.shm_slots, max_width, max_height)) {
+      _sinks.PushBack(sink);
+    }
+    else {
+      delete sink;
+    }
+  }
+
+  if (!_options.record_path.empty()) {
+    Recorder* recorder = new Recorder();
+    if (recorder->initialize(_options.record_path, _options.record_fps, _options.record_queue,
+                             _options.record_camera_path, _options.record_camera_fps)) {
+      _sinks.PushBack(recorder);
+      _recorder = recorder;
+    }
+    else {
+      delete recorder;
+    }
+  }
+}
+
+void Displayer::record_camera(const cv::Mat& frame) {
+  Recorder* recorder = _recorder;
+  if (recorder != NULL && !_options.record_camera_path.empty()) {
+    recorder->consume_camera(frame, _frameCount.load(), LAppUtil::get_time_seconds());
+  }
+}
+
+void Displayer::publish_frame(double timestamp) {
+  _readback.queue_read(_frameCount.load(), timestamp, _windowWidth, _windowHeight);
+
+  // This is the previous frame, which the GPU has had a whole swap to finish
+  const ReadbackFrame* frame = _readback.map_ready();
+  if (frame == NULL) {
+    return;
+  }
+
+  for (Csm::csmUint32 i = 0; i < _sinks.GetSize(); i++) {
+    _sinks[i]->consume(*frame);
+  }
+
+  _readback.unmap();
+}
+
+bool Displayer::dump_frame(const std::string& path) {
+  if (_windowWidth <= 0 || _windowHeight <= 0) {
+    return false;
+  }
+
+  cv::Mat frame(_windowHeight, _windowWidth, CV_8UC4);
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, _windowWidth, _windowHeight, GL_BGRA, GL_UNSIGNED_BYTE, frame.data);
+  // GL rows start at the bottom
+  cv::flip(frame, frame, 0);
+
+  return cv::imwrite(path, frame);
+}
+
+bool Displayer::is_hidden() const {
+  if (_headless != NULL) {
+    // Never shown, but always rendering
+    return false;
+  }
+  if (_window == NULL) {
+    return true;
+  }
+
+  Uint32 flags = SDL_GetWindowFlags(_window);
+  return (flags & (SDL_WINDOW_HIDDEN | SDL_WINDOW_MINIMIZED)) != 0;
+}
+
+void Displayer::apply_swap_mode() {
+  int interval;
+  switch (_options.swap_mode) {
+  case Immediate:
+    interval = 0;
+    break;
+  case AdaptiveVsync:
+    interval = -1;
+    break;
+  case Vsync:
+  case LowLatency:
+  default:
+    interval = 1;
+    break;
+  }
+
+  if (SDL_GL_SetSwapInterval(interval) < 0) {
+    if (interval == -1) {
+      fprintf(stderr, "Warning: adaptive VSync unsupported, falling back to VSync: %s\n", SDL_GetError());
+      interval = 1;
+      if (SDL_GL_SetSwapInterval(interval) < 0) {
+        fprintf(stderr, "Warning: unable to set VSync: %s\n", SDL_GetError());
+      }
+    }
+    else {
+      fprintf(stderr, "Warning: unable to set swap interval %d: %s\n", interval, SDL_GetError());
+    }
+  }
+
+  // Used by the stats to count frames that missed their vblank
+  SDL_DisplayMode mode;
+  int display = SDL_GetWindowDisplayIndex(_window);
+  if (interval != 0 && display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0) {
+    _frameStats.set_refresh_period(1000.0 / mode.refresh_rate);
+  }
+  else {
+    _frameStats.set_refresh_period(0.0);
+  }
+}
+
+void Displayer::record_frame(double frame_start, double swap_start, double swap_end) {
+  if (_lastSwapTime > 0.0) {
+    _frameStats.record(
+      (swap_end - _lastSwapTime) * 1000.0,
+      (swap_start - frame_start) * 1000.0,
+      (swap_end - swap_start) * 1000.0
+    );
+  }
+  _lastSwapTime = swap_end;
+
+  if (_options.lod) {
+    update_load_pressure((swap_start - frame_start) * 1000.0, swap_end);
+  }
+
+  if (!_options.print_stats) {
+    return;
+  }
+
+  if (_lastReportTime == 0.0) {
+    _lastReportTime = swap_end;
+  }
+  else if (swap_end - _lastReportTime >= _options.stats_interval) {
+    _frameStats.report("frame stats");
+    _gpuProfiler.report("frame stats");
+    _view->report_lod("frame stats");
+    _lastReportTime = swap_end;
+  }
+}
+
+void Displayer::update_load_pressure(double cpu_ms, double now) {
+  _averageCpuMs = _averageCpuMs == 0.0 ? cpu_ms : _averageCpuMs + (cpu_ms - _averageCpuMs) * LOAD_SMOOTHING;
+  if (now - _lastPressureChange < LOAD_HOLD_TIME) {
+    return;
+  }
+
+  double budget_ms = _options.frame_budget_ms;
+  if (budget_ms <= 0.0) {
+    budget_ms = _frameStats.get_refresh_period() > 0.0 ? _frameStats.get_refresh_period() : DEFAULT_FRAME_BUDGET_MS;
+  }
+
+  int pressure = _loadPressure;
+  if (_averageCpuMs > budget_ms * LOAD_HIGH_MARK && pressure < Model::LodMinimal) {
+    pressure++;
+  }
+  else if (_averageCpuMs < budget_ms * LOAD_LOW_MARK && pressure > Model::LodFull) {
+    pressure--;
+  }
+  if (pressure == _loadPressure) {
+    return;
+  }
+
+  _loadPressure = pressure;
+  _lastPressureChange = now;
+  _view->set_load_pressure(pressure);
+}
+
+void Displayer::idle() {
+  _view->set_hidden(true);
+  LAppUtil::update_time();
 }
 
 Displayer::Displayer() :
@@ -115,7 +458,23 @@ Displayer::Displayer() :
   _context(NULL),
   _isEnd(false),
   _windowWidth(0),
-  _windowHeight(0)
+  _windowHeight(0),
+  _headless(NULL),
+  _clock(NULL),
+  _frameCount(0),
+  _readback(),
+  _sinks(),
+  _recorder(NULL),
+  _options(),
+  _frameStats(),
+  _gpuProfiler(),
+  _gpuFrameSection(-1),
+  _gpuSwapSection(-1),
+  _lastSwapTime(0.0),
+  _lastReportTime(0.0),
+  _averageCpuMs(0.0),
+  _loadPressure(Model::LodFull),
+  _lastPressureChange(0.0)
 {
   _textureManager = new TextureManager();
   _shaderManager = new ShaderManager();
@@ -130,11 +489,39 @@ void Displayer::initialize_cubism(const int cv_width, const int cv_height) {
   _cubismOptions.LogFunction = LAppUtil::print_message;
   _cubismOptions.LoggingLevel = LAppDefinitions::CubismLoggingLevel; // Live2D::Cubism::Framework::CubismFramework::Option::LogLevel::LogLevel_Verbose;
   
-  Csm::CubismFramework::StartUp(&_cubismAllocator, &_cubismOptions);
-  Csm::CubismFramework::Initialize();
+  _cubismAllocator.set_mode(_options.allocator);
+  {
+    StartupProfiler::Scope scope("start Cubism framework");
+    Csm::CubismFramework::StartUp(&_cubismAllocator, &_cubismOptions);
+    Csm::CubismFramework::Initialize();
+  }
 
   _view->initialize_matricies(_window);
-  _view->initialize_sprites(_textureManager, _shaderManager, cv_width, cv_height);
+  if (_options.compress_textures) {
+    _textureManager->enable_compression();
+  }
+  _textureManager->set_vram_budget(static_cast<size_t>(_options.texture_budget_mb * 1024.0 * 1024.0));
+  {
+    StartupProfiler::Scope scope("load models");
+    _view->initialize_sprites(_textureManager, _shaderManager, cv_width, cv_height, _options.models);
+  }
+  _view->set_model_update_rate(_options.model_fps);
+  _view->set_fixed_timestep(_options.sim_rate);
+  _view->set_deterministic(_options.deterministic);
+  _view->set_lod_enabled(_options.lod);
+  _view->set_motion_budget(static_cast<size_t>(_options.motion_cache_mb * 1024.0 * 1024.0));
+  if (_options.hot_reload && !_view->enable_hot_reload(_textureManager)) {
+    fprintf(stderr, "Warning: could not watch the models for changes\n");
+  }
+  if (_options.threaded_simulation && !_view->start_simulation_thread(_textureManager)) {
+    fprintf(stderr, "Warning: could not start the simulation thread, simulating on the render thread\n");
+  }
+
+  if (_options.print_stats && _gpuProfiler.initialize()) {
+    _gpuFrameSection = _gpuProfiler.add_section("frame");
+    _gpuSwapSection = _gpuProfiler.add_section("swap");
+    _view->set_profiler(&_gpuProfiler);
+  }
 
   LAppUtil::update_time();
 }
@@ -6,6 +6,9 @@
 #ifndef DISPLAYER_HPP
 #define DISPLAYER_HPP
 
+#include <atomic>
+#include <string>
+#include <vector>
 #include <GL/glew.h>
 #include <SDL.h>
 #include <opencv2/core.hpp>
@@ -16,12 +19,75 @@ extern "C" {
 #include <acgl/threads.h>
 }
 #include "Allocator.hpp"
+#include "AllocTracker.hpp"
 #include "TextureManager.hpp"
 #include "ShaderManager.hpp"
 #include "View.hpp"
+#include "Clock.hpp"
+#include "FrameStats.hpp"
+#include "HeadlessContext.hpp"
+#include "FrameReadback.hpp"
+#include "Recorder.hpp"
+#include "GpuProfiler.hpp"
 
 class Displayer {
 public:
+  /**
+   * @brief How buffer swaps are synchronized with the display
+   */
+  enum SwapMode {
+    Vsync,         ///< Block on every vblank
+    AdaptiveVsync, ///< Vsync, but swap immediately instead of waiting a whole period when a frame runs late
+    LowLatency,    ///< Vsync, and wait for the swap to complete so no frames are queued ahead of the display
+    Immediate,     ///< No vsync, render as fast as possible
+  };
+
+  /**
+   * @brief Where frames are rendered to
+   */
+  enum Backend {
+    Window,   ///< An SDL window with its own GL context
+    Headless, ///< A windowless EGL/OSMesa context rendering into a framebuffer object
+  };
+
+  /**
+   * @brief Settings picked at startup
+   */
+  struct Options {
+    Backend backend = Window;
+    int width = 0;  ///< Initial drawable width, 0 for the default
+    int height = 0; ///< Initial drawable height, 0 for the default
+    unsigned long long max_frames = 0; ///< Stop after rendering this many frames, 0 runs until closed
+    std::string dump_dir; ///< If set, every frame is written as a PNG into this directory
+    SwapMode swap_mode = Vsync;
+    bool print_stats = false;
+    double stats_interval = 5.0; ///< Seconds between frame time reports
+    float model_fps = 0.0f; ///< Cap on model redraws per second through an offscreen cache, 0 redraws every frame
+    std::vector<std::string> models; ///< Models to show side by side, empty for the default one
+    bool threaded_simulation = false; ///< Simulate the models on a worker thread, drawing the previous step meanwhile
+    float sim_rate = 0.0f; ///< Fixed simulation steps per second with interpolated drawing, 0 steps once per frame
+    double virtual_fps = 0.0; ///< If set, every frame advances the models by exactly 1/virtual_fps seconds
+    bool deterministic = false; ///< Advance models in a fixed order so a seeded run can be reproduced
+    bool lod = true; ///< Simulate small models, and every model when frames run long, in less detail. Off for deterministic and virtual clock runs
+    double frame_budget_ms = 0.0; ///< CPU time per frame before models lose detail, 0 for the refresh period
+    double motion_cache_mb = 8.0; ///< Parsed motions each model keeps once they stop playing
+    LAppAllocator::Mode allocator = LAppAllocator::Malloc; ///< How the Cubism framework allocates memory
+    AllocTracker::GuardMode alloc_guard = AllocTracker::GuardOff; ///< What to do about allocations in the per-frame path
+    unsigned long long alloc_guard_warmup = 300; ///< Frames rendered before the allocation guard is armed
+    bool compress_textures = true; ///< Keep model textures compressed on the GPU, cached on disk after the first run
+    bool hot_reload = false; ///< Reload model assets as they're written
+    double texture_budget_mb = 0.0; ///< VRAM textures no model uses any more may keep, 0 frees them right away
+    std::string shm_name; ///< If set, every frame is published into a shared memory ring of this name
+    int shm_slots = 3;
+    int shm_max_width = 0;  ///< Largest frame the shared memory ring has room for, 0 for the drawable size at startup
+    int shm_max_height = 0;
+    std::string record_path; ///< If set, rendered frames are encoded into this file on a background thread
+    double record_fps = 60.0;
+    int record_queue = 8; ///< Frames that may wait for the encoder before new ones are dropped
+    std::string record_camera_path; ///< If set, the raw camera feed is recorded into this file too
+    double record_camera_fps = 4.0;
+  };
+
   /**
    * @brief Custom constructor/destructor pair
    */
@@ -31,9 +97,12 @@ public:
   /**
    * @brief Initializer the displayer
    * 
+   * @param[in] cv_width
+   * @param[in] cv_height
+   * @param[in] options
    * @return true iff initialization succeeded
    */
-  bool initialize(const int cv_width, const int cv_height);
+  bool initialize(const int cv_width, const int cv_height, const Options& options = Options());
 
   /**
    * @brief Release the current displayer instance
@@ -50,15 +119,59 @@ public:
 
   /**
    * @brief Render a frame to the screen
+   *
+   * Returns once the swap has been issued. With vsync enabled this blocks
+   * until the display is ready for the next frame, which is what paces the
+   * main loop.
    */
   void render();
 
+  /**
+   * @brief Check whether the window is currently minimized or hidden
+   */
+  bool is_hidden() const;
+
+  /**
+   * @brief Called instead of `render` while the window is hidden
+   *
+   * Pauses the models and keeps the frame clock current, so they pick up
+   * where they left off instead of jumping ahead once the window is shown.
+   */
+  void idle();
+
   void update_cv(cv::Mat& frame);
 
+  /**
+   * @brief Hand a raw camera frame to the recorder, if camera recording is enabled
+   *
+   * Safe to call from the capture thread. The frame is tagged with the
+   * current render frame ID so both recordings can be lined up afterwards.
+   *
+   * @param[in] frame
+   */
+  void record_camera(const cv::Mat& frame);
+
+  /**
+   * @brief Read back the frame currently being drawn and write it to an image file
+   *
+   * Stalls until rendering has finished, meant for debugging and CI, not streaming
+   *
+   * @param[in] path
+   * @return true iff the image was written
+   */
+  bool dump_frame(const std::string& path);
+
+  /**
+   * @brief Number of frames presented so far
+   */
+  unsigned long long get_frame_count() const { return _frameCount.load(); }
+
   SDL_Window* get_window() const { return _window; }
   TextureManager* get_texture_manager() const { return _textureManager; }
   ShaderManager* get_shader_manager() const { return _shaderManager; }
 
+  const FrameStats& get_frame_stats() const { return _frameStats; }
+
   bool get_is_end() { return _isEnd; }
   void app_end() { _isEnd = true; }
 
@@ -74,6 +187,41 @@ private:
    */
   void initialize_cubism(const int cv_width, const int cv_height);
 
+  /**
+   * @brief Open an SDL window with a desktop GL context
+   */
+  bool initialize_window();
+
+  /**
+   * @brief Set up a windowless GL context for the headless backend
+   */
+  bool initialize_headless();
+
+  /**
+   * @brief Apply the configured swap interval to the current context
+   */
+  void apply_swap_mode();
+
+  /**
+   * @brief Record timings of the frame that was just presented
+   */
+  void record_frame(double frame_start, double swap_start, double swap_end);
+
+  /**
+   * @brief Raise or lower the view's load pressure to keep CPU frame time within budget
+   */
+  void update_load_pressure(double cpu_ms, double now);
+
+  /**
+   * @brief Create the frame sinks requested in the options
+   */
+  void initialize_sinks();
+
+  /**
+   * @brief Queue a readback of the current frame and hand the previous one to the sinks
+   */
+  void publish_frame(double timestamp);
+
   LAppAllocator _cubismAllocator;
   TextureManager* _textureManager;
   ShaderManager* _shaderManager;
@@ -85,6 +233,24 @@ private:
 
   int _windowWidth;
   int _windowHeight;
+  HeadlessContext* _headless;
+  Clock* _clock; ///< Only set when it replaces the real clock
+  std::atomic<unsigned long long> _frameCount; ///< Also read by the capture thread
+
+  FrameReadback _readback;
+  Csm::csmVector<FrameSink*> _sinks;
+  Recorder* _recorder; ///< Also in _sinks, which owns it
+
+  Options _options;
+  FrameStats _frameStats;
+  GpuProfiler _gpuProfiler; ///< Only running with print_stats
+  int _gpuFrameSection;
+  int _gpuSwapSection;
+  double _lastSwapTime;
+  double _lastReportTime;
+  double _averageCpuMs; ///< Moving average the load pressure follows
+  int _loadPressure;
+  double _lastPressureChange;
 };
 
 #endif /* DISPLAYER_HPP */
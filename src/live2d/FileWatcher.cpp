@@ -0,0 +1,195 @@
+#include "FileWatcher.hpp"
+
+#include <chrono>
+#include <filesystem>
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#include "Util.hpp"
+
+// How long the watcher sleeps between checks for stop() and, without inotify, between polls
+static const int POLL_INTERVAL_MS = 500;
+
+FileWatcher::FileWatcher() :
+  _stop(false)
+#ifdef __linux__
+  , _fd(-1)
+#endif
+{
+  // Pass
+}
+
+FileWatcher::~FileWatcher() {
+  stop();
+}
+
+bool FileWatcher::start(const std::vector<std::string>& dirs) {
+  stop();
+  _dirs.clear();
+  for (size_t i = 0; i < dirs.size(); i++) {
+    std::string dir = dirs[i];
+    while (dir.size() > 1 && dir.back() == '/') {
+      dir.pop_back();
+    }
+    _dirs.push_back(dir);
+  }
+
+#ifdef __linux__
+  _fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (_fd < 0) {
+    LAppUtil::print_log("Error: could not start watching files");
+    return false;
+  }
+
+  for (size_t i = 0; i < _dirs.size(); i++) {
+    add_watches(_dirs[i], false);
+  }
+
+  if (_watches.empty()) {
+    LAppUtil::print_log("Error: none of the directories to watch could be watched");
+    close(_fd);
+    _fd = -1;
+    return false;
+  }
+#else
+  scan(false);
+#endif
+
+  _stop = false;
+  _thread = std::thread(&FileWatcher::run, this);
+  return true;
+}
+
+void FileWatcher::stop() {
+  _stop = true;
+  if (_thread.joinable()) {
+    _thread.join();
+  }
+
+#ifdef __linux__
+  if (_fd >= 0) {
+    close(_fd);
+    _fd = -1;
+  }
+  _watches.clear();
+#else
+  _modified.clear();
+#endif
+
+  std::lock_guard<std::mutex> lock(_mutex);
+  _changes.clear();
+}
+
+void FileWatcher::take_changes(std::vector<std::string>& paths) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  paths.insert(paths.end(), _changes.begin(), _changes.end());
+  _changes.clear();
+}
+
+void FileWatcher::add_change(const std::string& path) {
+  std::lock_guard<std::mutex> lock(_mutex);
+  // A save often comes as several writes, only a handful of files change at once
+  for (size_t i = 0; i < _changes.size(); i++) {
+    if (_changes[i] == path) {
+      return;
+    }
+  }
+  _changes.push_back(path);
+}
+
+#ifdef __linux__
+
+void FileWatcher::add_watches(const std::string& dir, bool report) {
+  // Editors tend to write a temporary file and rename it over the original
+  const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+  int watch = inotify_add_watch(_fd, dir.c_str(), mask);
+  if (watch >= 0) {
+    _watches[watch] = dir;
+  }
+
+  std::error_code error;
+  std::filesystem::recursive_directory_iterator iter(dir, error);
+  for (; !error && iter != std::filesystem::recursive_directory_iterator(); iter.increment(error)) {
+    const std::string path = iter->path().generic_string();
+    if (iter->is_directory(error)) {
+      watch = inotify_add_watch(_fd, path.c_str(), mask);
+      if (watch >= 0) {
+        _watches[watch] = path;
+      }
+    }
+    else if (report && iter->is_regular_file(error)) {
+      add_change(path);
+    }
+  }
+}
+
+void FileWatcher::run() {
+  alignas(inotify_event) char buffer[4096];
+  while (!_stop) {
+    pollfd poll_fd = { _fd, POLLIN, 0 };
+    if (poll(&poll_fd, 1, POLL_INTERVAL_MS) <= 0) {
+      continue;
+    }
+
+    const ssize_t length = read(_fd, buffer, sizeof(buffer));
+    for (ssize_t offset = 0; offset < length;) {
+      const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+      offset += sizeof(inotify_event) + event->len;
+      if ((event->mask & IN_IGNORED) != 0) {
+        // The directory is gone
+        _watches.erase(event->wd);
+        continue;
+      }
+      auto watch = _watches.find(event->wd);
+      if (event->len == 0 || watch == _watches.end()) {
+        continue;
+      }
+
+      const std::string path = watch->second + "/" + event->name;
+      if ((event->mask & IN_ISDIR) != 0) {
+        // Anything written into it before its watch was added would be missed otherwise
+        add_watches(path, true);
+      }
+      else if ((event->mask & IN_CREATE) == 0) {
+        // Created files are reported once they're written and closed
+        add_change(path);
+      }
+    }
+  }
+}
+
+#else
+
+void FileWatcher::run() {
+  while (!_stop) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(POLL_INTERVAL_MS));
+    scan(true);
+  }
+}
+
+void FileWatcher::scan(bool report) {
+  for (size_t i = 0; i < _dirs.size(); i++) {
+    std::error_code error;
+    std::filesystem::recursive_directory_iterator iter(_dirs[i], error);
+    for (; !error && iter != std::filesystem::recursive_directory_iterator(); iter.increment(error)) {
+      if (!iter->is_regular_file(error)) {
+        continue;
+      }
+
+      const std::string path = iter->path().generic_string();
+      const std::filesystem::file_time_type modified = iter->last_write_time(error);
+      auto known = _modified.find(path);
+      if (known == _modified.end() || known->second != modified) {
+        if (report) {
+          add_change(path);
+        }
+        _modified[path] = modified;
+      }
+    }
+  }
+}
+
+#endif /* __linux__ */
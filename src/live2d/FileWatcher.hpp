@@ -0,0 +1,84 @@
+#ifndef LIVE2D_FILE_WATCHER_HPP
+#define LIVE2D_FILE_WATCHER_HPP
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#ifndef __linux__
+#include <filesystem>
+#endif
+
+/**
+ * @brief Notices files being written under a set of directories, on a background thread
+ *
+ * Uses inotify on Linux, elsewhere the directories are polled for
+ * modification times twice a second.
+ */
+class FileWatcher {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  FileWatcher();
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  /**
+   * @brief Watch directories and every directory under them, stopping any watch already running
+   *
+   * @param[in] dirs Reported paths start with these, minus any trailing slash
+   * @return false if nothing could be watched
+   */
+  bool start(const std::vector<std::string>& dirs);
+  void stop();
+
+  /**
+   * @brief Take the files written since the last call, each once
+   *
+   * @param[out] paths Appended to
+   */
+  void take_changes(std::vector<std::string>& paths);
+
+  bool is_running() const { return _thread.joinable(); }
+
+private:
+  /**
+   * @brief Watcher loop
+   */
+  void run();
+  void add_change(const std::string& path);
+#ifdef __linux__
+  /**
+   * @brief Watch a directory and every directory under it
+   *
+   * @param[in] report Whether files already in them count as written, for directories that just appeared
+   */
+  void add_watches(const std::string& dir, bool report);
+#else
+  /**
+   * @brief Note every file's modification time
+   *
+   * @param[in] report Whether files that changed since the last scan count as written
+   */
+  void scan(bool report);
+#endif
+
+  std::thread _thread;
+  std::atomic<bool> _stop;
+  std::mutex _mutex;
+  std::vector<std::string> _changes; ///< Not taken yet, without duplicates
+  std::vector<std::string> _dirs;
+#ifdef __linux__
+  int _fd; ///< inotify instance
+  std::unordered_map<int, std::string> _watches; ///< Directory of each watch descriptor, only touched by the watcher once it runs
+#else
+  std::unordered_map<std::string, std::filesystem::file_time_type> _modified; ///< As of the last poll
+#endif
+};
+
+#endif /* LIVE2D_FILE_WATCHER_HPP */
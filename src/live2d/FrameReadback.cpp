@@ -0,0 +1,135 @@
+#include "FrameReadback.hpp"
+
+FrameReadback::FrameReadback() :
+  _next(0),
+  _mapped(-1),
+  _droppedFrames(0)
+{
+  // Pass
+}
+
+FrameReadback::~FrameReadback() {
+  release();
+}
+
+void FrameReadback::release() {
+  unmap();
+
+  for (int i = 0; i < NUM_BUFFERS; i++) {
+    Slot& slot = _slots[i];
+    if (slot.fence != NULL) {
+      glDeleteSync(slot.fence);
+      slot.fence = NULL;
+    }
+    if (slot.buffer != 0) {
+      glDeleteBuffers(1, &slot.buffer);
+      slot.buffer = 0;
+    }
+    slot.capacity = 0;
+    slot.pending = false;
+  }
+  _next = 0;
+}
+
+void FrameReadback::queue_read(unsigned long long frame_id, double timestamp, int width, int height) {
+  if (width <= 0 || height <= 0) {
+    return;
+  }
+
+  Slot& slot = _slots[_next];
+  if (slot.pending) {
+    // Nobody picked up the frame that was here, it's too old to be useful now
+    glDeleteSync(slot.fence);
+    slot.fence = NULL;
+    slot.pending = false;
+    _droppedFrames++;
+  }
+
+  const int stride = width * 4;
+  const size_t size = static_cast<size_t>(stride) * height;
+
+  if (slot.buffer == 0) {
+    glGenBuffers(1, &slot.buffer);
+  }
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  if (slot.capacity < size) {
+    glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+    slot.capacity = size;
+  }
+
+  // BGRA is what drivers store the framebuffer as, so this stays a straight DMA copy
+  glPixelStorei(GL_PACK_ALIGNMENT, 4);
+  glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_BYTE, NULL);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  slot.pending = true;
+  slot.frame.frame_id = frame_id;
+  slot.frame.timestamp = timestamp;
+  slot.frame.width = width;
+  slot.frame.height = height;
+  slot.frame.stride = stride;
+  slot.frame.data = NULL;
+  slot.frame.size = size;
+
+  _next = (_next + 1) % NUM_BUFFERS;
+}
+
+const ReadbackFrame* FrameReadback::map_ready() {
+  if (_mapped >= 0) {
+    return NULL;
+  }
+
+  // The slot after the one just written is the oldest one still queued
+  for (int i = 0; i < NUM_BUFFERS; i++) {
+    const int index = (_next + i) % NUM_BUFFERS;
+    Slot& slot = _slots[index];
+    if (!slot.pending) {
+      continue;
+    }
+
+    GLenum status = glClientWaitSync(slot.fence, 0, 0);
+    if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+      if (index == (_next + NUM_BUFFERS - 1) % NUM_BUFFERS) {
+        // Only just queued, give it until next frame
+        return NULL;
+      }
+      glDeleteSync(slot.fence);
+      slot.fence = NULL;
+      slot.pending = false;
+      _droppedFrames++;
+      continue;
+    }
+
+    glDeleteSync(slot.fence);
+    slot.fence = NULL;
+    slot.pending = false;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+    void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.frame.size, GL_MAP_READ_BIT);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    if (data == NULL) {
+      _droppedFrames++;
+      return NULL;
+    }
+
+    slot.frame.data = static_cast<const unsigned char*>(data);
+    _mapped = index;
+    return &slot.frame;
+  }
+
+  return NULL;
+}
+
+void FrameReadback::unmap() {
+  if (_mapped < 0) {
+    return;
+  }
+
+  Slot& slot = _slots[_mapped];
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+  glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+  glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+  slot.frame.data = NULL;
+  _mapped = -1;
+}
@@ -0,0 +1,101 @@
+#ifndef LIVE2D_FRAME_READBACK_HPP
+#define LIVE2D_FRAME_READBACK_HPP
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+/**
+ * @brief A composed frame read back from the GPU
+ *
+ * `data` points into mapped GPU memory and is only valid until the readback
+ * that produced it is unmapped. Rows are stored bottom row first, as GL
+ * hands them out.
+ */
+struct ReadbackFrame {
+  unsigned long long frame_id;
+  double timestamp; ///< Seconds on the LAppUtil::get_time_seconds clock, taken when the frame was queued
+  int width;
+  int height;
+  int stride; ///< Bytes per row
+  const unsigned char* data; ///< BGRA8 pixels
+  size_t size;
+};
+
+/**
+ * @brief Something that wants every rendered frame, e.g. a stream or a recorder
+ *
+ * Called on the render thread, so implementations must return quickly and may
+ * not hold on to `frame.data` after returning.
+ */
+class FrameSink {
+public:
+  virtual ~FrameSink() {}
+  virtual void consume(const ReadbackFrame& frame) = 0;
+};
+
+/**
+ * @brief Asynchronous readback of the default framebuffer through pixel buffer objects
+ *
+ * Each frame's pixels are copied into a PBO by the GPU and guarded with a
+ * fence. The frame is handed out one frame later, once the fence has
+ * signaled, so the CPU never waits for the GPU like a plain glReadPixels
+ * into client memory would.
+ */
+class FrameReadback {
+public:
+  static const int NUM_BUFFERS = 2;
+
+  /**
+   * @brief Custom constructor/destructor
+   */
+  FrameReadback();
+  ~FrameReadback();
+
+  /**
+   * @brief Delete all pixel buffers and pending fences
+   */
+  void release();
+
+  /**
+   * @brief Start reading the current framebuffer into the next pixel buffer
+   *
+   * @param[in] frame_id
+   * @param[in] timestamp
+   * @param[in] width
+   * @param[in] height
+   */
+  void queue_read(unsigned long long frame_id, double timestamp, int width, int height);
+
+  /**
+   * @brief Map the oldest queued frame if the GPU has finished writing it
+   *
+   * Never blocks. A frame that isn't ready when asked for is dropped rather
+   * than adding another frame of latency.
+   *
+   * @return The mapped frame, or NULL if none is ready. Must be followed by `unmap`.
+   */
+  const ReadbackFrame* map_ready();
+
+  /**
+   * @brief Unmap the frame returned by the last successful `map_ready`
+   */
+  void unmap();
+
+  unsigned long long get_dropped_frames() const { return _droppedFrames; }
+
+private:
+  struct Slot {
+    GLuint buffer = 0;
+    GLsync fence = NULL;
+    size_t capacity = 0;
+    bool pending = false;
+    ReadbackFrame frame;
+  };
+
+  Slot _slots[NUM_BUFFERS];
+  int _next;
+  int _mapped;
+  unsigned long long _droppedFrames;
+};
+
+#endif /* LIVE2D_FRAME_READBACK_HPP */
@@ -0,0 +1,104 @@
+#include "FrameStats.hpp"
+
+#include <algorithm>
+#include <math.h>
+
+#include "Util.hpp"
+
+FrameStats::FrameStats() :
+  _next(0),
+  _count(0),
+  _refreshPeriodMs(0.0),
+  _totalFrames(0),
+  _missedFrames(0)
+{
+  reset();
+}
+
+FrameStats::~FrameStats() {
+  // Pass
+}
+
+void FrameStats::reset() {
+  for (int i = 0; i < MAX_SAMPLES; i++) {
+    _intervals[i] = 0.0;
+    _cpuTimes[i] = 0.0;
+    _swapTimes[i] = 0.0;
+  }
+  _next = 0;
+  _count = 0;
+  _totalFrames = 0;
+  _missedFrames = 0;
+}
+
+void FrameStats::record(double interval_ms, double cpu_ms, double swap_ms) {
+  _intervals[_next] = interval_ms;
+  _cpuTimes[_next] = cpu_ms;
+  _swapTimes[_next] = swap_ms;
+  _next = (_next + 1) % MAX_SAMPLES;
+  if (_count < MAX_SAMPLES) {
+    _count++;
+  }
+
+  _totalFrames++;
+  // A frame that took more than one and a half refresh periods showed up at
+  // least one vblank late
+  if (_refreshPeriodMs > 0.0 && interval_ms > _refreshPeriodMs * 1.5) {
+    _missedFrames++;
+  }
+}
+
+double FrameStats::average_interval() const {
+  if (_count == 0) {
+    return 0.0;
+  }
+
+  double sum = 0.0;
+  for (int i = 0; i < _count; i++) {
+    sum += _intervals[i];
+  }
+  return sum / _count;
+}
+
+void FrameStats::report(const char* label) const {
+  if (_count == 0) {
+    LAppUtil::print_log("[%s] no frames recorded", label);
+    return;
+  }
+
+  double sorted[MAX_SAMPLES];
+  double mean = 0.0;
+  double cpu_mean = 0.0;
+  double swap_mean = 0.0;
+  for (int i = 0; i < _count; i++) {
+    sorted[i] = _intervals[i];
+    mean += _intervals[i];
+    cpu_mean += _cpuTimes[i];
+    swap_mean += _swapTimes[i];
+  }
+  mean /= _count;
+  cpu_mean /= _count;
+  swap_mean /= _count;
+
+  double variance = 0.0;
+  for (int i = 0; i < _count; i++) {
+    double d = _intervals[i] - mean;
+    variance += d * d;
+  }
+  double stddev = sqrt(variance / _count);
+
+  std::sort(sorted, sorted + _count);
+  double p50 = sorted[_count / 2];
+  double p95 = sorted[(_count * 95) / 100];
+  double p99 = sorted[(_count * 99) / 100];
+
+  LAppUtil::print_log(
+    "[%s] %d frames: interval avg %.3f ms (%.1f fps), stddev %.3f, min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f",
+    label, _count, mean, mean > 0.0 ? 1000.0 / mean : 0.0, stddev,
+    sorted[0], p50, p95, p99, sorted[_count - 1]
+  );
+  LAppUtil::print_log(
+    "[%s] cpu avg %.3f ms, swap avg %.3f ms, missed vsync %llu / %llu",
+    label, cpu_mean, swap_mean, _missedFrames, _totalFrames
+  );
+}
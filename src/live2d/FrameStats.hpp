@@ -0,0 +1,72 @@
+#ifndef LIVE2D_FRAME_STATS_HPP
+#define LIVE2D_FRAME_STATS_HPP
+
+/**
+ * @brief Collects per-frame timings so frame pacing can be verified
+ *
+ * Samples are kept in a fixed-size ring so recording a frame never allocates.
+ */
+class FrameStats {
+public:
+  static const int MAX_SAMPLES = 600;
+
+  /**
+   * @brief Custom constructor/destructor
+   */
+  FrameStats();
+  ~FrameStats();
+
+  /**
+   * @brief Clear all collected samples
+   */
+  void reset();
+
+  /**
+   * @brief Set the refresh period frames are expected to be paced at
+   *
+   * Used to count frames that missed their vsync deadline. A period of 0
+   * disables the check.
+   *
+   * @param[in] period_ms
+   */
+  void set_refresh_period(double period_ms) { _refreshPeriodMs = period_ms; }
+  double get_refresh_period() const { return _refreshPeriodMs; }
+
+  /**
+   * @brief Record a single presented frame
+   *
+   * @param[in] interval_ms Time between this swap completing and the previous one
+   * @param[in] cpu_ms Time spent building the frame before the swap was requested
+   * @param[in] swap_ms Time spent blocked inside the swap
+   */
+  void record(double interval_ms, double cpu_ms, double swap_ms);
+
+  /**
+   * @brief Print a summary of the currently collected samples
+   *
+   * @param[in] label Prefix identifying where the report came from
+   */
+  void report(const char* label) const;
+
+  /**
+   * @brief Average frame interval over the collected samples, in milliseconds
+   */
+  double average_interval() const;
+
+  int get_sample_count() const { return _count; }
+  unsigned long long get_total_frames() const { return _totalFrames; }
+  unsigned long long get_missed_frames() const { return _missedFrames; }
+
+private:
+  double _intervals[MAX_SAMPLES];
+  double _cpuTimes[MAX_SAMPLES];
+  double _swapTimes[MAX_SAMPLES];
+  int _next;
+  int _count;
+
+  double _refreshPeriodMs;
+  unsigned long long _totalFrames;
+  unsigned long long _missedFrames;
+};
+
+#endif /* LIVE2D_FRAME_STATS_HPP */
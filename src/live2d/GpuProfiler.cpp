@@ -0,0 +1,179 @@
+#include "GpuProfiler.hpp"
+
+#include "Util.hpp"
+
+GpuProfiler::GpuProfiler() :
+  _enabled(false),
+  _current(0),
+  _sectionCount(0),
+  _lateFrames(0)
+{
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    _frames[i].scope_count = 0;
+    for (int j = 0; j < MAX_SCOPES; j++) {
+      _frames[i].scopes[j].queries[0] = 0;
+      _frames[i].scopes[j].queries[1] = 0;
+    }
+  }
+}
+
+GpuProfiler::~GpuProfiler() {
+  release();
+}
+
+bool GpuProfiler::initialize() {
+  release();
+
+  // Core since GL 3.3
+  if (!GLEW_ARB_timer_query) {
+    LAppUtil::print_log("[APP] GL timer queries unsupported, GPU times won't be reported");
+    return false;
+  }
+
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    for (int j = 0; j < MAX_SCOPES; j++) {
+      glGenQueries(2, _frames[i].scopes[j].queries);
+    }
+    _frames[i].scope_count = 0;
+  }
+  _current = 0;
+  _lateFrames = 0;
+  _enabled = true;
+  return true;
+}
+
+void GpuProfiler::release() {
+  if (!_enabled) {
+    return;
+  }
+
+  for (int i = 0; i < NUM_FRAMES; i++) {
+    for (int j = 0; j < MAX_SCOPES; j++) {
+      glDeleteQueries(2, _frames[i].scopes[j].queries);
+      _frames[i].scopes[j].queries[0] = 0;
+      _frames[i].scopes[j].queries[1] = 0;
+    }
+    _frames[i].scope_count = 0;
+  }
+  _enabled = false;
+}
+
+int GpuProfiler::add_section(const char* name) {
+  if (_sectionCount >= MAX_SECTIONS) {
+    return -1;
+  }
+
+  Section& section = _sections[_sectionCount];
+  section.name = name;
+  section.total_ms = 0.0;
+  section.max_ms = 0.0;
+  section.frames = 0;
+  return _sectionCount++;
+}
+
+void GpuProfiler::begin_frame() {
+  if (!_enabled) {
+    return;
+  }
+
+  _current = (_current + 1) % NUM_FRAMES;
+  collect(_frames[_current]);
+  _frames[_current].scope_count = 0;
+}
+
+int GpuProfiler::begin(int section) {
+  Frame& frame = _frames[_current];
+  if (!_enabled || section < 0 || frame.scope_count >= MAX_SCOPES) {
+    return -1;
+  }
+
+  const int scope_index = frame.scope_count++;
+  Scope& scope = frame.scopes[scope_index];
+  scope.section = section;
+  scope.ended = false;
+  glQueryCounter(scope.queries[0], GL_TIMESTAMP);
+  return scope_index;
+}
+
+void GpuProfiler::end(int scope) {
+  if (!_enabled || scope < 0) {
+    return;
+  }
+
+  Scope& s = _frames[_current].scopes[scope];
+  glQueryCounter(s.queries[1], GL_TIMESTAMP);
+  s.ended = true;
+}
+
+void GpuProfiler::collect(Frame& frame) {
+  if (frame.scope_count == 0) {
+    return;
+  }
+
+  // Queries complete in order, so the last one being ready means they all are
+  GLuint last = 0;
+  for (int i = 0; i < frame.scope_count; i++) {
+    if (frame.scopes[i].ended) {
+      last = frame.scopes[i].queries[1];
+    }
+  }
+  if (last == 0) {
+    return;
+  }
+  GLint available = GL_FALSE;
+  glGetQueryObjectiv(last, GL_QUERY_RESULT_AVAILABLE, &available);
+  if (!available) {
+    _lateFrames++;
+    return;
+  }
+
+  double frame_ms[MAX_SECTIONS] = {};
+  bool seen[MAX_SECTIONS] = {};
+  for (int i = 0; i < frame.scope_count; i++) {
+    const Scope& scope = frame.scopes[i];
+    if (!scope.ended) {
+      continue;
+    }
+    GLuint64 start, stop;
+    glGetQueryObjectui64v(scope.queries[0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(scope.queries[1], GL_QUERY_RESULT, &stop);
+    if (stop > start) {
+      frame_ms[scope.section] += (stop - start) / 1e6;
+    }
+    seen[scope.section] = true;
+  }
+
+  for (int i = 0; i < _sectionCount; i++) {
+    if (!seen[i]) {
+      continue;
+    }
+    Section& section = _sections[i];
+    section.total_ms += frame_ms[i];
+    if (frame_ms[i] > section.max_ms) {
+      section.max_ms = frame_ms[i];
+    }
+    section.frames++;
+  }
+}
+
+void GpuProfiler::report(const char* label) {
+  if (!_enabled) {
+    return;
+  }
+
+  for (int i = 0; i < _sectionCount; i++) {
+    Section& section = _sections[i];
+    if (section.frames == 0) {
+      continue;
+    }
+    LAppUtil::print_log("[%s] gpu %-10s avg %6.3f ms  max %6.3f ms  (%llu frames)",
+      label, section.name, section.total_ms / section.frames, section.max_ms, section.frames);
+    section.total_ms = 0.0;
+    section.max_ms = 0.0;
+    section.frames = 0;
+  }
+  if (_lateFrames > 0) {
+    LAppUtil::print_log("[%s] gpu results not ready in time for %llu frames", label, _lateFrames);
+    _lateFrames = 0;
+  }
+}
@@ -0,0 +1,99 @@
+#ifndef LIVE2D_GPU_PROFILER_HPP
+#define LIVE2D_GPU_PROFILER_HPP
+
+#include <GL/glew.h>
+
+/**
+ * @brief Measures how long the GPU spends on named sections of a frame
+ *
+ * Sections are bracketed with GL_TIMESTAMP queries, so they may nest and may
+ * run more than once per frame (their times add up). Queries go into a ring
+ * of per-frame sets and are only read back once the ring comes around again,
+ * a few frames later, so reading results never waits for the GPU. A frame
+ * whose results still aren't available by then is discarded and counted.
+ */
+class GpuProfiler {
+public:
+  static const int MAX_SECTIONS = 8;
+  static const int MAX_SCOPES = 32;  ///< Section begin/end pairs recorded per frame
+  static const int NUM_FRAMES = 4;   ///< Frames in flight before results are read
+
+  /**
+   * @brief Custom constructor/destructor
+   */
+  GpuProfiler();
+  ~GpuProfiler();
+
+  /**
+   * @brief Create the queries, needs a current GL context
+   *
+   * @return true iff timer queries are supported, otherwise every call is a no-op
+   */
+  bool initialize();
+
+  /**
+   * @brief Delete all queries
+   */
+  void release();
+
+  /**
+   * @brief Register a section to be timed
+   *
+   * @param[in] name Must outlive the profiler
+   * @return The section's id, or -1 if there are already MAX_SECTIONS
+   */
+  int add_section(const char* name);
+
+  /**
+   * @brief Start a new frame, collecting the results of the one that last used its queries
+   */
+  void begin_frame();
+
+  /**
+   * @brief Mark the start of a section in the GL command stream
+   *
+   * @return A scope to pass to `end`, or -1 if nothing is being recorded
+   */
+  int begin(int section);
+  void end(int scope);
+
+  /**
+   * @brief Print the average and peak GPU time of every section since the last report, then reset
+   */
+  void report(const char* label);
+
+  bool is_enabled() const { return _enabled; }
+
+private:
+  struct Scope {
+    int section;
+    GLuint queries[2];
+    bool ended;
+  };
+
+  struct Frame {
+    Scope scopes[MAX_SCOPES];
+    int scope_count;
+  };
+
+  struct Section {
+    const char* name;
+    double total_ms;
+    double max_ms;
+    unsigned long long frames; ///< Frames the section showed up in
+  };
+
+  /**
+   * @brief Add a frame's results to the section totals, if they're ready
+   */
+  void collect(Frame& frame);
+
+  bool _enabled;
+  Frame _frames[NUM_FRAMES];
+  int _current;
+  Section _sections[MAX_SECTIONS];
+  int _sectionCount;
+  unsigned long long _lateFrames;
+};
+
+#endif /* LIVE2D_GPU_PROFILER_HPP */
@@ -0,0 +1,228 @@
+#include "HeadlessContext.hpp"
+
+#include <stdio.h>
+
+#if defined(FACESTUFF_HEADLESS_EGL)
+#define EGL_NO_X11
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#elif defined(FACESTUFF_HEADLESS_OSMESA)
+#include <GL/osmesa.h>
+#endif
+
+HeadlessContext::HeadlessContext() :
+  _display(NULL),
+  _context(NULL),
+  _framebuffer(0),
+  _colorBuffer(0),
+  _depthBuffer(0),
+  _width(0),
+  _height(0)
+{
+  // Pass
+}
+
+HeadlessContext::~HeadlessContext() {
+  release();
+}
+
+bool HeadlessContext::is_supported() {
+#if defined(FACESTUFF_HEADLESS_EGL) || defined(FACESTUFF_HEADLESS_OSMESA)
+  return true;
+#else
+  return false;
+#endif
+}
+
+#if defined(FACESTUFF_HEADLESS_EGL)
+
+bool HeadlessContext::initialize(int width, int height) {
+  release();
+  _width = width;
+  _height = height;
+
+  // Prefer Mesa's surfaceless platform, which doesn't need X, Wayland or a GPU
+  EGLDisplay display = EGL_NO_DISPLAY;
+  PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+    reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+  if (get_platform_display != NULL) {
+    display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  }
+  if (display == EGL_NO_DISPLAY) {
+    fprintf(stderr, "Error getting an EGL display\n");
+    return false;
+  }
+
+  EGLint major, minor;
+  if (!eglInitialize(display, &major, &minor)) {
+    fprintf(stderr, "Error initializing EGL: 0x%x\n", eglGetError());
+    return false;
+  }
+  _display = display;
+
+  if (!eglBindAPI(EGL_OPENGL_API)) {
+    fprintf(stderr, "Error binding the desktop OpenGL API: 0x%x\n", eglGetError());
+    release();
+    return false;
+  }
+
+  static const EGLint config_attribs[] = {
+    EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+    EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+    EGL_RED_SIZE, 8,
+    EGL_GREEN_SIZE, 8,
+    EGL_BLUE_SIZE, 8,
+    EGL_ALPHA_SIZE, 8,
+    EGL_NONE
+  };
+  EGLConfig config;
+  EGLint num_configs = 0;
+  if (!eglChooseConfig(display, config_attribs, &config, 1, &num_configs) || num_configs < 1) {
+    fprintf(stderr, "Error choosing an EGL config: 0x%x\n", eglGetError());
+    release();
+    return false;
+  }
+
+  // The sprite code relies on client-side vertex arrays, so ask for the same
+  // compatibility profile SDL gives us by default
+  static const EGLint context_attribs[] = {
+    EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_COMPATIBILITY_PROFILE_BIT,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, context_attribs);
+  if (context == EGL_NO_CONTEXT) {
+    fprintf(stderr, "Error creating EGL context: 0x%x\n", eglGetError());
+    release();
+    return false;
+  }
+  _context = context;
+
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+    fprintf(stderr, "Error making surfaceless EGL context current: 0x%x\n", eglGetError());
+    release();
+    return false;
+  }
+
+  return create_framebuffer();
+}
+
+#elif defined(FACESTUFF_HEADLESS_OSMESA)
+
+bool HeadlessContext::initialize(int width, int height) {
+  release();
+  _width = width;
+  _height = height;
+
+  static const int context_attribs[] = {
+    OSMESA_FORMAT, OSMESA_RGBA,
+    OSMESA_DEPTH_BITS, 24,
+    OSMESA_STENCIL_BITS, 8,
+    OSMESA_PROFILE, OSMESA_COMPAT_PROFILE,
+    0
+  };
+  OSMesaContext context = OSMesaCreateContextAttribs(context_attribs, NULL);
+  if (context == NULL) {
+    fprintf(stderr, "Error creating OSMesa context\n");
+    return false;
+  }
+  _context = context;
+
+  // Rendering goes to the framebuffer object, the OSMesa buffer is just there to make it current
+  if (!OSMesaMakeCurrent(context, _osmesaBuffer, GL_UNSIGNED_BYTE, 1, 1)) {
+    fprintf(stderr, "Error making OSMesa context current\n");
+    release();
+    return false;
+  }
+
+  return create_framebuffer();
+}
+
+#else
+
+bool HeadlessContext::initialize(int, int) {
+  fprintf(stderr, "Error: headless rendering was not compiled in, configure with FACESTUFF_HEADLESS_BACKEND=EGL or OSMESA\n");
+  return false;
+}
+
+#endif
+
+bool HeadlessContext::create_framebuffer() {
+  // GLEW looks for GLX as well, which isn't there without a display. The GL
+  // entry points themselves are loaded before that check fails.
+  glewExperimental = GL_FALSE;
+  GLenum glew_error = glewInit();
+  if (glew_error != GLEW_OK && glew_error != GLEW_ERROR_NO_GLX_DISPLAY) {
+    fprintf(stderr, "Error initializing GLEW: %s\n", glewGetErrorString(glew_error));
+    release();
+    return false;
+  }
+
+  fprintf(stderr, "Headless renderer: %s (%s)\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+
+  glGenRenderbuffers(1, &_colorBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, _colorBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, _width, _height);
+
+  glGenRenderbuffers(1, &_depthBuffer);
+  glBindRenderbuffer(GL_RENDERBUFFER, _depthBuffer);
+  glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, _width, _height);
+  glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+  glGenFramebuffers(1, &_framebuffer);
+  glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorBuffer);
+  glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, _depthBuffer);
+
+  GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+  if (status != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "Error: headless framebuffer incomplete: 0x%x\n", status);
+    release();
+    return false;
+  }
+
+  // Left bound for good: whoever saves and restores the framebuffer binding
+  // (the Cubism renderer, offscreen frames) comes back to this one
+  glViewport(0, 0, _width, _height);
+
+  return true;
+}
+
+void HeadlessContext::present() {
+  glFinish();
+}
+
+void HeadlessContext::release() {
+  if (_framebuffer != 0) {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteFramebuffers(1, &_framebuffer);
+    _framebuffer = 0;
+  }
+  if (_colorBuffer != 0) {
+    glDeleteRenderbuffers(1, &_colorBuffer);
+    _colorBuffer = 0;
+  }
+  if (_depthBuffer != 0) {
+    glDeleteRenderbuffers(1, &_depthBuffer);
+    _depthBuffer = 0;
+  }
+
+#if defined(FACESTUFF_HEADLESS_EGL)
+  if (_display != NULL) {
+    eglMakeCurrent(static_cast<EGLDisplay>(_display), EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (_context != NULL) {
+      eglDestroyContext(static_cast<EGLDisplay>(_display), static_cast<EGLContext>(_context));
+      _context = NULL;
+    }
+    eglTerminate(static_cast<EGLDisplay>(_display));
+    _display = NULL;
+  }
+#elif defined(FACESTUFF_HEADLESS_OSMESA)
+  if (_context != NULL) {
+    OSMesaDestroyContext(static_cast<OSMesaContext>(_context));
+    _context = NULL;
+  }
+#endif
+}
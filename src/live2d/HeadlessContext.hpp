@@ -0,0 +1,70 @@
+#ifndef LIVE2D_HEADLESS_CONTEXT_HPP
+#define LIVE2D_HEADLESS_CONTEXT_HPP
+
+#include <GL/glew.h>
+
+/**
+ * @brief An OpenGL context that doesn't need a display or a window
+ *
+ * Depending on the build, this is either a surfaceless EGL context (Mesa's
+ * llvmpipe works fine) or an OSMesa context. In both cases a framebuffer
+ * object is created and left bound, so everything rendering to "the default
+ * framebuffer" ends up in it without knowing the difference.
+ *
+ * Configure with `-DFACESTUFF_HEADLESS_BACKEND=EGL` or `=OSMESA` to enable.
+ */
+class HeadlessContext {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  HeadlessContext();
+  ~HeadlessContext();
+
+  /**
+   * @brief Check whether this build has any headless backend compiled in
+   */
+  static bool is_supported();
+
+  /**
+   * @brief Create the context, make it current, and bind a framebuffer of the given size
+   *
+   * @param[in] width
+   * @param[in] height
+   * @return true iff the context is current and ready to render
+   */
+  bool initialize(int width, int height);
+
+  /**
+   * @brief Destroy the framebuffer and the context
+   */
+  void release();
+
+  /**
+   * @brief Stand-in for a buffer swap: wait for all rendering to finish
+   */
+  void present();
+
+  GLuint get_framebuffer() const { return _framebuffer; }
+  int get_width() const { return _width; }
+  int get_height() const { return _height; }
+
+private:
+  /**
+   * @brief Create the framebuffer object everything renders into
+   */
+  bool create_framebuffer();
+
+  // Kept opaque so EGL/OSMesa (and the X11 headers they drag in) stay out of this header
+  void* _display; ///< EGLDisplay
+  void* _context; ///< EGLContext or OSMesaContext
+  GLubyte _osmesaBuffer[4]; ///< OSMesa insists on a buffer, nothing is drawn to it
+
+  GLuint _framebuffer;
+  GLuint _colorBuffer;
+  GLuint _depthBuffer;
+  int _width;
+  int _height;
+};
+
+#endif /* LIVE2D_HEADLESS_CONTEXT_HPP */
@@ -0,0 +1,191 @@
+#include "Logger.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Records each thread can have queued, a power of two
+static const size_t RING_SIZE = 512;
+static const size_t MESSAGE_SIZE = 512;
+// How long the background thread sleeps between drains
+static const int DRAIN_INTERVAL_MS = 5;
+
+struct Record {
+  unsigned long long sequence; ///< Order across threads
+  char message[MESSAGE_SIZE];
+};
+
+/**
+ * @brief Single producer, single consumer queue of one thread's records
+ */
+struct Ring {
+  Record records[RING_SIZE];
+  std::atomic<size_t> head{ 0 }; ///< Next to write, only moved by the logging thread
+  std::atomic<size_t> tail{ 0 }; ///< Next to read, only moved by the drain
+  std::atomic<bool> owned{ true }; ///< False once its thread exits, when another thread may take it over
+};
+
+/**
+ * @brief Hands a thread's ring back when the thread exits
+ */
+struct RingOwner {
+  Ring* ring = NULL;
+  ~RingOwner() {
+    if (ring != NULL) {
+      ring->owned.store(false, std::memory_order_release);
+    }
+  }
+};
+
+static std::mutex rings_mutex; ///< Also serializes drains
+static std::vector<std::unique_ptr<Ring>> rings;
+static thread_local RingOwner thread_ring;
+static std::atomic<unsigned long long> sequence{ 0 };
+static std::atomic<unsigned long long> dropped{ 0 };
+static std::atomic<bool> running{ false };
+static std::atomic<bool> stopping{ false };
+static std::thread drain_thread;
+// Kept between drains so a steady trickle of records doesn't allocate there either.
+// Namespace scope, so they outlive the stop at exit.
+static std::vector<const Record*> pending;
+static std::vector<size_t> heads;
+
+static Ring* get_ring() {
+  if (thread_ring.ring == NULL) {
+    std::lock_guard<std::mutex> lock(rings_mutex);
+    for (size_t i = 0; i < rings.size() && thread_ring.ring == NULL; i++) {
+      bool owned = false;
+      if (rings[i]->owned.compare_exchange_strong(owned, true, std::memory_order_acquire)) {
+        thread_ring.ring = rings[i].get();
+      }
+    }
+    if (thread_ring.ring == NULL) {
+      rings.push_back(std::unique_ptr<Ring>(new Ring()));
+      thread_ring.ring = rings.back().get();
+    }
+  }
+  return thread_ring.ring;
+}
+
+/**
+ * @brief Write out every queued record, oldest first
+ */
+static void drain() {
+  std::lock_guard<std::mutex> lock(rings_mutex);
+  pending.clear();
+  heads.resize(rings.size());
+  for (size_t i = 0; i < rings.size(); i++) {
+    Ring& ring = *rings[i];
+    heads[i] = ring.head.load(std::memory_order_acquire);
+    for (size_t j = ring.tail.load(std::memory_order_relaxed); j != heads[i]; j++) {
+      pending.push_back(&ring.records[j % RING_SIZE]);
+    }
+  }
+
+  std::sort(pending.begin(), pending.end(), [](const Record* a, const Record* b) {
+    return a->sequence < b->sequence;
+  });
+  for (size_t i = 0; i < pending.size(); i++) {
+    fputs(pending[i]->message, stderr);
+    fputc('\n', stderr);
+  }
+  if (!pending.empty()) {
+    fflush(stderr);
+  }
+
+  // Only now can the slots be written again
+  for (size_t i = 0; i < rings.size(); i++) {
+    rings[i]->tail.store(heads[i], std::memory_order_release);
+  }
+}
+
+static void run() {
+  while (!stopping.load()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(DRAIN_INTERVAL_MS));
+    drain();
+  }
+  drain();
+}
+
+void Logger::start() {
+  if (running.load()) {
+    return;
+  }
+
+  static bool registered = false;
+  if (!registered) {
+    registered = true;
+    atexit(stop);
+  }
+
+  register_thread();
+  stopping.store(false);
+  running.store(true);
+  drain_thread = std::thread(run);
+}
+
+void Logger::stop() {
+  if (!running.exchange(false)) {
+    return;
+  }
+  stopping.store(true);
+  drain_thread.join();
+
+  const unsigned long long count = dropped.exchange(0);
+  if (count > 0) {
+    fprintf(stderr, "[APP] %llu log records dropped, their thread logged too much at once\n", count);
+  }
+}
+
+void Logger::register_thread() {
+  get_ring();
+}
+
+void Logger::log(Level level, const char* format, ...) {
+  va_list args;
+  va_start(args, format);
+  vlog(level, format, args);
+  va_end(args);
+}
+
+void Logger::vlog(Level level, const char* format, va_list args) {
+  (void)level;
+  if (!running.load(std::memory_order_relaxed)) {
+    char message[MESSAGE_SIZE];
+    vsnprintf(message, sizeof(message), format, args);
+    fprintf(stderr, "%s\n", message);
+    return;
+  }
+
+  Ring* ring = get_ring();
+  const size_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) == RING_SIZE) {
+    dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  Record& record = ring->records[head % RING_SIZE];
+  record.sequence = sequence.fetch_add(1, std::memory_order_relaxed);
+  vsnprintf(record.message, sizeof(record.message), format, args);
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+void Logger::write(Level level, const char* message) {
+  // Cubism ends its messages with a newline, records get one when written out
+  size_t length = strlen(message);
+  if (length > 0 && message[length - 1] == '\n') {
+    length--;
+  }
+  log(level, "%.*s", static_cast<int>(length), message);
+}
+
+unsigned long long Logger::get_dropped() {
+  return dropped.load();
+}
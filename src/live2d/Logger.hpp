@@ -0,0 +1,97 @@
+#ifndef LIVE2D_LOGGER_HPP
+#define LIVE2D_LOGGER_HPP
+
+#include <stdarg.h>
+
+/**
+ * @brief Least severe level compiled in, a Logger::Level
+ *
+ * Release builds keep Info and up, others Debug and up. Records below the
+ * level cost nothing, the APP_LOG macros drop them at compile time.
+ */
+#ifndef FACESTUFF_LOG_LEVEL
+#ifdef NDEBUG
+#define FACESTUFF_LOG_LEVEL 2
+#else
+#define FACESTUFF_LOG_LEVEL 1
+#endif
+#endif
+
+#define APP_LOG(level, ...) \
+  do { \
+    if constexpr ((level) >= FACESTUFF_LOG_LEVEL) { \
+      Logger::log((level), __VA_ARGS__); \
+    } \
+  } while (0)
+
+#define APP_LOG_VERBOSE(...) APP_LOG(Logger::Verbose, __VA_ARGS__)
+#define APP_LOG_DEBUG(...) APP_LOG(Logger::Debug, __VA_ARGS__)
+#define APP_LOG_INFO(...) APP_LOG(Logger::Info, __VA_ARGS__)
+#define APP_LOG_WARNING(...) APP_LOG(Logger::Warning, __VA_ARGS__)
+#define APP_LOG_ERROR(...) APP_LOG(Logger::Error, __VA_ARGS__)
+
+/**
+ * @brief Writes log records to stderr from a background thread
+ *
+ * Each thread formats its records into a ring of its own, which the
+ * background thread drains in the order they were logged. Logging never
+ * blocks or allocates, past the ring a thread gets the first time it logs:
+ * if its ring is full, the record is dropped and counted instead. Until
+ * start and after stop, records are written to stderr right away.
+ */
+class Logger {
+public:
+  /**
+   * @brief How severe a record is, in the same order as Cubism's log levels
+   */
+  enum Level {
+    Verbose, ///< Per frame detail
+    Debug,
+    Info,
+    Warning,
+    Error,
+    Off,     ///< As FACESTUFF_LOG_LEVEL, compiles every record out
+    NUM_LEVELS
+  };
+
+  /**
+   * @brief Start the background thread, which is stopped at exit
+   */
+  static void start();
+
+  /**
+   * @brief Write out every record still queued, then stop the background thread
+   */
+  static void stop();
+
+  /**
+   * @brief Give the calling thread its ring now, rather than on its first record
+   *
+   * For threads that mustn't allocate once they're running.
+   */
+  static void register_thread();
+
+  /**
+   * @brief Log a record with printf formatting, truncated to 512 bytes
+   *
+   * Prefer the APP_LOG macros, which compile out records below FACESTUFF_LOG_LEVEL.
+   */
+  static void log(Level level, const char* format, ...)
+#ifdef __GNUC__
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+  static void vlog(Level level, const char* format, va_list args);
+
+  /**
+   * @brief Log a record as is, less any trailing newline
+   */
+  static void write(Level level, const char* message);
+
+  /**
+   * @return Records dropped because their thread's ring was full
+   */
+  static unsigned long long get_dropped();
+};
+
+#endif /* LIVE2D_LOGGER_HPP */
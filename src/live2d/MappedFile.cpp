@@ -0,0 +1,170 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Util.hpp"
+#include "Definitions.hpp"
+
+// Smallest page size in use, touching one byte this far apart faults in every page
+static const size_t PAGE_SIZE_BYTES = 4096;
+
+MappedFile::MappedFile() :
+  _data(NULL),
+  _size(0),
+  _mapped(false),
+  _borrowed(false)
+#ifdef _WIN32
+  , _mapping(NULL)
+#endif
+{
+  // Pass
+}
+
+MappedFile::~MappedFile() {
+  close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) :
+  MappedFile()
+{
+  move_from(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) {
+  if (this != &other) {
+    close();
+    move_from(other);
+  }
+  return *this;
+}
+
+void MappedFile::move_from(MappedFile& other) {
+  _data = other._data;
+  _size = other._size;
+  _mapped = other._mapped;
+  _borrowed = other._borrowed;
+  other._data = NULL;
+  other._size = 0;
+  other._mapped = false;
+  other._borrowed = false;
+#ifdef _WIN32
+  _mapping = other._mapping;
+  other._mapping = NULL;
+#endif
+}
+
+bool MappedFile::open(const std::string& path) {
+  close();
+
+#ifdef _WIN32
+  HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+  if (file != INVALID_HANDLE_VALUE) {
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+      // The mapping keeps the file open by itself
+      HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (mapping != NULL) {
+        void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (view != NULL) {
+          _data = static_cast<const Csm::csmByte*>(view);
+          _size = static_cast<size_t>(size.QuadPart);
+          _mapping = mapping;
+          _mapped = true;
+        }
+        else {
+          CloseHandle(mapping);
+        }
+      }
+    }
+    CloseHandle(file);
+  }
+#else
+  int fd = ::open(path.c_str(), O_RDONLY);
+  if (fd >= 0) {
+    struct stat stat_buf;
+    if (fstat(fd, &stat_buf) == 0 && S_ISREG(stat_buf.st_mode) && stat_buf.st_size > 0) {
+      // The mapping keeps the file open by itself
+      void* view = mmap(NULL, stat_buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (view != MAP_FAILED) {
+        _data = static_cast<const Csm::csmByte*>(view);
+        _size = static_cast<size_t>(stat_buf.st_size);
+        _mapped = true;
+      }
+    }
+    ::close(fd);
+  }
+#endif
+
+  if (_mapped) {
+    return true;
+  }
+
+  Csm::csmSizeInt size = 0;
+  _data = LAppUtil::load_file_as_bytes(path, &size);
+  _size = size;
+  if (_data == NULL) {
+    if (LAppDefinitions::DebugLogEnable) {
+      LAppUtil::print_log("Error: could not open %s", path.c_str());
+    }
+    return false;
+  }
+  return true;
+}
+
+void MappedFile::open_view(const Csm::csmByte* data, size_t size) {
+  close();
+  _data = data;
+  _size = size;
+  _borrowed = true;
+}
+
+void MappedFile::close() {
+  if (_data == NULL) {
+    return;
+  }
+
+  if (_borrowed) {
+    // Pass
+  }
+  else if (_mapped) {
+#ifdef _WIN32
+    UnmapViewOfFile(_data);
+    CloseHandle(_mapping);
+    _mapping = NULL;
+#else
+    munmap(const_cast<Csm::csmByte*>(_data), _size);
+#endif
+  }
+  else {
+    LAppUtil::release_bytes(const_cast<Csm::csmByte*>(_data));
+  }
+
+  _data = NULL;
+  _size = 0;
+  _mapped = false;
+  _borrowed = false;
+}
+
+void MappedFile::prefetch() const {
+  if (!_mapped && !_borrowed) {
+    return;
+  }
+
+#ifndef _WIN32
+  // Lets the kernel read ahead in large requests instead of one page per fault. Views
+  // don't start on a page boundary, which madvise insists on.
+  const uintptr_t start = reinterpret_cast<uintptr_t>(_data) & ~static_cast<uintptr_t>(PAGE_SIZE_BYTES - 1);
+  madvise(reinterpret_cast<void*>(start), reinterpret_cast<uintptr_t>(_data) + _size - start, MADV_WILLNEED);
+#endif
+  volatile Csm::csmByte sink = 0;
+  for (size_t offset = 0; offset < _size; offset += PAGE_SIZE_BYTES) {
+    sink = sink + _data[offset];
+  }
+}
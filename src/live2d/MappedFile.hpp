@@ -0,0 +1,72 @@
+#ifndef LIVE2D_MAPPED_FILE_HPP
+#define LIVE2D_MAPPED_FILE_HPP
+
+#include <string>
+#include <CubismFramework.hpp>
+
+/**
+ * @brief Read-only view of a whole file, mapped into memory where possible
+ *
+ * Mapping saves reading every asset into a heap buffer that's only copied
+ * from and freed again, the pages come straight from the page cache. Files
+ * that can't be mapped, like empty ones, fall back to a buffered read. The
+ * view lives as long as the object.
+ */
+class MappedFile {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  MappedFile();
+  ~MappedFile();
+
+  MappedFile(MappedFile&& other);
+  MappedFile& operator=(MappedFile&& other);
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * @brief Map a file, closing the one currently open
+   *
+   * @param[in] path
+   * @return true iff the file's contents are available
+   */
+  bool open(const std::string& path);
+
+  /**
+   * @brief View memory owned by something else, like a blob of a ModelBundle, closing the file currently open
+   *
+   * @param[in] data Has to outlive the view
+   * @param[in] size
+   */
+  void open_view(const Csm::csmByte* data, size_t size);
+
+  /**
+   * @brief Unmap or free the file's contents
+   */
+  void close();
+
+  /**
+   * @brief Fault in every page of a mapped file now, rather than while it's parsed
+   */
+  void prefetch() const;
+
+  const Csm::csmByte* get_data() const { return _data; }
+  Csm::csmSizeInt get_size() const { return static_cast<Csm::csmSizeInt>(_size); }
+  bool is_open() const { return _data != NULL; }
+  bool is_mapped() const { return _mapped; }
+
+private:
+  void move_from(MappedFile& other);
+
+  const Csm::csmByte* _data;
+  size_t _size;
+  bool _mapped; ///< Whether _data is a mapping, otherwise it's a buffer from LAppUtil::load_file_as_bytes
+  bool _borrowed; ///< _data belongs to someone else and is left alone on close
+
+#ifdef _WIN32
+  void* _mapping; ///< HANDLE
+#endif
+};
+
+#endif /* LIVE2D_MAPPED_FILE_HPP */
@@ -1,40 +1,57 @@
 #include "Model.hpp"
 
 #include <fstream>
+#include <filesystem>
+#include <string.h>
 #include <vector>
 #include <CubismModelSettingJson.hpp>
 #include <Motion/CubismMotion.hpp>
+#include <Motion/CubismExpressionMotion.hpp>
 #include <Physics/CubismPhysics.hpp>
 #include <CubismDefaultParameterId.hpp>
 #include <Rendering/OpenGL/CubismRenderer_OpenGLES2.hpp>
-#include <Utils/CubismString.hpp>
 #include <Id/CubismIdManager.hpp>
 #include <Motion/CubismMotionQueueEntry.hpp>
+#include <Live2DCubismCore.h>
 
 #include "Displayer.hpp"
 #include "TextureManager.hpp"
 #include "Definitions.hpp"
 #include "Util.hpp"
+#include "AllocTracker.hpp"
+#include "StartupProfiler.hpp"
 
-Csm::csmByte* create_buffer(const Csm::csmChar* path, Csm::csmSizeInt* size) {
+static bool open_asset(MappedFile& file, const Csm::csmChar* path) {
   if (LAppDefinitions::DebugLogEnable) {
-    LAppUtil::print_log("[APP] creating buffer %s ", path);
+    LAppUtil::print_log("[APP] opening %s ", path);
   }
-  return LAppUtil::load_file_as_bytes(path, size);
-}
-
-void delete_buffer(Csm::csmByte* buffer, const Csm::csmChar* path = "") {
-  if (LAppDefinitions::DebugLogEnable) {
-    LAppUtil::print_log("[APP] deleting buffer %s ", path);
-  }
-  LAppUtil::release_bytes(buffer);
+  return ModelBundle::open_asset(file, path);
 }
 
 Model::Model()
   : CubismUserModel(),
   _modelSetting(NULL),
-  _userTimeSeconds(0.0f)
+  _userTimeSeconds(0.0f),
+  _profiler(NULL),
+  _profilerSection(-1),
+  _frontSnapshot(0),
+  _snapshotPublished(false),
+  _arena(NULL),
+  _bundle(NULL),
+  _textureManager(NULL),
+  _lod(LodFull),
+  _lodSkippedSteps(0),
+  _lodSkippedTime(0.0f),
+  _motionBytes(0),
+  _motionBudget(LAppDefinitions::MotionCacheBudget),
+  _motionUses(0),
+  _idleGroup(InvalidHandle),
+  _interpolating(false),
+  _interpolated(false)
 {
+  _snapshots[0] = _snapshots[1] = NULL;
+  _snapshotRenderers[0] = _snapshotRenderers[1] = NULL;
+
   if (LAppDefinitions::DebugLogEnable) {
     _debugMode = true;
   }
@@ -48,18 +65,33 @@ Model::Model()
 }
 
 Model::~Model() {
+  release_snapshots();
   release_motions();
   release_expressions();
+  release_retired_motions(true);
 
   for (Csm::csmInt32 i = 0; i < _modelSetting->GetMotionGroupCount(); i++) {
     const Csm::csmChar* group = _modelSetting->GetMotionGroupName(i);
     release_motion_group(group);
   }
 
+  // Once no renderer, snapshots' included, can draw with them
+  release_textures(_textureIds);
+
   delete _modelSetting;
+  delete _bundle;
+}
+
+void Model::destroy(Model* model) {
+  LAppArena* arena = model->_arena;
+  delete model;
+  delete arena;
 }
 
 void Model::load_assets(TextureManager* texture_manager, const Csm::csmChar* dir, const Csm::csmChar* fileName) {
+  StartupProfiler::Scope scope("load model", dir != NULL ? dir : "");
+  const double start = LAppUtil::get_time_seconds();
+
   if (dir == NULL) {
     if (LAppDefinitions::DebugLogEnable) {
       LAppUtil::print_log("Error: NULL dir passed to Model::load_assets");
@@ -74,100 +106,161 @@ void Model::load_assets(TextureManager* texture_manager, const Csm::csmChar* dir
   }
 
   _modelHomeDir = dir;
+
+  // A model packed with --pack-bundle is read from one mapped file instead of its directory
+  std::string bundle_path = dir;
+  if (!bundle_path.empty() && bundle_path.back() == '/') {
+    bundle_path.pop_back();
+  }
+  bundle_path += LAppDefinitions::BundleExtension;
+  std::error_code error;
+  if (std::filesystem::exists(bundle_path, error)) {
+    _bundle = new ModelBundle();
+    if (_bundle->open(bundle_path)) {
+      ModelBundle::mount(dir, _bundle);
+      LAppUtil::print_log("[APP] reading model from %s, %zu files", bundle_path.c_str(), _bundle->get_file_count());
+    }
+    else {
+      delete _bundle;
+      _bundle = NULL;
+    }
+  }
   if (LAppDefinitions::DebugLogEnable) {
     LAppUtil::print_log("[APP] loading model settings: %s", fileName);
   }
 
-  Csm::csmSizeInt size;
   const Csm::csmString path = Csm::csmString(dir) + fileName;
 
-  Csm::csmByte* buffer = create_buffer(path.GetRawString(), &size);
-  if (buffer == NULL) {
+  MappedFile file;
+  if (!open_asset(file, path.GetRawString())) {
     if (LAppDefinitions::DebugLogEnable) {
       LAppUtil::print_log("Error reading model settings file %s", path.GetRawString());
     }
     return;
   }
 
-  Live2D::Cubism::Framework::ICubismModelSetting* settings = new Live2D::Cubism::Framework::CubismModelSettingJson(buffer, size);
-  delete_buffer(buffer, path.GetRawString());
+  Live2D::Cubism::Framework::ICubismModelSetting* settings = new Live2D::Cubism::Framework::CubismModelSettingJson(file.get_data(), file.get_size());
+  file.close();
 
-  setup_model(settings);
+  _arena = new LAppArena();
+  LAppArena::set_current(_arena);
+  const double read_ms = setup_model(settings);
+  LAppArena::set_current(NULL);
   CreateRenderer();
   setup_textures(texture_manager);
+
+  LAppUtil::print_log("[APP] loaded model %s in %.1f ms (%.1f ms reading files)",
+    fileName, (LAppUtil::get_time_seconds() - start) * 1000.0, read_ms);
 }
 
-void Model::setup_model(Live2D::Cubism::Framework::ICubismModelSetting* settings) {
+double Model::read_asset_files(std::vector<AssetFile>& files) {
+  StartupProfiler::Scope scope("read files");
+  const double start = LAppUtil::get_time_seconds();
+  const int count = static_cast<int>(files.size());
+
+  // Sizes vary a lot between the moc and the motions, so files are handed out one at a time
+  #pragma omp parallel for schedule(dynamic)
+  for (int i = 0; i < count; i++) {
+    if (open_asset(files[i].file, files[i].path.c_str())) {
+      files[i].file.prefetch();
+    }
+  }
+
+  return (LAppUtil::get_time_seconds() - start) * 1000.0;
+}
+
+double Model::setup_model(Live2D::Cubism::Framework::ICubismModelSetting* settings) {
   _updating = true;
   _initialized = false;
 
   _modelSetting = settings;
+  index_motions();
+
+  // Every file is read up front, concurrently. Parsing stays on this thread
+  // and in this order: the framework's id manager isn't thread safe, and
+  // motions need the eye blink and lip sync ids.
+  std::vector<AssetFile> files;
+  auto add_file = [&](const Csm::csmChar* name) {
+    if (strcmp(name, "") == 0) {
+      return -1;
+    }
+    files.emplace_back();
+    files.back().path = std::string(_modelHomeDir.GetRawString()) + name;
+    return static_cast<int>(files.size()) - 1;
+  };
+
+  const int model_file = add_file(_modelSetting->GetModelFileName());
+  const int first_expression_file = static_cast<int>(files.size());
+  for (Csm::csmInt32 i = 0; i < _modelSetting->GetExpressionCount(); i++) {
+    files.emplace_back();
+    files.back().path = std::string(_modelHomeDir.GetRawString()) + _modelSetting->GetExpressionFileName(i);
+  }
+  const int physics_file = add_file(_modelSetting->GetPhysicsFileName());
+  const int pose_file = add_file(_modelSetting->GetPoseFileName());
+  const int user_data_file = add_file(_modelSetting->GetUserDataFile());
+  // Idle motions start playing right away, every other motion is loaded when first started
+  const Csm::csmChar* idle_group = LAppDefinitions::MotionGroupIdle;
+  const int first_idle_file = static_cast<int>(files.size());
+  for (Csm::csmInt32 i = 0; i < _modelSetting->GetMotionCount(idle_group); i++) {
+    files.emplace_back();
+    files.back().path = std::string(_modelHomeDir.GetRawString()) + _modelSetting->GetMotionFileName(idle_group, i);
+  }
 
-  Csm::csmByte* buffer;
-  Csm::csmSizeInt size;
+  const double read_ms = read_asset_files(files);
 
   //Cubism Model
-  if (strcmp(_modelSetting->GetModelFileName(), "") != 0)
+  if (model_file >= 0)
   {
-    const Csm::csmString path = _modelHomeDir + _modelSetting->GetModelFileName();
-
+    StartupProfiler::Scope scope("parse moc");
     if (_debugMode)
     {
       LAppUtil::print_log("[APP]create model: %s", settings->GetModelFileName());
     }
 
-    buffer = create_buffer(path.GetRawString(), &size);
-    LoadModel(buffer, size);
-    delete_buffer(buffer, path.GetRawString());
+    LoadModel(files[model_file].file.get_data(), files[model_file].file.get_size());
   }
 
   //Expression
   if (_modelSetting->GetExpressionCount() > 0)
   {
+    StartupProfiler::Scope scope("parse expressions");
     const Csm::csmInt32 count = _modelSetting->GetExpressionCount();
     for (Csm::csmInt32 i = 0; i < count; i++)
     {
       const Csm::csmString name = _modelSetting->GetExpressionName(i);
-      const Csm::csmString path = _modelHomeDir + _modelSetting->GetExpressionFileName(i);
+      const MappedFile& file = files[first_expression_file + i].file;
 
-      buffer = create_buffer(path.GetRawString(), &size);
-      if (buffer != NULL) {
-        Live2D::Cubism::Framework::ACubismMotion* motion = LoadExpression(buffer, size, name.GetRawString());
+      if (file.is_open()) {
+        Live2D::Cubism::Framework::ACubismMotion* motion = LoadExpression(file.get_data(), file.get_size(), name.GetRawString());
 
-        if (_expressions[name] != NULL)
+        const std::string& path = files[first_expression_file + i].path;
+        const ExpressionHandle existing = find_expression(name.GetRawString());
+        if (existing != InvalidHandle)
+        {
+          Live2D::Cubism::Framework::ACubismMotion::Delete(_expressions[existing].motion);
+          _expressions[existing].path = path;
+          _expressions[existing].motion = motion;
+        }
+        else
         {
-          Live2D::Cubism::Framework::ACubismMotion::Delete(_expressions[name]);
-          _expressions[name] = NULL;
+          _expressions.push_back(Expression{ name.GetRawString(), path, motion, Csm::InvalidMotionQueueEntryHandleValue });
         }
-        _expressions[name] = motion;
       }
-
-      delete_buffer(buffer, path.GetRawString());
     }
   }
 
   //Physics
-  if (strcmp(_modelSetting->GetPhysicsFileName(), "") != 0)
+  if (physics_file >= 0 && files[physics_file].file.is_open())
   {
-    const Csm::csmString path = _modelHomeDir + _modelSetting->GetPhysicsFileName();
-
-    buffer = create_buffer(path.GetRawString(), &size);
-    if (buffer != NULL) {
-      LoadPhysics(buffer, size);
-    }
-    delete_buffer(buffer, path.GetRawString());
+    StartupProfiler::Scope scope("parse physics");
+    LoadPhysics(files[physics_file].file.get_data(), files[physics_file].file.get_size());
   }
 
   //Pose
-  if (strcmp(_modelSetting->GetPoseFileName(), "") != 0)
+  if (pose_file >= 0 && files[pose_file].file.is_open())
   {
-    const Csm::csmString path = _modelHomeDir + _modelSetting->GetPoseFileName();
-
-    buffer = create_buffer(path.GetRawString(), &size);
-    if (buffer != NULL) {
-      LoadPose(buffer, size);
-    }
-    delete_buffer(buffer, path.GetRawString());
+    StartupProfiler::Scope scope("parse pose");
+    LoadPose(files[pose_file].file.get_data(), files[pose_file].file.get_size());
   }
 
   //EyeBlink
@@ -192,14 +285,10 @@ void Model::setup_model(Live2D::Cubism::Framework::ICubismModelSetting* settings
   }
 
   //UserData
-  if (strcmp(_modelSetting->GetUserDataFile(), "") != 0)
+  if (user_data_file >= 0 && files[user_data_file].file.is_open())
   {
-    Csm::csmString path = _modelHomeDir + _modelSetting->GetUserDataFile();
-    buffer = create_buffer(path.GetRawString(), &size);
-    if (buffer != NULL) {
-      LoadUserData(buffer, size);
-    }
-    delete_buffer(buffer, path.GetRawString());
+    StartupProfiler::Scope scope("parse user data");
+    LoadUserData(files[user_data_file].file.get_data(), files[user_data_file].file.get_size());
   }
 
   // EyeBlinkIds
@@ -227,54 +316,254 @@ void Model::setup_model(Live2D::Cubism::Framework::ICubismModelSetting* settings
 
   _model->SaveParameters();
 
-  for (Csm::csmInt32 i = 0; i < _modelSetting->GetMotionGroupCount(); i++)
-  {
-    const Csm::csmChar* group = _modelSetting->GetMotionGroupName(i);
-    preload_motion_group(group);
+  if (_idleGroup != InvalidHandle) {
+    StartupProfiler::Scope scope("parse idle motions");
+    preload_motion_group(_idleGroup, files.data() + first_idle_file);
   }
 
+  files.clear();
   _motionManager->StopAllMotions();
 
   _updating = false;
   _initialized = true;
+  return read_ms;
 }
 
-void Model::preload_motion_group(const Csm::csmChar* group) {
-  const Csm::csmInt32 count = _modelSetting->GetMotionCount(group);
+void Model::index_motions() {
+  _motionGroups.clear();
+  _motions.clear();
+  _motionBytes = 0;
+  _idleGroup = InvalidHandle;
+
+  const Csm::csmInt32 group_count = _modelSetting->GetMotionGroupCount();
+  for (Csm::csmInt32 i = 0; i < group_count; i++) {
+    MotionGroup group;
+    group.name = _modelSetting->GetMotionGroupName(i);
+    group.first = static_cast<MotionHandle>(_motions.size());
+    group.count = _modelSetting->GetMotionCount(group.name.c_str());
+
+    for (Csm::csmInt32 j = 0; j < group.count; j++) {
+      CachedMotion motion;
+      motion.group = i;
+      motion.index = j;
+      motion.path = std::string(_modelHomeDir.GetRawString()) + _modelSetting->GetMotionFileName(group.name.c_str(), j);
+      _motions.push_back(motion);
+    }
 
-  for (Csm::csmInt32 i = 0; i < count; i++) {
-    Csm::csmString name = Live2D::Cubism::Framework::Utils::CubismString::GetFormatedString("%s_%d", group, i);
-    Csm::csmString path = _modelHomeDir + _modelSetting->GetMotionFileName(group, i);
+    if (group.name == LAppDefinitions::MotionGroupIdle) {
+      _idleGroup = i;
+    }
+    _motionGroups.push_back(group);
+  }
+}
 
+void Model::preload_motion_group(int group, const AssetFile* files) {
+  const MotionGroup& motion_group = _motionGroups[group];
+
+  for (Csm::csmInt32 i = 0; i < motion_group.count; i++) {
     if (_debugMode) {
-      LAppUtil::print_log("[APP] loading motion %s => [%s_%d]", path.GetRawString(), group, i);
-    }
-
-    Csm::csmByte* buffer;
-    Csm::csmSizeInt size;
-    buffer = create_buffer(path.GetRawString(), &size);
-    if (buffer != NULL) {
-      Live2D::Cubism::Framework::CubismMotion* tmpMotion = static_cast<Live2D::Cubism::Framework::CubismMotion*>(LoadMotion(buffer, size, name.GetRawString()));
-      
-      Csm::csmFloat32 fadeTime = _modelSetting->GetMotionFadeInTimeValue(group, i);
-      if (fadeTime >= 0.0f) {
-        tmpMotion->SetFadeInTime(fadeTime);
+      LAppUtil::print_log("[APP] loading motion %s => [%s_%d]", files[i].path.c_str(), motion_group.name.c_str(), i);
+    }
+
+    if (files[i].file.is_open() && files[i].file.get_size() <= _motionBudget) {
+      CachedMotion& cached = _motions[motion_group.first + i];
+      if (cached.motion != NULL) {
+        Live2D::Cubism::Framework::ACubismMotion::Delete(cached.motion);
+        _motionBytes -= cached.bytes;
       }
+      cached.motion = load_motion(motion_group.first + i, files[i].file);
+      cached.bytes = files[i].file.get_size();
+      cached.last_used = 0;
+      cached.handle = Csm::InvalidMotionQueueEntryHandleValue;
+      _motionBytes += cached.bytes;
+    }
+  }
+  evict_motions();
+}
 
-      fadeTime = _modelSetting->GetMotionFadeOutTimeValue(group, i);
-      if (fadeTime >= 0.0f) {
-        tmpMotion->SetFadeOutTime(fadeTime);
+Csm::CubismMotion* Model::load_motion(MotionHandle handle, const MappedFile& file) {
+  Live2D::Cubism::Framework::CubismMotion* motion = static_cast<Live2D::Cubism::Framework::CubismMotion*>(LoadMotion(file.get_data(), file.get_size(), NULL));
+  configure_motion(handle, motion);
+  return motion;
+}
+
+void Model::configure_motion(MotionHandle handle, Csm::CubismMotion* motion) {
+  const Csm::csmChar* group = _motionGroups[_motions[handle].group].name.c_str();
+  const Csm::csmInt32 num = _motions[handle].index;
+  Csm::csmFloat32 fadeTime = _modelSetting->GetMotionFadeInTimeValue(group, num);
+  if (fadeTime >= 0.0f) {
+    motion->SetFadeInTime(fadeTime);
+  }
+
+  fadeTime = _modelSetting->GetMotionFadeOutTimeValue(group, num);
+  if (fadeTime >= 0.0f) {
+    motion->SetFadeOutTime(fadeTime);
+  }
+
+  motion->SetEffectIds(_eyeBlinkIds, _lipSyncIds);
+}
+
+void Model::set_motion_budget(size_t bytes) {
+  _motionBudget = bytes;
+  evict_motions();
+}
+
+void Model::evict_motions() {
+  while (_motionBytes > _motionBudget) {
+    // Motions number in the dozens, a linear scan beats keeping a list in order
+    CachedMotion* oldest = NULL;
+    for (size_t i = 0; i < _motions.size(); i++) {
+      CachedMotion& cached = _motions[i];
+      if (cached.motion == NULL || !_motionManager->IsFinished(cached.handle)) {
+        continue;
       }
+      if (oldest == NULL || cached.last_used < oldest->last_used) {
+        oldest = &cached;
+      }
+    }
+    if (oldest == NULL) {
+      // Everything left is playing
+      return;
+    }
 
-      tmpMotion->SetEffectIds(_eyeBlinkIds, _lipSyncIds);
+    if (_debugMode) {
+      LAppUtil::print_log("[APP] dropping motion [%s_%d]", _motionGroups[oldest->group].name.c_str(), oldest->index);
+    }
+    Live2D::Cubism::Framework::ACubismMotion::Delete(oldest->motion);
+    _motionBytes -= oldest->bytes;
+    oldest->motion = NULL;
+    oldest->bytes = 0;
+    oldest->handle = Csm::InvalidMotionQueueEntryHandleValue;
+  }
+}
+
+Model::AssetKind Model::find_asset(const std::string& path) const {
+  for (size_t i = 0; i < _motions.size(); i++) {
+    if (_motions[i].path == path) {
+      return MotionAsset;
+    }
+  }
+  for (size_t i = 0; i < _expressions.size(); i++) {
+    if (_expressions[i].path == path) {
+      return ExpressionAsset;
+    }
+  }
+  const Csm::csmChar* physics_file = _modelSetting->GetPhysicsFileName();
+  if (strcmp(physics_file, "") != 0 && path == std::string(_modelHomeDir.GetRawString()) + physics_file) {
+    return PhysicsAsset;
+  }
+  return NoAsset;
+}
+
+void Model::parse_asset(AssetKind kind, const MappedFile& file, ParsedAsset& asset) {
+  asset.kind = kind;
+  asset.bytes = file.get_size();
+  switch (kind) {
+  case MotionAsset:
+    asset.motion = Live2D::Cubism::Framework::CubismMotion::Create(file.get_data(), static_cast<Csm::csmSizeInt>(file.get_size()));
+    break;
+  case ExpressionAsset:
+    asset.motion = Live2D::Cubism::Framework::CubismExpressionMotion::Create(file.get_data(), static_cast<Csm::csmSizeInt>(file.get_size()));
+    break;
+  case PhysicsAsset:
+    asset.physics = Live2D::Cubism::Framework::CubismPhysics::Create(file.get_data(), static_cast<Csm::csmSizeInt>(file.get_size()));
+    break;
+  default:
+    break;
+  }
+}
+
+void Model::delete_asset(ParsedAsset& asset) {
+  if (asset.motion != NULL) {
+    Live2D::Cubism::Framework::ACubismMotion::Delete(asset.motion);
+    asset.motion = NULL;
+  }
+  if (asset.physics != NULL) {
+    Live2D::Cubism::Framework::CubismPhysics::Delete(asset.physics);
+    asset.physics = NULL;
+  }
+}
 
-      if (_motions[name] != NULL) {
-        Live2D::Cubism::Framework::ACubismMotion::Delete(_motions[name]);
+bool Model::reload_asset(const std::string& path, ParsedAsset& asset) {
+  release_retired_motions(false);
+  if (asset.kind == NoAsset || find_asset(path) != asset.kind) {
+    delete_asset(asset);
+    return false;
+  }
+  if (asset.motion == NULL && asset.physics == NULL) {
+    LAppUtil::print_log("Error: could not parse %s, keeping the old version", path.c_str());
+    return true;
+  }
+
+  if (asset.kind == MotionAsset) {
+    for (size_t i = 0; i < _motions.size(); i++) {
+      CachedMotion& cached = _motions[i];
+      if (cached.path != path) {
+        continue;
+      }
+
+      // One that isn't cached is read from the new file when it's next started
+      if (cached.motion != NULL) {
+        Live2D::Cubism::Framework::CubismMotion* parsed = static_cast<Live2D::Cubism::Framework::CubismMotion*>(asset.motion);
+        configure_motion(static_cast<MotionHandle>(i), parsed);
+        asset.motion = NULL;
+        _retiredMotions.push_back(RetiredMotion{ cached.motion, _motionManager, cached.handle });
+        _motionBytes -= cached.bytes;
+        cached.motion = parsed;
+        cached.bytes = asset.bytes;
+        cached.handle = Csm::InvalidMotionQueueEntryHandleValue;
+        _motionBytes += cached.bytes;
+        evict_motions();
+      }
+      break;
+    }
+    delete_asset(asset);
+    LAppUtil::print_log("[APP] reloaded motion %s", path.c_str());
+    return true;
+  }
+
+  if (asset.kind == ExpressionAsset) {
+    for (size_t i = 0; i < _expressions.size(); i++) {
+      Expression& expression = _expressions[i];
+      if (expression.path != path) {
+        continue;
+      }
+
+      const bool playing = expression.motion != NULL && !_expressionManager->IsFinished(expression.handle);
+      if (expression.motion != NULL) {
+        _retiredMotions.push_back(RetiredMotion{ expression.motion, _expressionManager, expression.handle });
       }
-      _motions[name] = tmpMotion;
+      expression.motion = asset.motion;
+      asset.motion = NULL;
+      expression.handle = Csm::InvalidMotionQueueEntryHandleValue;
+      if (playing) {
+        set_expression(static_cast<ExpressionHandle>(i));
+      }
+      break;
     }
+    LAppUtil::print_log("[APP] reloaded expression %s", path.c_str());
+    return true;
+  }
 
-    delete_buffer(buffer, path.GetRawString());
+  if (_physics != NULL) {
+    Live2D::Cubism::Framework::CubismPhysics::Delete(_physics);
+  }
+  _physics = asset.physics;
+  asset.physics = NULL;
+  LAppUtil::print_log("[APP] reloaded physics %s", path.c_str());
+  return true;
+}
+
+void Model::release_retired_motions(bool all) {
+  for (size_t i = 0; i < _retiredMotions.size();) {
+    const RetiredMotion& retired = _retiredMotions[i];
+    if (all || retired.manager->IsFinished(retired.handle)) {
+      Live2D::Cubism::Framework::ACubismMotion::Delete(retired.motion);
+      _retiredMotions.erase(_retiredMotions.begin() + i);
+    }
+    else {
+      i++;
+    }
   }
 }
 
@@ -287,23 +576,64 @@ void Model::release_motion_group(const Csm::csmChar* group) {
 }
 
 void Model::release_motions() {
-  for (auto iter = _motions.Begin(); iter != _motions.End(); ++iter) {
-    Live2D::Cubism::Framework::ACubismMotion::Delete(iter->Second);
+  for (size_t i = 0; i < _motions.size(); i++) {
+    if (_motions[i].motion != NULL) {
+      Live2D::Cubism::Framework::ACubismMotion::Delete(_motions[i].motion);
+    }
   }
 
-  _motions.Clear();
+  _motions.clear();
+  _motionGroups.clear();
+  _idleGroup = InvalidHandle;
+  _motionBytes = 0;
 }
 
 void Model::release_expressions() {
-  for (auto iter = _expressions.Begin(); iter != _expressions.End(); ++iter) {
-    Live2D::Cubism::Framework::ACubismMotion::Delete(iter->Second);
+  for (size_t i = 0; i < _expressions.size(); i++) {
+    if (_expressions[i].motion != NULL) {
+      Live2D::Cubism::Framework::ACubismMotion::Delete(_expressions[i].motion);
+    }
   }
 
-  _expressions.Clear();
+  _expressions.clear();
 }
 
 void Model::update() {
-  const Csm::csmFloat32 delta_time_seconds = LAppUtil::get_delta_time();
+  update(LAppUtil::get_delta_time());
+}
+
+void Model::update(Csm::csmFloat32 delta_time_seconds) {
+  AllocTracker::FrameScope frame_scope("Model::update");
+  schedule_motions();
+  update_parameters(delta_time_seconds);
+  finish_update(1.0f);
+}
+
+void Model::schedule_motions() {
+  AllocTracker::FrameScope frame_scope("Model::schedule_motions");
+  if (_motionManager->IsFinished()) {
+    start_random_motion(_idleGroup, LAppDefinitions::PriorityIdle);
+  }
+}
+
+// Steps out of which one is simulated, per LOD level
+static const int LOD_STRIDES[Model::NUM_LOD_LEVELS] = { 1, 2, 4, 0 };
+
+void Model::update_parameters(Csm::csmFloat32 delta_time_seconds) {
+  AllocTracker::FrameScope frame_scope("Model::update_parameters");
+  restore_simulated_state();
+
+  if (_lod == LodPaused) {
+    return;
+  }
+  _lodSkippedTime += delta_time_seconds;
+  if (++_lodSkippedSteps < LOD_STRIDES[_lod]) {
+    return;
+  }
+  delta_time_seconds = _lodSkippedTime;
+  _lodSkippedTime = 0.0f;
+  _lodSkippedSteps = 0;
+
   _userTimeSeconds += delta_time_seconds;
 
   _dragManager->Update(delta_time_seconds);
@@ -313,17 +643,14 @@ void Model::update() {
   Csm::csmBool motion_updated = false;
 
   _model->LoadParameters();
-  if (_motionManager->IsFinished()) {
-    start_random_motion(LAppDefinitions::MotionGroupIdle, LAppDefinitions::PriorityIdle);
-  }
-  else {
+  if (!_motionManager->IsFinished()) {
     motion_updated = _motionManager->UpdateMotion(_model, delta_time_seconds);
   }
   _model->SaveParameters();
 
   if (!motion_updated) {
     // When idling, update the eye blink interval if it exists
-    if (_eyeBlink != NULL) {
+    if (_eyeBlink != NULL && _lod < LodMinimal) {
       _eyeBlink->UpdateParameters(_model, delta_time_seconds);
     }
   }
@@ -343,11 +670,11 @@ void Model::update() {
   _model->AddParameterValue(_idParamEyeBallX, _dragX);
   _model->AddParameterValue(_idParamEyeBallY, _dragY);
 
-  if (_breath != NULL) {
+  if (_breath != NULL && _lod < LodReduced) {
     _breath->UpdateParameters(_model, delta_time_seconds);
   }
 
-  if (_physics != NULL) {
+  if (_physics != NULL && _lod < LodMinimal) {
     _physics->Evaluate(_model, delta_time_seconds);
   }
 
@@ -363,10 +690,200 @@ void Model::update() {
     _pose->UpdateParameters(_model, delta_time_seconds);
   }
 
-  _model->Update();
+  if (_snapshots[0] == NULL && !_interpolating) {
+    _model->Update();
+  }
+  // Otherwise finish_update deforms whatever is drawn
 }
 
-Csm::CubismMotionQueueEntryHandle Model::start_motion(const Csm::csmChar* group, Csm::csmInt32 num, Csm::csmInt32 priority, Csm::ACubismMotion::FinishedMotionCallback on_motion_finished) {
+bool Model::enable_snapshots(TextureManager* texture_manager) {
+  if (_moc == NULL || _model == NULL) {
+    return false;
+  }
+  release_snapshots();
+
+  for (int i = 0; i < 2; i++) {
+    _snapshots[i] = _moc->CreateModel();
+    if (_snapshots[i] == NULL) {
+      LAppUtil::print_log("Error: could not create a snapshot of %s", _modelHomeDir.GetRawString());
+      release_snapshots();
+      return false;
+    }
+
+    _snapshotRenderers[i] = Csm::Rendering::CubismRenderer::Create();
+    _snapshotRenderers[i]->Initialize(_snapshots[i]);
+    bind_textures(texture_manager, static_cast<Csm::Rendering::CubismRenderer_OpenGLES2*>(_snapshotRenderers[i]));
+  }
+
+  // Both start out as the current state, so there's something to draw before the first publish
+  finish_update(1.0f);
+  swap_snapshots();
+  finish_update(1.0f);
+  return true;
+}
+
+void Model::save_previous_state() {
+  restore_simulated_state();
+  read_state(_model, _previousState);
+  _interpolating = true;
+}
+
+void Model::finish_update(Csm::csmFloat32 alpha) {
+  AllocTracker::FrameScope frame_scope("Model::finish_update");
+  if (_snapshots[0] == NULL && !_interpolating) {
+    // Already deformed by the last step
+    return;
+  }
+
+  restore_simulated_state();
+  read_state(_model, _currentState);
+  const std::vector<Csm::csmFloat32>* previous = NULL;
+  if (_interpolating && alpha < 1.0f && _previousState.size() == _currentState.size()) {
+    previous = &_previousState;
+  }
+
+  if (_snapshots[0] != NULL) {
+    Csm::CubismModel* back = _snapshots[1 - _frontSnapshot];
+    write_state(back, previous, _currentState, alpha);
+    back->Update();
+    _snapshotPublished = true;
+  }
+  else {
+    write_state(_model, previous, _currentState, alpha);
+    _model->Update();
+    _interpolated = previous != NULL;
+  }
+}
+
+void Model::restore_simulated_state() {
+  if (!_interpolated) {
+    return;
+  }
+  write_state(_model, NULL, _currentState, 1.0f);
+  _interpolated = false;
+}
+
+void Model::read_state(Csm::CubismModel* model, std::vector<Csm::csmFloat32>& state) {
+  const int parameter_count = csmGetParameterCount(model->GetModel());
+  const int part_count = csmGetPartCount(model->GetModel());
+  state.resize(parameter_count + part_count);
+  memcpy(state.data(), csmGetParameterValues(model->GetModel()), sizeof(float) * parameter_count);
+  memcpy(state.data() + parameter_count, csmGetPartOpacities(model->GetModel()), sizeof(float) * part_count);
+}
+
+void Model::write_state(Csm::CubismModel* model, const std::vector<Csm::csmFloat32>* from, const std::vector<Csm::csmFloat32>& to, Csm::csmFloat32 alpha) {
+  // Every instance comes from the same moc, so the core arrays line up one to one
+  const int parameter_count = csmGetParameterCount(model->GetModel());
+  const int part_count = csmGetPartCount(model->GetModel());
+  float* parameters = csmGetParameterValues(model->GetModel());
+  float* opacities = csmGetPartOpacities(model->GetModel());
+
+  if (from == NULL) {
+    memcpy(parameters, to.data(), sizeof(float) * parameter_count);
+    memcpy(opacities, to.data() + parameter_count, sizeof(float) * part_count);
+    return;
+  }
+
+  for (int i = 0; i < parameter_count; i++) {
+    parameters[i] = (*from)[i] + ((to[i] - (*from)[i]) * alpha);
+  }
+  for (int i = 0; i < part_count; i++) {
+    const int j = parameter_count + i;
+    opacities[i] = (*from)[j] + ((to[j] - (*from)[j]) * alpha);
+  }
+}
+
+void Model::swap_snapshots() {
+  if (!_snapshotPublished) {
+    return;
+  }
+  _frontSnapshot = 1 - _frontSnapshot;
+  _snapshotPublished = false;
+}
+
+void Model::release_snapshots() {
+  for (int i = 0; i < 2; i++) {
+    if (_snapshotRenderers[i] != NULL) {
+      Csm::Rendering::CubismRenderer::Delete(_snapshotRenderers[i]);
+      _snapshotRenderers[i] = NULL;
+    }
+    if (_snapshots[i] != NULL) {
+      _moc->DeleteModel(_snapshots[i]);
+      _snapshots[i] = NULL;
+    }
+  }
+  _frontSnapshot = 0;
+  _snapshotPublished = false;
+}
+
+Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2* Model::active_renderer() {
+  if (_snapshots[0] != NULL) {
+    return static_cast<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2*>(_snapshotRenderers[_frontSnapshot]);
+  }
+  return GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>();
+}
+
+Csm::csmBool Model::parameters_changed() {
+  if (_model == NULL) {
+    return false;
+  }
+
+  // Compare what will be drawn, which may be a snapshot or an interpolated state
+  Csm::CubismModel* model = _model;
+  if (_snapshots[0] != NULL) {
+    model = _snapshots[_snapshotPublished ? 1 - _frontSnapshot : _frontSnapshot];
+  }
+
+  const Csm::csmInt32 parameter_count = model->GetParameterCount();
+  const Csm::csmInt32 part_count = model->GetPartCount();
+  Csm::csmBool changed = false;
+
+  if (_lastParameterValues.GetSize() != parameter_count + part_count) {
+    _lastParameterValues.Resize(parameter_count + part_count, 0.0f);
+    changed = true;
+  }
+
+  for (Csm::csmInt32 i = 0; i < parameter_count; i++) {
+    const Csm::csmFloat32 value = model->GetParameterValue(i);
+    if (_lastParameterValues[i] != value) {
+      _lastParameterValues[i] = value;
+      changed = true;
+    }
+  }
+
+  for (Csm::csmInt32 i = 0; i < part_count; i++) {
+    const Csm::csmFloat32 opacity = model->GetPartOpacity(i);
+    if (_lastParameterValues[parameter_count + i] != opacity) {
+      _lastParameterValues[parameter_count + i] = opacity;
+      changed = true;
+    }
+  }
+
+  return changed;
+}
+
+int Model::find_motion_group(const Csm::csmChar* group) const {
+  for (size_t i = 0; i < _motionGroups.size(); i++) {
+    if (_motionGroups[i].name == group) {
+      return static_cast<int>(i);
+    }
+  }
+  return InvalidHandle;
+}
+
+Model::MotionHandle Model::get_motion_handle(int group, Csm::csmInt32 motion_num) const {
+  if (group < 0 || group >= static_cast<int>(_motionGroups.size()) ||
+      motion_num < 0 || motion_num >= _motionGroups[group].count) {
+    return InvalidHandle;
+  }
+  return _motionGroups[group].first + motion_num;
+}
+
+Csm::CubismMotionQueueEntryHandle Model::start_motion(MotionHandle motion, Csm::csmInt32 priority, Csm::ACubismMotion::FinishedMotionCallback on_motion_finished) {
+  if (motion < 0 || motion >= static_cast<MotionHandle>(_motions.size())) {
+    return Csm::InvalidMotionQueueEntryHandleValue;
+  }
+
   if (priority == LAppDefinitions::PriorityForce) {
     _motionManager->SetReservePriority(priority);
   }
@@ -377,51 +894,38 @@ Csm::CubismMotionQueueEntryHandle Model::start_motion(const Csm::csmChar* group,
     return Csm::InvalidMotionQueueEntryHandleValue;
   }
 
-  const Csm::csmString filename = _modelSetting->GetMotionFileName(group, num);
-  Csm::csmString name = Live2D::Cubism::Framework::Utils::CubismString::GetFormatedString("%s_%d", group, num);
-  Live2D::Cubism::Framework::CubismMotion* motion = static_cast<Live2D::Cubism::Framework::CubismMotion*>(_motions[name.GetRawString()]);
+  CachedMotion& cached = _motions[motion];
+  const Csm::csmChar* group = _motionGroups[cached.group].name.c_str();
+  Live2D::Cubism::Framework::CubismMotion* parsed = cached.motion;
   Csm::csmBool auto_delete = false;
 
-  if (motion == NULL) {
-    // The motion isn't already present in the list of pre-loaded motions,
-    // So we create a temporary motion object and set it to destroy once it's done
-    const Csm::csmString path = _modelHomeDir + filename;
-    
-    Csm::csmByte* buffer;
-    Csm::csmSizeInt size;
-    buffer = create_buffer(path.GetRawString(), &size);
-    if (buffer != NULL) {
-      motion = static_cast<Live2D::Cubism::Framework::CubismMotion*>(LoadMotion(buffer, size, NULL, on_motion_finished));
-      Csm::csmFloat32 fadeTime = _modelSetting->GetMotionFadeInTimeValue(group, num);
-      if (fadeTime >= 0.0f) {
-        motion->SetFadeInTime(fadeTime);
+  if (parsed == NULL) {
+    // First time this motion plays since it was loaded or dropped
+    MappedFile file;
+    if (open_asset(file, cached.path.c_str())) {
+      parsed = load_motion(motion, file);
+      if (file.get_size() <= _motionBudget) {
+        cached.motion = parsed;
+        cached.bytes = file.get_size();
+        _motionBytes += cached.bytes;
       }
-
-      fadeTime = _modelSetting->GetMotionFadeOutTimeValue(group, num);
-      if (fadeTime >= 0.0f) {
-        motion->SetFadeOutTime(fadeTime);
+      else {
+        // Too big to keep, so destroy it once it's done
+        auto_delete = true;
       }
-
-      motion->SetEffectIds(_eyeBlinkIds, _lipSyncIds);
-      auto_delete = true;
-
-      delete_buffer(buffer, path.GetRawString());
     }
     else {
       if (_debugMode) {
-        LAppUtil::print_log("Error loading motion %s_%d from file %s", group, num, path.GetRawString());
+        LAppUtil::print_log("Error loading motion %s_%d from file %s", group, cached.index, cached.path.c_str());
       }
       return Csm::InvalidMotionQueueEntryHandleValue;
     }
   }
-  else {
-    // Motion already registered, just need to set the handler
-    motion->SetFinishedMotionHandler(on_motion_finished);
-  }
+  parsed->SetFinishedMotionHandler(on_motion_finished);
 
   // Optionally load voice file that goes along with motion
   /*
-  Csm::csmString voice = _modelSetting->GetMotionSoundFileName(group, num);
+  Csm::csmString voice = _modelSetting->GetMotionSoundFileName(group, cached.index);
   if (strcmp(voice.GetRawString(), "") != 0) {
     csmString path = voice;
     path = _modelHomeDir + path;
@@ -430,20 +934,42 @@ Csm::CubismMotionQueueEntryHandle Model::start_motion(const Csm::csmChar* group,
   */
 
   if (_debugMode) {
-    LAppUtil::print_log("[APP] starting motion [%s_%d]", group, num);
+    LAppUtil::print_log("[APP] starting motion [%s_%d]", group, cached.index);
   }
 
-  return _motionManager->StartMotionPriority(motion, auto_delete, priority);
+  const Csm::CubismMotionQueueEntryHandle handle = _motionManager->StartMotionPriority(parsed, auto_delete, priority);
+  if (!auto_delete) {
+    cached.last_used = ++_motionUses;
+    cached.handle = handle;
+    // Only now that it's protected by its queue entry can the rest make room for it
+    evict_motions();
+  }
+  return handle;
 }
 
-Csm::CubismMotionQueueEntryHandle Model::start_random_motion(const Csm::csmChar* group, Csm::csmInt32 priority, Csm::ACubismMotion::FinishedMotionCallback on_motion_finished) {
-  if (_modelSetting->GetMotionCount(group) == 0) {
+Csm::CubismMotionQueueEntryHandle Model::start_random_motion(int group, Csm::csmInt32 priority, Csm::ACubismMotion::FinishedMotionCallback on_motion_finished) {
+  if (group < 0 || group >= static_cast<int>(_motionGroups.size()) || _motionGroups[group].count == 0) {
+    return Csm::InvalidMotionQueueEntryHandleValue;
+  }
+
+  const MotionGroup& motion_group = _motionGroups[group];
+  return start_motion(motion_group.first + rand() % motion_group.count, priority, on_motion_finished);
+}
+
+Csm::CubismMotionQueueEntryHandle Model::start_motion(const Csm::csmChar* group, Csm::csmInt32 num, Csm::csmInt32 priority, Csm::ACubismMotion::FinishedMotionCallback on_motion_finished) {
+  const MotionHandle motion = get_motion_handle(find_motion_group(group), num);
+  if (motion == InvalidHandle) {
+    if (_debugMode) {
+      LAppUtil::print_log("Error: no motion %s_%d", group, num);
+    }
     return Csm::InvalidMotionQueueEntryHandleValue;
   }
 
-  Csm::csmInt32 num = rand() % _modelSetting->GetMotionCount(group);
+  return start_motion(motion, priority, on_motion_finished);
+}
 
-  return start_motion(group, num, priority, on_motion_finished);
+Csm::CubismMotionQueueEntryHandle Model::start_random_motion(const Csm::csmChar* group, Csm::csmInt32 priority, Csm::ACubismMotion::FinishedMotionCallback on_motion_finished) {
+  return start_random_motion(find_motion_group(group), priority, on_motion_finished);
 }
 
 void Model::do_draw() {
@@ -451,7 +977,16 @@ void Model::do_draw() {
     return;
   }
 
-  GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>()->DrawModel();
+  const int scope = _profiler != NULL ? _profiler->begin(_profilerSection) : -1;
+  active_renderer()->DrawModel();
+  if (_profiler != NULL) {
+    _profiler->end(scope);
+  }
+}
+
+void Model::set_profiler(GpuProfiler* profiler, int section) {
+  _profiler = profiler;
+  _profilerSection = section;
 }
 
 void Model::draw(Csm::CubismMatrix44& matrix) {
@@ -461,7 +996,7 @@ void Model::draw(Csm::CubismMatrix44& matrix) {
 
   matrix.MultiplyByMatrix(_modelMatrix);
 
-  GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>()->SetMvpMatrix(&matrix);
+  active_renderer()->SetMvpMatrix(&matrix);
 
   do_draw();
 }
@@ -484,47 +1019,93 @@ Csm::csmBool Model::hit_test(const Csm::csmChar* area_name, Csm::csmFloat32 x, C
   return false;
 }
 
-void Model::set_expression(const Csm::csmChar* expression_id) {
-  Csm::ACubismMotion* motion = _expressions[expression_id];
+Model::ExpressionHandle Model::find_expression(const Csm::csmChar* expression_id) const {
+  for (size_t i = 0; i < _expressions.size(); i++) {
+    if (_expressions[i].name == expression_id) {
+      return static_cast<ExpressionHandle>(i);
+    }
+  }
+  return InvalidHandle;
+}
+
+void Model::set_expression(ExpressionHandle expression) {
+  if (expression < 0 || expression >= static_cast<ExpressionHandle>(_expressions.size())) {
+    return;
+  }
+
+  Expression& entry = _expressions[expression];
   if (_debugMode) {
-    LAppUtil::print_log("[APP] starting expression [%s]", expression_id);
+    LAppUtil::print_log("[APP] starting expression [%s]", entry.name.c_str());
   }
 
-  if (motion != NULL) {
-    _expressionManager->StartMotionPriority(motion, false, LAppDefinitions::PriorityForce);
+  if (entry.motion != NULL) {
+    entry.handle = _expressionManager->StartMotionPriority(entry.motion, false, LAppDefinitions::PriorityForce);
   }
   else {
     if (_debugMode) {
-      LAppUtil::print_log("Error: expression [%s] is NULL", expression_id);
+      LAppUtil::print_log("Error: expression [%s] is NULL", entry.name.c_str());
     }
   }
 }
 
-void Model::set_random_expression() {
-  if (_expressions.GetSize() == 0) {
+void Model::set_expression(const Csm::csmChar* expression_id) {
+  const ExpressionHandle expression = find_expression(expression_id);
+  if (expression == InvalidHandle) {
+    if (_debugMode) {
+      LAppUtil::print_log("Error: no expression [%s]", expression_id);
+    }
     return;
   }
 
-  Csm::csmInt32 num = rand() % _expressions.GetSize();
-  Csm::csmMap<Csm::csmString, Csm::ACubismMotion*>::const_iterator map_iter;
-  Csm::csmInt32 i = 0;
-  for (auto map_iter = _expressions.Begin(); map_iter != _expressions.End(); map_iter++, i++) {
-    if (i == num) {
-      Csm::csmString name = (*map_iter).First;
-      set_expression(name.GetRawString());
-      return;
-    }
+  set_expression(expression);
+}
+
+void Model::set_random_expression() {
+  if (_expressions.empty()) {
+    return;
   }
+
+  set_expression(static_cast<ExpressionHandle>(rand() % _expressions.size()));
 }
 
 void Model::reload_renderer(TextureManager* texture_manager) {
+  // Released once rebound, so the textures stay resident in between
+  std::vector<GLuint> previous_ids;
+  previous_ids.swap(_textureIds);
+
   DeleteRenderer();
   CreateRenderer();
   setup_textures(texture_manager);
+
+  for (int i = 0; i < 2; i++) {
+    if (_snapshotRenderers[i] != NULL) {
+      Csm::Rendering::CubismRenderer::Delete(_snapshotRenderers[i]);
+      _snapshotRenderers[i] = Csm::Rendering::CubismRenderer::Create();
+      _snapshotRenderers[i]->Initialize(_snapshots[i]);
+      bind_textures(texture_manager, static_cast<Csm::Rendering::CubismRenderer_OpenGLES2*>(_snapshotRenderers[i]));
+    }
+  }
+
+  release_textures(previous_ids);
 }
 
 void Model::setup_textures(TextureManager* texture_manager) {
+  StartupProfiler::Scope scope("load textures");
+  bind_textures(texture_manager, GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>());
+}
+
+void Model::bind_textures(TextureManager* texture_manager, Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2* renderer) {
   Csm::csmInt32 num_textures = _modelSetting->GetTextureCount();
+  _textureManager = texture_manager;
+
+  // Decode every atlas at once, they're uploaded one by one below
+  for (Csm::csmInt32 texture_num = 0; texture_num < num_textures; texture_num++) {
+    Csm::csmString texture_path = _modelSetting->GetTextureFileName(texture_num);
+    if (strcmp(texture_path.GetRawString(), "") != 0) {
+      texture_manager->preload_png((_modelHomeDir + texture_path).GetRawString());
+    }
+  }
+
   for (Csm::csmInt32 texture_num = 0; texture_num < num_textures; texture_num++) {
     Csm::csmString texture_path = _modelSetting->GetTextureFileName(texture_num);
     if (strcmp(texture_path.GetRawString(), "") == 0) {
@@ -540,16 +1121,26 @@ void Model::setup_textures(TextureManager* texture_manager) {
       return;
     }
 
-    GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>()->BindTexture(texture_num, texture_info->id);
+    renderer->BindTexture(texture_num, texture_info->id);
+    _textureIds.push_back(texture_info->id);
   }
 
 #ifdef PREMULTIPLIED_ALPHA_ENABLE
-  GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>()->IsPremultipliedAlpha(true);
+  renderer->IsPremultipliedAlpha(true);
 #else
-  GetRenderer<Live2D::Cubism::Framework::Rendering::CubismRenderer_OpenGLES2>()->IsPremultipliedAlpha(false);
+  renderer->IsPremultipliedAlpha(false);
 #endif
 }
 
+void Model::release_textures(const std::vector<GLuint>& texture_ids) {
+  if (_textureManager == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < texture_ids.size(); i++) {
+    _textureManager->release_texture(texture_ids[i]);
+  }
+}
+
 void Model::motion_event_fired(const Csm::csmString& event_value) {
   CubismLogInfo("%s was fired on Model!", event_value.GetRawString());
 }
\ No newline at end of file
@@ -1,23 +1,62 @@
 ﻿#ifndef LIVE2D_MODEL_HPP
 #define LIVE2D_MODEL_HPP
 
+#include <string>
+#include <vector>
 #include <CubismFramework.hpp>
 #include <Model/CubismUserModel.hpp>
 #include <ICubismModelSetting.hpp>
+#include <Motion/CubismMotion.hpp>
 #include <Type/csmRectF.hpp>
 #include <Rendering/OpenGL/CubismOffscreenSurface_OpenGLES2.hpp>
+#include <Rendering/OpenGL/CubismRenderer_OpenGLES2.hpp>
 
 #include "TextureManager.hpp"
+#include "GpuProfiler.hpp"
+#include "MappedFile.hpp"
+#include "Allocator.hpp"
+#include "ModelBundle.hpp"
 
 
 class Model : public Csm::CubismUserModel {
 public:
+  /**
+   * @brief How much simulation work the model gets, cheapest last
+   */
+  enum LodLevel {
+    LodFull,    ///< Everything, every step
+    LodReduced, ///< Every 2nd step, no breathing
+    LodMinimal, ///< Every 4th step, no breathing, eye blinks or physics
+    LodPaused,  ///< Not simulated at all
+    NUM_LOD_LEVELS
+  };
+
+  /**
+   * @brief A motion numbered by its group and index once the settings are loaded
+   *
+   * Starting a motion or expression by handle is an array index, without
+   * the string formatting and lookups starting one by name takes.
+   */
+  typedef int MotionHandle;
+  typedef int ExpressionHandle;
+  static const int InvalidHandle = -1;
+
   /**
    * Default constructor/destructor
    */
   Model();
   virtual ~Model();
 
+  /**
+   * @brief Delete a model, then the arena its moc and model data came from
+   *
+   * The framework frees that data in CubismUserModel's destructor, after
+   * every member of Model is gone, so the arena can't be one of them.
+   *
+   * @param[in] model
+   */
+  static void destroy(Model* model);
+
   /**
    * @brief Load from a model3.json file
    * 
@@ -34,8 +73,54 @@ public:
    */
   void reload_renderer(TextureManager* texture_manager);
   
+  /**
+   * @brief Advance motions, expressions and physics by the time since the last frame
+   */
   void update();
 
+  /**
+   * @brief Advance motions, expressions and physics by a given amount of time
+   *
+   * @param[in] delta_time_seconds
+   */
+  void update(Csm::csmFloat32 delta_time_seconds);
+
+  /**
+   * @brief Queue the next idle motion if nothing is playing
+   *
+   * Picks motions with rand() and may parse files, which registers ids with the
+   * framework's id manager, so this runs on the render thread before a frame's
+   * steps are handed to the models.
+   */
+  void schedule_motions();
+
+  /**
+   * @brief The part of `update` after `schedule_motions`
+   *
+   * Only touches this model's own state, so different models may be advanced
+   * on different threads at once.
+   *
+   * @param[in] delta_time_seconds
+   */
+  void update_parameters(Csm::csmFloat32 delta_time_seconds);
+
+  /**
+   * @brief Choose how much simulation work `update_parameters` does
+   *
+   * Skipped steps aren't lost, their time is added to the next step that runs.
+   */
+  void set_lod(LodLevel level) { _lod = level; }
+  LodLevel get_lod() const { return _lod; }
+
+  /**
+   * @brief Check whether any parameter or part opacity changed since the last call
+   *
+   * The first call always reports a change.
+   *
+   * @return true iff the model would render differently than last time
+   */
+  Csm::csmBool parameters_changed();
+
   /**
    * @brief Render the model onto the internal renderer using the provided projection matrix
    * 
@@ -43,6 +128,142 @@ public:
    */
   void draw(Csm::CubismMatrix44& matrix);
 
+  /**
+   * @brief Time every DrawModel call under the given profiler section
+   *
+   * @param[in] profiler NULL to stop profiling
+   * @param[in] section
+   */
+  void set_profiler(GpuProfiler* profiler, int section);
+
+  /**
+   * @brief Draw from snapshots so the model can be simulated while it's being drawn
+   *
+   * Creates two extra instances of the model, each with its own renderer. The
+   * simulation keeps running on the main instance, but no longer computes
+   * drawables there. `finish_update` copies its parameters into the
+   * snapshot that isn't being drawn and deforms it, `swap_snapshots` makes
+   * that the one drawn from. Must be called on the render thread.
+   *
+   * @param[in] texture_manager
+   * @return true iff the snapshots were created
+   */
+  bool enable_snapshots(TextureManager* texture_manager);
+
+  /**
+   * @brief Remember the simulated state before the next step, for `finish_update` to interpolate from
+   *
+   * The first call switches the model to interpolated rendering: from then on
+   * steps no longer deform the model, `finish_update` does.
+   */
+  void save_previous_state();
+
+  /**
+   * @brief Deform the model to the simulated state so it can be drawn
+   *
+   * With snapshots enabled this fills the back snapshot, and may run on
+   * another thread than `draw`, but not at the same time as `swap_snapshots`.
+   *
+   * @param[in] alpha How far between the state saved by `save_previous_state` (0) and the current one (1) to draw
+   */
+  void finish_update(Csm::csmFloat32 alpha);
+
+  /**
+   * @brief Draw the most recently published snapshot from now on
+   */
+  void swap_snapshots();
+
+  /**
+   * @brief Cap the parsed motions kept around once they stop playing
+   *
+   * Motions are loaded when first started and dropped least recently used
+   * first, measured by the size of their motion3.json. One larger than the
+   * whole budget is parsed again every time it plays.
+   *
+   * @param[in] bytes
+   */
+  void set_motion_budget(size_t bytes);
+  size_t get_motion_bytes() const { return _motionBytes; }
+
+  const Csm::csmChar* get_home_dir() const { return _modelHomeDir.GetRawString(); }
+  bool is_bundled() const { return _bundle != NULL; }
+
+  /**
+   * @brief What a model uses a file as
+   */
+  enum AssetKind {
+    NoAsset,
+    MotionAsset,
+    ExpressionAsset,
+    PhysicsAsset
+  };
+
+  /**
+   * @brief A new version of a motion, expression or physics, parsed for reload_asset
+   */
+  struct ParsedAsset {
+    AssetKind kind = NoAsset;
+    Csm::ACubismMotion* motion = NULL; ///< Motions and expressions, NULL if parsing failed
+    Csm::CubismPhysics* physics = NULL; ///< NULL if parsing failed
+    size_t bytes = 0; ///< Of the file
+  };
+
+  /**
+   * @param[in] path Of the file, as the model refers to it under its directory
+   * @return What the model uses the file as, NoAsset if nothing
+   */
+  AssetKind find_asset(const std::string& path) const;
+
+  /**
+   * @brief Parse a motion, expression or physics for reload_asset
+   *
+   * Parsing interns every id the file names, and Cubism's id manager isn't
+   * thread safe, so this only runs on the render thread between steps.
+   *
+   * @param[out] asset Left without an object if the file doesn't parse
+   */
+  static void parse_asset(AssetKind kind, const MappedFile& file, ParsedAsset& asset);
+  static void delete_asset(ParsedAsset& asset);
+
+  /**
+   * @brief Swap in a new version of one of the model's motions, expressions or its physics
+   *
+   * A motion that's playing finishes as it started, a playing expression
+   * is restarted in its new version. Must not run while the model is being
+   * simulated.
+   *
+   * @param[in] path Of the file, as the model refers to it under its directory
+   * @param[in] asset Parsed from the file's new contents, taken over whether it's used or not
+   * @return false if the model doesn't use the file
+   */
+  bool reload_asset(const std::string& path, ParsedAsset& asset);
+
+  /**
+   * @return Index of a motion group, InvalidHandle if the model has none by that name
+   */
+  int find_motion_group(const Csm::csmChar* group) const;
+
+  /**
+   * @return InvalidHandle if the group doesn't have that many motions
+   */
+  MotionHandle get_motion_handle(int group, Csm::csmInt32 motion_num) const;
+  ExpressionHandle find_expression(const Csm::csmChar* expression) const;
+
+  Csm::CubismMotionQueueEntryHandle start_motion(
+    MotionHandle motion,
+    Csm::csmInt32 priority,
+    Csm::ACubismMotion::FinishedMotionCallback on_motion_finished = NULL
+    );
+
+  Csm::CubismMotionQueueEntryHandle start_random_motion(
+    int group,
+    Csm::csmInt32 priority,
+    Csm::ACubismMotion::FinishedMotionCallback on_motion_finished = NULL
+  );
+
+  /**
+   * @brief Same as the handle versions, looking the motion up by name first
+   */
   Csm::CubismMotionQueueEntryHandle start_motion(
     const Csm::csmChar* group,
     Csm::csmInt32 motion_num,
@@ -56,6 +277,7 @@ public:
     Csm::ACubismMotion::FinishedMotionCallback on_motion_finished = NULL
   );
 
+  void set_expression(ExpressionHandle expression);
   void set_expression(const Csm::csmChar* expression);
   void set_random_expression();
 
@@ -69,9 +291,117 @@ public:
 protected:
   void do_draw();
 private:
-  void setup_model(Csm::ICubismModelSetting* settings);
+  /**
+   * @brief A file of the model, read ahead of being parsed
+   */
+  struct AssetFile {
+    std::string path;
+    MappedFile file; ///< Not open if the file couldn't be read
+  };
+
+  /**
+   * @brief Map a list of files and fault them in concurrently
+   *
+   * @return Milliseconds spent reading
+   */
+  static double read_asset_files(std::vector<AssetFile>& files);
+
+  /**
+   * @return Milliseconds spent reading files
+   */
+  double setup_model(Csm::ICubismModelSetting* settings);
   void setup_textures(TextureManager* texture_manager);
-  void preload_motion_group(const Csm::csmChar* group);
+  void bind_textures(TextureManager* texture_manager, Csm::Rendering::CubismRenderer_OpenGLES2* renderer);
+
+  /**
+   * @brief Give back texture references to the texture manager they came from
+   */
+  void release_textures(const std::vector<GLuint>& texture_ids);
+
+  /**
+   * @brief The renderer to draw with, the front snapshot's when snapshots are enabled
+   */
+  Csm::Rendering::CubismRenderer_OpenGLES2* active_renderer();
+  void release_snapshots();
+
+  /**
+   * @brief Undo the interpolation `finish_update` applied to _model, before simulating further
+   */
+  void restore_simulated_state();
+
+  /**
+   * @brief Copy parameter values followed by part opacities out of a model
+   */
+  void read_state(Csm::CubismModel* model, std::vector<Csm::csmFloat32>& state);
+
+  /**
+   * @brief Write `to`, or `alpha` of the way from `from` to `to` if `from` isn't NULL, into a model
+   */
+  void write_state(Csm::CubismModel* model, const std::vector<Csm::csmFloat32>* from, const std::vector<Csm::csmFloat32>& to, Csm::csmFloat32 alpha);
+
+  /**
+   * @brief A motion of the settings, parsed once started and kept for the next time
+   */
+  struct CachedMotion {
+    int group = InvalidHandle; ///< Into _motionGroups
+    Csm::csmInt32 index = 0; ///< Within the group
+    std::string path;
+    Csm::CubismMotion* motion = NULL; ///< NULL until loaded, and again once dropped
+    size_t bytes = 0;
+    unsigned long long last_used = 0; ///< _motionUses as of the last start
+    Csm::CubismMotionQueueEntryHandle handle = Csm::InvalidMotionQueueEntryHandleValue; ///< Queue entry of the last start, the motion is kept until it finishes
+  };
+
+  struct MotionGroup {
+    std::string name;
+    MotionHandle first; ///< The group's motions have consecutive handles from here
+    Csm::csmInt32 count;
+  };
+
+  struct Expression {
+    std::string name;
+    std::string path;
+    Csm::ACubismMotion* motion;
+    Csm::CubismMotionQueueEntryHandle handle; ///< Queue entry of the last start
+  };
+
+  /**
+   * @brief A motion or expression replaced by reload_asset, deleted once its queue entry finishes
+   */
+  struct RetiredMotion {
+    Csm::ACubismMotion* motion;
+    Csm::CubismMotionManager* manager;
+    Csm::CubismMotionQueueEntryHandle handle;
+  };
+
+  /**
+   * @param[in] all Whether to delete the ones still playing too
+   */
+  void release_retired_motions(bool all);
+
+  /**
+   * @brief Hand out a MotionHandle to every motion in the settings
+   */
+  void index_motions();
+
+  /**
+   * @brief Parse every motion of a group into the motion cache
+   *
+   * @param[in] group Index into _motionGroups
+   * @param[in] files The group's motion files, already read
+   */
+  void preload_motion_group(int group, const AssetFile* files);
+
+  /**
+   * @brief Parse a motion and apply its fade times and effect ids
+   */
+  Csm::CubismMotion* load_motion(MotionHandle motion, const MappedFile& file);
+  void configure_motion(MotionHandle handle, Csm::CubismMotion* motion);
+
+  /**
+   * @brief Drop motions that aren't playing, least recently used first, until within budget
+   */
+  void evict_motions();
   void release_motion_group(const Csm::csmChar* group);
 
   /**
@@ -89,10 +419,34 @@ private:
   Csm::csmFloat32 _userTimeSeconds; ///< デルタ時間の積算値[秒]
   Csm::csmVector<Csm::CubismIdHandle> _eyeBlinkIds; ///< モデルに設定されたまばたき機能用パラメータID
   Csm::csmVector<Csm::CubismIdHandle> _lipSyncIds; ///< モデルに設定されたリップシンク機能用パラメータID
-  Csm::csmMap<Csm::csmString, Csm::ACubismMotion*>   _motions; ///< 読み込まれているモーションのリスト
-  Csm::csmMap<Csm::csmString, Csm::ACubismMotion*>   _expressions; ///< 読み込まれている表情のリスト
+  std::vector<MotionGroup> _motionGroups;
+  std::vector<CachedMotion> _motions; ///< Indexed by MotionHandle
+  int _idleGroup; ///< Index into _motionGroups, InvalidHandle if the model has no idle motions
+  size_t _motionBytes;  ///< Sum of _motions' sizes
+  size_t _motionBudget;
+  unsigned long long _motionUses; ///< Motions started so far
+  std::vector<Expression> _expressions; ///< 読み込まれている表情のリスト, indexed by ExpressionHandle
+  std::vector<RetiredMotion> _retiredMotions;
   Csm::csmVector<Csm::csmRectF> _hitArea;
   Csm::csmVector<Csm::csmRectF> _userArea;
+  Csm::csmVector<Csm::csmFloat32> _lastParameterValues; ///< Parameter values followed by part opacities, as of the last parameters_changed call
+  GpuProfiler* _profiler;
+  int _profilerSection;
+  Csm::CubismModel* _snapshots[2]; ///< Deformed copies of _model to draw from, NULL unless enabled
+  Csm::Rendering::CubismRenderer* _snapshotRenderers[2];
+  int _frontSnapshot; ///< Snapshot currently being drawn
+  bool _snapshotPublished; ///< The back snapshot holds a newer state than the front one
+  LAppArena* _arena; ///< Moc and model data, in LAppAllocator::Arena mode
+  ModelBundle* _bundle; ///< Mounted over _modelHomeDir, NULL when the model is read from its directory
+  TextureManager* _textureManager; ///< Where _textureIds were acquired
+  std::vector<GLuint> _textureIds; ///< One reference per texture bound to any of the renderers
+  LodLevel _lod;
+  int _lodSkippedSteps;
+  Csm::csmFloat32 _lodSkippedTime;
+  bool _interpolating; ///< Drawables are only computed in finish_update
+  bool _interpolated;  ///< _model currently holds an interpolated state, not the simulated one
+  std::vector<Csm::csmFloat32> _previousState; ///< Simulated state before the last step
+  std::vector<Csm::csmFloat32> _currentState;
   const Csm::CubismId* _idParamAngleX; ///< パラメータID: ParamAngleX
   const Csm::CubismId* _idParamAngleY; ///< パラメータID: ParamAngleX
   const Csm::CubismId* _idParamAngleZ; ///< パラメータID: ParamAngleX
@@ -0,0 +1,263 @@
+#include "ModelBundle.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <filesystem>
+#include <mutex>
+#include <vector>
+
+#include "Util.hpp"
+
+static const char BUNDLE_MAGIC[8] = { 'F', 'S', 'B', 'U', 'N', 'D', 'L', 'E' };
+static const uint32_t BUNDLE_VERSION = 1;
+// csmReviveMocInPlace wants the moc 64 byte aligned, the rest doesn't mind
+static const uint64_t BLOB_ALIGNMENT = 64;
+
+/**
+ * Start of a bundle, followed by the entries, their names, then the blobs. Stored little endian.
+ */
+struct BundleHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t file_count;
+  uint64_t names_size; ///< Bytes of names following the entries
+};
+
+struct BundleEntry {
+  uint64_t offset; ///< From the start of the bundle, a multiple of BLOB_ALIGNMENT
+  uint64_t size;
+  uint32_t name_offset; ///< Into the names
+  uint32_t name_size;
+};
+
+struct Mount {
+  std::string dir;
+  ModelBundle* bundle;
+};
+
+static std::mutex mounts_mutex;
+static std::vector<Mount> mounts;
+
+ModelBundle::ModelBundle() :
+  _modified(0)
+{
+  // Pass
+}
+
+ModelBundle::~ModelBundle() {
+  unmount(this);
+  close();
+}
+
+bool ModelBundle::open(const std::string& path) {
+  close();
+  if (!_file.open(path)) {
+    return false;
+  }
+
+  const Csm::csmByte* data = _file.get_data();
+  const uint64_t size = _file.get_size();
+  BundleHeader header;
+  uint64_t names_start = 0;
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    memcpy(&header, data, sizeof(header));
+    // One term at a time, a corrupt count or size could overflow the sum
+    uint64_t remaining = size - sizeof(header);
+    valid = memcmp(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC)) == 0 &&
+      header.version == BUNDLE_VERSION &&
+      header.file_count <= remaining / sizeof(BundleEntry);
+    if (valid) {
+      remaining -= static_cast<uint64_t>(header.file_count) * sizeof(BundleEntry);
+      valid = header.names_size <= remaining;
+      names_start = sizeof(header) + static_cast<uint64_t>(header.file_count) * sizeof(BundleEntry);
+    }
+  }
+
+  for (uint32_t i = 0; valid && i < header.file_count; i++) {
+    BundleEntry entry;
+    memcpy(&entry, data + sizeof(header) + i * sizeof(BundleEntry), sizeof(entry));
+    valid = static_cast<uint64_t>(entry.name_offset) + entry.name_size <= header.names_size &&
+      entry.offset <= size && entry.size <= size - entry.offset;
+    if (valid) {
+      const std::string name(reinterpret_cast<const char*>(data + names_start + entry.name_offset), entry.name_size);
+      Blob blob = { data + entry.offset, static_cast<size_t>(entry.size) };
+      _files[name] = blob;
+    }
+  }
+
+  if (!valid) {
+    LAppUtil::print_log("Error: %s is not a valid model bundle", path.c_str());
+    close();
+    return false;
+  }
+
+  struct stat stat_buf;
+  if (stat(path.c_str(), &stat_buf) == 0) {
+    _modified = static_cast<long long>(stat_buf.st_mtime);
+  }
+  return true;
+}
+
+void ModelBundle::close() {
+  _files.clear();
+  _file.close();
+  _modified = 0;
+}
+
+bool ModelBundle::find(const std::string& name, MappedFile& file) const {
+  auto blob = _files.find(name);
+  if (blob == _files.end()) {
+    return false;
+  }
+  file.open_view(blob->second.data, blob->second.size);
+  return true;
+}
+
+/**
+ * @brief Position of a file in the bundle, in the order models load them
+ */
+static int load_order(const std::string& name) {
+  static const char* suffixes[] = {
+    ".model3.json", ".moc3", ".exp3.json", ".physics3.json", ".pose3.json", ".userdata3.json", ".png", ".motion3.json"
+  };
+  const int count = static_cast<int>(sizeof(suffixes) / sizeof(suffixes[0]));
+  for (int i = 0; i < count; i++) {
+    if (name.ends_with(suffixes[i])) {
+      return i;
+    }
+  }
+  return count;
+}
+
+static uint64_t align_blob(uint64_t offset) {
+  return (offset + BLOB_ALIGNMENT - 1) / BLOB_ALIGNMENT * BLOB_ALIGNMENT;
+}
+
+bool ModelBundle::pack(const std::string& model_dir, const std::string& output) {
+  std::error_code error;
+  std::vector<std::string> names;
+  std::filesystem::recursive_directory_iterator iter(model_dir, error);
+  for (; !error && iter != std::filesystem::recursive_directory_iterator(); iter.increment(error)) {
+    // Empty files can't be mapped and hold nothing to load anyway
+    if (iter->is_regular_file(error) && iter->file_size(error) > 0) {
+      names.push_back(iter->path().lexically_relative(model_dir).generic_string());
+    }
+  }
+  if (error || names.empty()) {
+    LAppUtil::print_log("Error: no files to pack in %s", model_dir.c_str());
+    return false;
+  }
+  std::sort(names.begin(), names.end(), [](const std::string& a, const std::string& b) {
+    const int order_a = load_order(a);
+    const int order_b = load_order(b);
+    return order_a != order_b ? order_a < order_b : a < b;
+  });
+
+  std::vector<MappedFile> files(names.size());
+  std::vector<BundleEntry> entries(names.size());
+  std::string name_table;
+  for (size_t i = 0; i < names.size(); i++) {
+    if (!files[i].open(model_dir + "/" + names[i])) {
+      return false;
+    }
+    entries[i].size = files[i].get_size();
+    entries[i].name_offset = static_cast<uint32_t>(name_table.size());
+    entries[i].name_size = static_cast<uint32_t>(names[i].size());
+    name_table += names[i];
+  }
+
+  BundleHeader header;
+  memcpy(header.magic, BUNDLE_MAGIC, sizeof(BUNDLE_MAGIC));
+  header.version = BUNDLE_VERSION;
+  header.file_count = static_cast<uint32_t>(names.size());
+  header.names_size = name_table.size();
+  uint64_t offset = align_blob(sizeof(header) + entries.size() * sizeof(BundleEntry) + name_table.size());
+  for (size_t i = 0; i < entries.size(); i++) {
+    entries[i].offset = offset;
+    offset = align_blob(offset + entries[i].size);
+  }
+
+  // Written under a temporary name so a crash never leaves a truncated bundle behind
+  const std::string temp_path = output + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == NULL) {
+    LAppUtil::print_log("Error: could not write model bundle %s", temp_path.c_str());
+    return false;
+  }
+
+  static const uint8_t padding[BLOB_ALIGNMENT] = {};
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(entries.data(), sizeof(BundleEntry), entries.size(), file) == entries.size() &&
+    fwrite(name_table.data(), 1, name_table.size(), file) == name_table.size();
+  uint64_t position = sizeof(header) + entries.size() * sizeof(BundleEntry) + name_table.size();
+  for (size_t i = 0; written && i < entries.size(); i++) {
+    const size_t pad = static_cast<size_t>(entries[i].offset - position);
+    written = fwrite(padding, 1, pad, file) == pad &&
+      fwrite(files[i].get_data(), 1, entries[i].size, file) == entries[i].size;
+    position = entries[i].offset + entries[i].size;
+  }
+  fclose(file);
+
+  if (!written) {
+    LAppUtil::print_log("Error: could not write model bundle %s", temp_path.c_str());
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  std::filesystem::rename(temp_path, output, error);
+  if (error) {
+    LAppUtil::print_log("Error: could not write model bundle %s", output.c_str());
+    std::remove(temp_path.c_str());
+    return false;
+  }
+
+  LAppUtil::print_log("[APP] packed %zu files from %s into %s, %.2f MB",
+    names.size(), model_dir.c_str(), output.c_str(), position / (1024.0 * 1024.0));
+  return true;
+}
+
+void ModelBundle::mount(const std::string& dir, ModelBundle* bundle) {
+  std::lock_guard<std::mutex> lock(mounts_mutex);
+  Mount mount = { dir, bundle };
+  mounts.push_back(mount);
+}
+
+void ModelBundle::unmount(ModelBundle* bundle) {
+  std::lock_guard<std::mutex> lock(mounts_mutex);
+  mounts.erase(std::remove_if(mounts.begin(), mounts.end(), [bundle](const Mount& mount) {
+    return mount.bundle == bundle;
+  }), mounts.end());
+}
+
+bool ModelBundle::open_asset(MappedFile& file, const std::string& path) {
+  {
+    std::lock_guard<std::mutex> lock(mounts_mutex);
+    for (size_t i = 0; i < mounts.size(); i++) {
+      if (path.starts_with(mounts[i].dir) && mounts[i].bundle->find(path.substr(mounts[i].dir.size()), file)) {
+        return true;
+      }
+    }
+  }
+  return file.open(path);
+}
+
+std::string ModelBundle::get_asset_key(const std::string& path) {
+  std::lock_guard<std::mutex> lock(mounts_mutex);
+  for (size_t i = 0; i < mounts.size(); i++) {
+    const ModelBundle* bundle = mounts[i].bundle;
+    if (!path.starts_with(mounts[i].dir)) {
+      continue;
+    }
+    auto blob = bundle->_files.find(path.substr(mounts[i].dir.size()));
+    if (blob != bundle->_files.end()) {
+      char key[96];
+      snprintf(key, sizeof(key), "bundle:%lld:%lld:%zu", bundle->_modified,
+        static_cast<long long>(blob->second.data - bundle->_file.get_data()), blob->second.size);
+      return key;
+    }
+  }
+  return "";
+}
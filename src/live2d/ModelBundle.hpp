@@ -0,0 +1,98 @@
+#ifndef LIVE2D_MODEL_BUNDLE_HPP
+#define LIVE2D_MODEL_BUNDLE_HPP
+
+#include <string>
+#include <unordered_map>
+#include <CubismFramework.hpp>
+
+#include "MappedFile.hpp"
+
+/**
+ * @brief Every file of a model packed into one, read through a single mapping
+ *
+ * A bundle is a header, a table of contents naming each file by its path
+ * relative to the model's directory, then the files' contents, each aligned
+ * to 64 bytes like the moc requires. Once a bundle is mounted over its
+ * model's directory, open_asset serves files from it instead of the disk.
+ */
+class ModelBundle {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  ModelBundle();
+  ~ModelBundle();
+
+  ModelBundle(const ModelBundle&) = delete;
+  ModelBundle& operator=(const ModelBundle&) = delete;
+
+  /**
+   * @brief Map a bundle and read its table of contents
+   *
+   * @param[in] path
+   * @return false if the file couldn't be read or isn't a valid bundle
+   */
+  bool open(const std::string& path);
+  void close();
+
+  /**
+   * @brief Look up a packed file
+   *
+   * @param[in] name Path relative to the model's directory
+   * @param[out] file Views the file's contents, valid while the bundle is open
+   * @return false if the bundle doesn't have it
+   */
+  bool find(const std::string& name, MappedFile& file) const;
+
+  size_t get_file_count() const { return _files.size(); }
+
+  /**
+   * @brief Pack every file under a model's directory into a bundle
+   *
+   * Files are laid out in the order a model loads them, settings and moc first.
+   *
+   * @param[in] model_dir
+   * @param[in] output
+   * @return true iff the bundle was written
+   */
+  static bool pack(const std::string& model_dir, const std::string& output);
+
+  /**
+   * @brief Serve files under a directory from a bundle, until it's unmounted
+   *
+   * @param[in] dir Ending in a slash, as it prefixes asset paths
+   * @param[in] bundle Has to stay open while mounted
+   */
+  static void mount(const std::string& dir, ModelBundle* bundle);
+  static void unmount(ModelBundle* bundle);
+
+  /**
+   * @brief Open an asset from the bundle mounted over its directory, or from disk if none has it
+   *
+   * Safe to call from any thread.
+   *
+   * @param[out] file
+   * @param[in] path
+   * @return true iff the file's contents are available
+   */
+  static bool open_asset(MappedFile& file, const std::string& path);
+
+  /**
+   * @brief Identifies a bundled asset's contents, for caches keyed by source file
+   *
+   * @return Empty if no mounted bundle has the asset
+   */
+  static std::string get_asset_key(const std::string& path);
+
+private:
+  struct Blob {
+    const Csm::csmByte* data;
+    size_t size;
+  };
+
+  MappedFile _file;
+  std::unordered_map<std::string, Blob> _files;
+  long long _modified; ///< Modification time of the bundle, for get_asset_key
+};
+
+#endif /* LIVE2D_MODEL_BUNDLE_HPP */
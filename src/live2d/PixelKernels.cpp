@@ -0,0 +1,331 @@
+#include "PixelKernels.hpp"
+
+#include <string.h>
+#include <vector>
+
+#include "Util.hpp"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define PIXEL_KERNELS_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC lets any function use any instruction set
+#define TARGET_SSE2
+#define TARGET_AVX2
+#else
+#define TARGET_SSE2 __attribute__((target("sse2")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+static void premultiply_alpha_scalar(uint8_t* pixels, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    uint8_t* p = pixels + i * 4;
+    const uint32_t alpha = static_cast<uint32_t>(p[3]) + 1;
+    p[0] = static_cast<uint8_t>((p[0] * alpha) >> 8);
+    p[1] = static_cast<uint8_t>((p[1] * alpha) >> 8);
+    p[2] = static_cast<uint8_t>((p[2] * alpha) >> 8);
+  }
+}
+
+static void swap_red_blue_scalar(const uint8_t* src, uint8_t* dst, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* s = src + i * 4;
+    uint8_t* d = dst + i * 4;
+    const uint8_t red = s[0];
+    d[0] = s[2];
+    d[1] = s[1];
+    d[2] = red;
+    d[3] = s[3];
+  }
+}
+
+static void expand_to_four_channels_scalar(const uint8_t* src, uint8_t* dst, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    const uint8_t* s = src + i * 3;
+    uint8_t* d = dst + i * 4;
+    d[0] = s[0];
+    d[1] = s[1];
+    d[2] = s[2];
+    d[3] = 255;
+  }
+}
+
+#ifdef PIXEL_KERNELS_X86
+
+/**
+ * @brief Premultiply two pixels widened to 16 bits per channel
+ */
+TARGET_SSE2 static inline __m128i premultiply_lanes_sse2(__m128i color, __m128i one, __m128i alpha_mask) {
+  const __m128i alpha = _mm_shufflehi_epi16(_mm_shufflelo_epi16(color, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  // At most 255 * 256, so the low 16 bits of the product are the whole product
+  const __m128i scaled = _mm_srli_epi16(_mm_mullo_epi16(color, _mm_add_epi16(alpha, one)), 8);
+  return _mm_or_si128(_mm_andnot_si128(alpha_mask, scaled), _mm_and_si128(alpha_mask, color));
+}
+
+TARGET_SSE2 static void premultiply_alpha_sse2(uint8_t* pixels, size_t count) {
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(1);
+  const __m128i alpha_mask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    __m128i* p = reinterpret_cast<__m128i*>(pixels + i * 4);
+    const __m128i v = _mm_loadu_si128(p);
+    const __m128i lo = premultiply_lanes_sse2(_mm_unpacklo_epi8(v, zero), one, alpha_mask);
+    const __m128i hi = premultiply_lanes_sse2(_mm_unpackhi_epi8(v, zero), one, alpha_mask);
+    _mm_storeu_si128(p, _mm_packus_epi16(lo, hi));
+  }
+  premultiply_alpha_scalar(pixels + i * 4, count - i);
+}
+
+TARGET_SSE2 static void swap_red_blue_sse2(const uint8_t* src, uint8_t* dst, size_t count) {
+  // Pixels read as little endian 32 bit words are 0xAABBGGRR
+  const __m128i keep = _mm_set1_epi32(static_cast<int>(0xFF00FF00));
+  const __m128i low = _mm_set1_epi32(0x000000FF);
+
+  size_t i = 0;
+  for (; i + 4 <= count; i += 4) {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i * 4));
+    const __m128i red = _mm_slli_epi32(_mm_and_si128(v, low), 16);
+    const __m128i blue = _mm_and_si128(_mm_srli_epi32(v, 16), low);
+    const __m128i result = _mm_or_si128(_mm_and_si128(v, keep), _mm_or_si128(red, blue));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+  }
+  swap_red_blue_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+TARGET_SSE2 static void expand_to_four_channels_sse2(const uint8_t* src, uint8_t* dst, size_t count) {
+  const __m128i alpha = _mm_set1_epi32(static_cast<int>(0xFF000000));
+
+  // Every pixel is read as a 32 bit word, so the last one would read past the end
+  size_t i = 0;
+  for (; i + 5 <= count; i += 4) {
+    const uint8_t* s = src + i * 3;
+    int32_t words[4];
+    memcpy(&words[0], s, 4);
+    memcpy(&words[1], s + 3, 4);
+    memcpy(&words[2], s + 6, 4);
+    memcpy(&words[3], s + 9, 4);
+    const __m128i v = _mm_setr_epi32(words[0], words[1], words[2], words[3]);
+    const __m128i result = _mm_or_si128(_mm_andnot_si128(alpha, v), alpha);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), result);
+  }
+  expand_to_four_channels_scalar(src + i * 3, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static inline __m256i premultiply_lanes_avx2(__m256i color, __m256i one, __m256i alpha_mask) {
+  const __m256i alpha = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(color, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+  const __m256i scaled = _mm256_srli_epi16(_mm256_mullo_epi16(color, _mm256_add_epi16(alpha, one)), 8);
+  return _mm256_or_si256(_mm256_andnot_si256(alpha_mask, scaled), _mm256_and_si256(alpha_mask, color));
+}
+
+TARGET_AVX2 static void premultiply_alpha_avx2(uint8_t* pixels, size_t count) {
+  const __m256i zero = _mm256_setzero_si256();
+  const __m256i one = _mm256_set1_epi16(1);
+  const __m256i alpha_mask = _mm256_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0, -1, 0, 0, 0);
+
+  // Unpacking and packing both work within 128 bit lanes, so pixels come out in order
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    __m256i* p = reinterpret_cast<__m256i*>(pixels + i * 4);
+    const __m256i v = _mm256_loadu_si256(p);
+    const __m256i lo = premultiply_lanes_avx2(_mm256_unpacklo_epi8(v, zero), one, alpha_mask);
+    const __m256i hi = premultiply_lanes_avx2(_mm256_unpackhi_epi8(v, zero), one, alpha_mask);
+    _mm256_storeu_si256(p, _mm256_packus_epi16(lo, hi));
+  }
+  premultiply_alpha_scalar(pixels + i * 4, count - i);
+}
+
+TARGET_AVX2 static void swap_red_blue_avx2(const uint8_t* src, uint8_t* dst, size_t count) {
+  const __m256i order = _mm256_setr_epi8(
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+    2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15
+  );
+
+  size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i * 4));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), _mm256_shuffle_epi8(v, order));
+  }
+  swap_red_blue_scalar(src + i * 4, dst + i * 4, count - i);
+}
+
+TARGET_AVX2 static void expand_to_four_channels_avx2(const uint8_t* src, uint8_t* dst, size_t count) {
+  // -1 zeroes the byte, the alpha is or'd in after
+  const __m256i order = _mm256_setr_epi8(
+    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1,
+    0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1
+  );
+  const __m256i alpha = _mm256_set1_epi32(static_cast<int>(0xFF000000));
+
+  // Each lane loads 16 bytes for the 12 it uses, so stop while the second lane's load still fits
+  size_t i = 0;
+  for (; i + 10 <= count; i += 8) {
+    const uint8_t* s = src + i * 3;
+    const __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+    const __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + 12));
+    const __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    const __m256i result = _mm256_or_si256(_mm256_shuffle_epi8(v, order), alpha);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i * 4), result);
+  }
+  expand_to_four_channels_scalar(src + i * 3, dst + i * 4, count - i);
+}
+
+#endif /* PIXEL_KERNELS_X86 */
+
+struct KernelSet {
+  void (*premultiply_alpha)(uint8_t* pixels, size_t count);
+  void (*swap_red_blue)(const uint8_t* src, uint8_t* dst, size_t count);
+  void (*expand_to_four_channels)(const uint8_t* src, uint8_t* dst, size_t count);
+};
+
+static const KernelSet KERNELS[PixelKernels::NUM_ISAS] = {
+  { premultiply_alpha_scalar, swap_red_blue_scalar, expand_to_four_channels_scalar },
+#ifdef PIXEL_KERNELS_X86
+  { premultiply_alpha_sse2, swap_red_blue_sse2, expand_to_four_channels_sse2 },
+  { premultiply_alpha_avx2, swap_red_blue_avx2, expand_to_four_channels_avx2 },
+#else
+  { premultiply_alpha_scalar, swap_red_blue_scalar, expand_to_four_channels_scalar },
+  { premultiply_alpha_scalar, swap_red_blue_scalar, expand_to_four_channels_scalar },
+#endif
+};
+
+PixelKernels::Isa PixelKernels::current_isa = PixelKernels::detect_isa();
+
+void PixelKernels::premultiply_alpha(uint8_t* pixels, size_t count) {
+  KERNELS[current_isa].premultiply_alpha(pixels, count);
+}
+
+void PixelKernels::swap_red_blue(const uint8_t* src, uint8_t* dst, size_t count) {
+  KERNELS[current_isa].swap_red_blue(src, dst, count);
+}
+
+void PixelKernels::expand_to_four_channels(const uint8_t* src, uint8_t* dst, size_t count) {
+  KERNELS[current_isa].expand_to_four_channels(src, dst, count);
+}
+
+PixelKernels::Isa PixelKernels::detect_isa() {
+#if !defined(PIXEL_KERNELS_X86)
+  return Scalar;
+#elif defined(_MSC_VER)
+  int info[4];
+  __cpuid(info, 0);
+  const int max_leaf = info[0];
+  __cpuid(info, 1);
+  const bool sse2 = (info[3] & (1 << 26)) != 0;
+  // AVX registers are only usable if the OS saves them on context switches
+  const bool avx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (_xgetbv(0) & 6) == 6;
+  bool avx2 = false;
+  if (avx && max_leaf >= 7) {
+    __cpuidex(info, 7, 0);
+    avx2 = (info[1] & (1 << 5)) != 0;
+  }
+  return avx2 ? Avx2 : sse2 ? Sse2 : Scalar;
+#else
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return Avx2;
+  }
+  return __builtin_cpu_supports("sse2") ? Sse2 : Scalar;
+#endif
+}
+
+bool PixelKernels::set_isa(Isa isa) {
+  if (isa < Scalar || isa > detect_isa()) {
+    return false;
+  }
+  current_isa = isa;
+  return true;
+}
+
+const char* PixelKernels::get_isa_name(Isa isa) {
+  switch (isa) {
+  case Scalar:
+    return "scalar";
+  case Sse2:
+    return "sse2";
+  case Avx2:
+    return "avx2";
+  default:
+    return "unknown";
+  }
+}
+
+bool PixelKernels::run_benchmark() {
+  // A 2048 x 2048 texture atlas, plus a few pixels so the vector loops leave a remainder
+  const size_t count = 2048 * 2048 + 7;
+  const double megapixels = count / 1e6;
+  // Each measurement repeats a kernel for at least this long
+  const double min_seconds = 0.25;
+
+  std::vector<uint8_t> source(count * 4);
+  uint32_t state = 0x12345678;
+  for (size_t i = 0; i < source.size(); i++) {
+    // xorshift, so every run checks the same data
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    source[i] = static_cast<uint8_t>(state);
+  }
+
+  const char* names[3] = { "premultiply", "swap r/b", "rgb->rgba" };
+  std::vector<uint8_t> expected(count * 4);
+  std::vector<uint8_t> actual(count * 4);
+  std::vector<uint8_t> scratch(count * 4);
+  bool exact = true;
+  const Isa best = detect_isa();
+  LAppUtil::print_log("[bench] pixel kernels on %.2f MP, best instruction set %s", megapixels, get_isa_name(best));
+
+  for (int kernel = 0; kernel < 3; kernel++) {
+    for (int isa = Scalar; isa <= best; isa++) {
+      const KernelSet& kernels = KERNELS[isa];
+      std::vector<uint8_t>& output = isa == Scalar ? expected : actual;
+
+      // Correctness first, on fresh input
+      switch (kernel) {
+      case 0:
+        output = source;
+        kernels.premultiply_alpha(output.data(), count);
+        break;
+      case 1:
+        kernels.swap_red_blue(source.data(), output.data(), count);
+        break;
+      default:
+        kernels.expand_to_four_channels(source.data(), output.data(), count);
+        break;
+      }
+      const bool matches = isa == Scalar || memcmp(expected.data(), actual.data(), count * 4) == 0;
+      exact = exact && matches;
+
+      // Premultiplying keeps darkening the same buffer, which costs the same every time
+      scratch = source;
+      int repetitions = 0;
+      const double start = LAppUtil::get_time_seconds();
+      double elapsed = 0.0;
+      while (elapsed < min_seconds || repetitions < 3) {
+        switch (kernel) {
+        case 0:
+          kernels.premultiply_alpha(scratch.data(), count);
+          break;
+        case 1:
+          kernels.swap_red_blue(source.data(), scratch.data(), count);
+          break;
+        default:
+          kernels.expand_to_four_channels(source.data(), scratch.data(), count);
+          break;
+        }
+        repetitions++;
+        elapsed = LAppUtil::get_time_seconds() - start;
+      }
+
+      LAppUtil::print_log("[bench] %-11s %-6s %8.1f MP/s %8.3f ms/MP  %s",
+        names[kernel], get_isa_name(static_cast<Isa>(isa)),
+        megapixels * repetitions / elapsed, elapsed * 1000.0 / (megapixels * repetitions),
+        isa == Scalar ? "reference" : matches ? "bit-exact" : "MISMATCH");
+    }
+  }
+
+  return exact;
+}
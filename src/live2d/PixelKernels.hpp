@@ -0,0 +1,75 @@
+#ifndef LIVE2D_PIXEL_KERNELS_HPP
+#define LIVE2D_PIXEL_KERNELS_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Per-pixel conversions over 8 bit channels, picked at runtime for the best instruction set available
+ *
+ * Every implementation gives bit-identical results to the scalar one, so
+ * the instruction set in use never changes what ends up on screen.
+ */
+class PixelKernels {
+public:
+  enum Isa {
+    Scalar,
+    Sse2,
+    Avx2,
+    NUM_ISAS
+  };
+
+  /**
+   * @brief Scale the color channels of RGBA (or BGRA) pixels by their alpha, in place
+   *
+   * Matches TextureManager::premultiply: c * (a + 1) >> 8, alpha is kept.
+   *
+   * @param[in,out] pixels
+   * @param[in] count Number of pixels
+   */
+  static void premultiply_alpha(uint8_t* pixels, size_t count);
+
+  /**
+   * @brief Swap the first and third channel of 4 channel pixels, RGBA <-> BGRA
+   *
+   * @param[in] src
+   * @param[out] dst May be the same as src
+   * @param[in] count Number of pixels
+   */
+  static void swap_red_blue(const uint8_t* src, uint8_t* dst, size_t count);
+
+  /**
+   * @brief Add an opaque alpha channel to 3 channel pixels, RGB -> RGBA or BGR -> BGRA
+   *
+   * @param[in] src
+   * @param[out] dst Must not overlap src
+   * @param[in] count Number of pixels
+   */
+  static void expand_to_four_channels(const uint8_t* src, uint8_t* dst, size_t count);
+
+  /**
+   * @brief Best instruction set the CPU supports
+   */
+  static Isa detect_isa();
+
+  /**
+   * @brief Use a specific instruction set from now on, not thread safe
+   *
+   * @return false if the CPU doesn't support it, in which case nothing changes
+   */
+  static bool set_isa(Isa isa);
+  static Isa get_isa() { return current_isa; }
+  static const char* get_isa_name(Isa isa);
+
+  /**
+   * @brief Check every implementation against the scalar one and print their throughput
+   *
+   * @return true iff all results were bit-exact
+   */
+  static bool run_benchmark();
+
+private:
+  static Isa current_isa;
+};
+
+#endif /* LIVE2D_PIXEL_KERNELS_HPP */
@@ -0,0 +1,279 @@
+#include "Recorder.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <string.h>
+#include <opencv2/imgproc.hpp>
+
+#include "Util.hpp"
+
+static bool ends_with(const std::string& str, const char* suffix) {
+  const size_t length = strlen(suffix);
+  return str.size() >= length && str.compare(str.size() - length, length, suffix) == 0;
+}
+
+Recorder::Recorder() :
+  _running(false)
+{
+  // Pass
+}
+
+Recorder::~Recorder() {
+  release();
+}
+
+bool Recorder::initialize(const std::string& path, double fps, int queue_size,
+                          const std::string& camera_path, double camera_fps) {
+  release();
+
+  if (fps <= 0.0 || queue_size < 1) {
+    LAppUtil::print_log("Error: invalid recording of %f fps with a queue of %d frames", fps, queue_size);
+    return false;
+  }
+
+  if (!open_stream(_output, path, fps, queue_size)) {
+    return false;
+  }
+  if (!camera_path.empty() && !open_stream(_camera, camera_path, camera_fps > 0.0 ? camera_fps : fps, queue_size)) {
+    close_stream(_output, "recording");
+    return false;
+  }
+
+  _running.store(true);
+  _thread = std::thread(&Recorder::run, this);
+  return true;
+}
+
+bool Recorder::open_stream(Stream& stream, const std::string& path, double fps, int queue_size) {
+  std::string index_path = path + ".frames.csv";
+  stream.index_file = fopen(index_path.c_str(), "w");
+  if (stream.index_file == NULL) {
+    LAppUtil::print_log("Error: could not open recording index %s", index_path.c_str());
+    return false;
+  }
+  fprintf(stream.index_file, "index,frame_id,timestamp\n");
+
+  stream.path = path;
+  stream.fps = fps;
+  stream.y4m = ends_with(path, ".y4m");
+  stream.queue.clear();
+  stream.queue.resize(queue_size);
+  stream.head.store(0);
+  stream.tail.store(0);
+  stream.width = 0;
+  stream.height = 0;
+  stream.written = 0;
+  stream.dropped.store(0);
+  stream.skipped = 0;
+  stream.active = true;
+
+  LAppUtil::print_log("[APP] recording to %s (%s, %.2f fps)", path.c_str(), stream.y4m ? "y4m" : "VideoWriter", fps);
+  return true;
+}
+
+void Recorder::release() {
+  if (_thread.joinable()) {
+    // The worker drains both queues before it exits
+    _running.store(false);
+    _wake.notify_one();
+    _thread.join();
+  }
+
+  close_stream(_output, "recording");
+  close_stream(_camera, "camera recording");
+}
+
+void Recorder::close_stream(Stream& stream, const char* label) {
+  if (!stream.active) {
+    return;
+  }
+
+  if (stream.writer.isOpened()) {
+    stream.writer.release();
+  }
+  if (stream.raw_file != NULL) {
+    fclose(stream.raw_file);
+    stream.raw_file = NULL;
+  }
+  if (stream.index_file != NULL) {
+    fclose(stream.index_file);
+    stream.index_file = NULL;
+  }
+
+  LAppUtil::print_log("[APP] %s %s: %llu frames written, %llu dropped, %llu skipped after a size change",
+    label, stream.path.c_str(), stream.written, stream.dropped.load(), stream.skipped);
+
+  stream.queue.clear();
+  stream.active = false;
+}
+
+Recorder::QueuedFrame* Recorder::begin_push(Stream& stream) {
+  if (!stream.active) {
+    return NULL;
+  }
+
+  const unsigned int tail = stream.tail.load(std::memory_order_relaxed);
+  const unsigned int head = stream.head.load(std::memory_order_acquire);
+  if (tail - head >= stream.queue.size()) {
+    stream.dropped.fetch_add(1, std::memory_order_relaxed);
+    return NULL;
+  }
+  return &stream.queue[tail % stream.queue.size()];
+}
+
+void Recorder::end_push(Stream& stream) {
+  stream.tail.fetch_add(1, std::memory_order_release);
+  _wake.notify_one();
+}
+
+void Recorder::consume(const ReadbackFrame& frame) {
+  QueuedFrame* slot = begin_push(_output);
+  if (slot == NULL) {
+    return;
+  }
+
+  slot->frame_id = frame.frame_id;
+  slot->timestamp = frame.timestamp;
+  slot->width = frame.width;
+  slot->height = frame.height;
+  slot->stride = frame.stride;
+  slot->type = CV_8UC4;
+  slot->bottom_up = true;
+  // Slots keep their buffers, so this only allocates while the queue first fills or the window grows
+  slot->data.resize(frame.size);
+  memcpy(slot->data.data(), frame.data, frame.size);
+
+  end_push(_output);
+}
+
+void Recorder::consume_camera(const cv::Mat& frame, unsigned long long frame_id, double timestamp) {
+  if (frame.empty() || frame.type() != CV_8UC3) {
+    return;
+  }
+  QueuedFrame* slot = begin_push(_camera);
+  if (slot == NULL) {
+    return;
+  }
+
+  const size_t row_size = frame.cols * frame.elemSize();
+  slot->frame_id = frame_id;
+  slot->timestamp = timestamp;
+  slot->width = frame.cols;
+  slot->height = frame.rows;
+  slot->stride = static_cast<int>(row_size);
+  slot->type = CV_8UC3;
+  slot->bottom_up = false;
+  slot->data.resize(row_size * frame.rows);
+  if (frame.isContinuous()) {
+    memcpy(slot->data.data(), frame.data, slot->data.size());
+  }
+  else {
+    for (int y = 0; y < frame.rows; y++) {
+      memcpy(slot->data.data() + row_size * y, frame.ptr(y), row_size);
+    }
+  }
+
+  end_push(_camera);
+}
+
+void Recorder::run() {
+  while (true) {
+    // Checked before draining so anything queued before release() still gets written
+    const bool running = _running.load();
+
+    bool worked = drain(_output);
+    worked = drain(_camera) || worked;
+
+    if (!running) {
+      break;
+    }
+    if (!worked) {
+      // Producers notify without taking the lock, the timeout covers a missed wakeup
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait_for(lock, std::chrono::milliseconds(10));
+    }
+  }
+}
+
+bool Recorder::drain(Stream& stream) {
+  if (!stream.active) {
+    return false;
+  }
+
+  bool worked = false;
+  unsigned int head = stream.head.load(std::memory_order_relaxed);
+  while (head != stream.tail.load(std::memory_order_acquire)) {
+    write_frame(stream, stream.queue[head % stream.queue.size()]);
+    head++;
+    stream.head.store(head, std::memory_order_release);
+    worked = true;
+  }
+  return worked;
+}
+
+bool Recorder::open_writer(Stream& stream, int width, int height) {
+  stream.width = width;
+  stream.height = height;
+
+  if (stream.y4m) {
+    stream.raw_file = fopen(stream.path.c_str(), "wb");
+    if (stream.raw_file == NULL) {
+      LAppUtil::print_log("Error: could not open %s for writing", stream.path.c_str());
+      return false;
+    }
+    // OpenCV's YCrCb conversion is full range, which y4m readers assume isn't the case unless told
+    const long long rate = llround(stream.fps * 1000.0);
+    fprintf(stream.raw_file, "YUV4MPEG2 W%d H%d F%lld:1000 Ip A1:1 C444 XCOLORRANGE=FULL\n", width, height, rate);
+    return true;
+  }
+
+  const int fourcc = ends_with(stream.path, ".mp4")
+    ? cv::VideoWriter::fourcc('m', 'p', '4', 'v')
+    : cv::VideoWriter::fourcc('M', 'J', 'P', 'G');
+  if (!stream.writer.open(stream.path, fourcc, stream.fps, cv::Size(width, height))) {
+    LAppUtil::print_log("Error: could not open video writer for %s", stream.path.c_str());
+    return false;
+  }
+  return true;
+}
+
+void Recorder::write_frame(Stream& stream, QueuedFrame& frame) {
+  if (stream.width == 0) {
+    if (!open_writer(stream, frame.width, frame.height)) {
+      // Nothing more can be written, keep emptying the queue so producers don't count drops
+      stream.width = -1;
+    }
+  }
+  if (frame.width != stream.width || frame.height != stream.height) {
+    stream.skipped++;
+    return;
+  }
+
+  cv::Mat pixels(frame.height, frame.width, frame.type, frame.data.data(), frame.stride);
+  if (frame.type == CV_8UC4) {
+    cv::cvtColor(pixels, stream.scratch, cv::COLOR_BGRA2BGR);
+  }
+  else {
+    pixels.copyTo(stream.scratch);
+  }
+  if (frame.bottom_up) {
+    cv::flip(stream.scratch, stream.scratch, 0);
+  }
+
+  if (stream.y4m) {
+    cv::cvtColor(stream.scratch, stream.scratch, cv::COLOR_BGR2YCrCb);
+    cv::split(stream.scratch, stream.planes);
+    const size_t plane_size = static_cast<size_t>(frame.width) * frame.height;
+    fputs("FRAME\n", stream.raw_file);
+    // Planes go Y, Cb, Cr
+    fwrite(stream.planes[0].data, 1, plane_size, stream.raw_file);
+    fwrite(stream.planes[2].data, 1, plane_size, stream.raw_file);
+    fwrite(stream.planes[1].data, 1, plane_size, stream.raw_file);
+  }
+  else {
+    stream.writer.write(stream.scratch);
+  }
+
+  fprintf(stream.index_file, "%llu,%llu,%.6f\n", stream.written, frame.frame_id, frame.timestamp);
+  stream.written++;
+}
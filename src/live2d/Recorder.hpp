@@ -0,0 +1,142 @@
+#ifndef LIVE2D_RECORDER_HPP
+#define LIVE2D_RECORDER_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "FrameReadback.hpp"
+
+/**
+ * @brief Records rendered frames (and optionally the raw camera feed) to disk
+ *
+ * Frames are copied into a bounded queue and encoded on a background thread.
+ * When the encoder falls behind and the queue is full, new frames are dropped
+ * and counted; the producers never wait on the encoder.
+ *
+ * Next to each recording, `<path>.frames.csv` lists the render frame ID and
+ * timestamp of every written frame, which is how the camera recording is
+ * lined up with the rendered one.
+ */
+class Recorder : public FrameSink {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  Recorder();
+  ~Recorder();
+
+  /**
+   * @brief Start recording rendered frames
+   *
+   * Paths ending in ".y4m" are written as uncompressed 4:4:4 YUV4MPEG2,
+   * anything else goes through cv::VideoWriter.
+   *
+   * @param[in] path
+   * @param[in] fps Frame rate written into the file
+   * @param[in] queue_size Frames that can wait for the encoder before new ones are dropped
+   * @param[in] camera_path If set, the raw camera feed is recorded into this file too
+   * @param[in] camera_fps Frame rate of the camera recording
+   * @return true iff the recording thread is running
+   */
+  bool initialize(const std::string& path, double fps, int queue_size,
+                  const std::string& camera_path = std::string(), double camera_fps = 0.0);
+
+  /**
+   * @brief Encode what's still queued, close the files and stop the thread
+   */
+  void release();
+
+  /**
+   * @brief Queue a rendered frame, called from the render thread
+   */
+  virtual void consume(const ReadbackFrame& frame);
+
+  /**
+   * @brief Queue a camera frame, called from the capture thread
+   *
+   * @param[in] frame A BGR camera frame
+   * @param[in] frame_id The render frame current when the camera frame was captured
+   * @param[in] timestamp
+   */
+  void consume_camera(const cv::Mat& frame, unsigned long long frame_id, double timestamp);
+
+private:
+  struct QueuedFrame {
+    unsigned long long frame_id = 0;
+    double timestamp = 0.0;
+    int width = 0;
+    int height = 0;
+    int stride = 0;
+    int type = 0; ///< OpenCV type of the pixels
+    bool bottom_up = false;
+    std::vector<unsigned char> data;
+  };
+
+  /**
+   * @brief One output file fed by a single producer thread
+   *
+   * The queue is a single-producer/single-consumer ring, buffers are reused
+   * so a steady-state push only copies pixels.
+   */
+  struct Stream {
+    std::string path;
+    double fps = 0.0;
+    bool y4m = false;
+    bool active = false;
+
+    std::vector<QueuedFrame> queue;
+    std::atomic<unsigned int> head; ///< Next frame for the encoder
+    std::atomic<unsigned int> tail; ///< Next free slot for the producer
+
+    cv::VideoWriter writer;
+    FILE* raw_file = NULL;
+    FILE* index_file = NULL;
+    int width = 0;
+    int height = 0;
+    cv::Mat scratch;
+    cv::Mat planes[3];
+
+    unsigned long long written = 0;
+    std::atomic<unsigned long long> dropped;
+    unsigned long long skipped = 0;
+
+    Stream() : head(0), tail(0), dropped(0) {}
+  };
+
+  bool open_stream(Stream& stream, const std::string& path, double fps, int queue_size);
+  void close_stream(Stream& stream, const char* label);
+
+  /**
+   * @brief Claim the next free queue slot, or NULL if the queue is full
+   */
+  QueuedFrame* begin_push(Stream& stream);
+  void end_push(Stream& stream);
+
+  /**
+   * @brief Encode everything currently queued on a stream
+   *
+   * @return true iff at least one frame was handled
+   */
+  bool drain(Stream& stream);
+  bool open_writer(Stream& stream, int width, int height);
+  void write_frame(Stream& stream, QueuedFrame& frame);
+
+  void run();
+
+  Stream _output;
+  Stream _camera;
+
+  std::thread _thread;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::atomic<bool> _running;
+};
+
+#endif /* LIVE2D_RECORDER_HPP */
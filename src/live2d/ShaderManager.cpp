@@ -1,8 +1,15 @@
 #include "ShaderManager.hpp"
 
+#include <stdio.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "Definitions.hpp"
+#include "Util.hpp"
+
 GLuint ShaderManager::create_shader()
 {
-  GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
   const char* vertexShader =
     "#version 330 core\n"
     "layout(location = 0) in vec3 position;"
@@ -12,13 +19,6 @@ GLuint ShaderManager::create_shader()
     "    gl_Position = vec4(position, 1);"
     "    UV = vertexUV;"
     "}";
-  glShaderSource(vertexShaderId, 1, &vertexShader, NULL);
-  glCompileShader(vertexShaderId);
-  if (!check_shader(vertexShaderId)) {
-    return 0;
-  }
-
-  GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
   const char* fragmentShader =
     "#version 330 core\n"
     "in vec2 UV;"
@@ -28,15 +28,69 @@ GLuint ShaderManager::create_shader()
     "void main(){"
     "    color = baseColor * texture(myTexture, UV).rgba;"
     "}";
-  glShaderSource(fragmentShaderId, 1, &fragmentShader, NULL);
+
+  GLuint programId = create_program(vertexShader, fragmentShader);
+  if (programId != 0) {
+    glUseProgram(programId);
+  }
+  return programId;
+}
+
+GLuint ShaderManager::create_program(const char* vertex_source, const char* fragment_source) {
+  const uint64_t key = program_key(vertex_source, fragment_source);
+  for (Csm::csmUint32 i = 0; i < _programKeys.GetSize(); i++) {
+    if (_programKeys[i] == key) {
+      return _programs[i];
+    }
+  }
+
+  if (_binaryCacheSupported < 0) {
+    GLint formats = 0;
+    if (GLEW_ARB_get_program_binary) {
+      glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    }
+    _binaryCacheSupported = formats > 0 ? 1 : 0;
+  }
+
+  GLuint programId = _binaryCacheSupported ? load_cached_program(key) : 0;
+  if (programId == 0) {
+    programId = compile_program(vertex_source, fragment_source);
+    if (programId == 0) {
+      return 0;
+    }
+    if (_binaryCacheSupported) {
+      save_cached_program(programId, key);
+    }
+  }
+
+  _programs.PushBack(programId);
+  _programKeys.PushBack(key);
+  return programId;
+}
+
+GLuint ShaderManager::compile_program(const char* vertex_source, const char* fragment_source) {
+  GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(vertexShaderId, 1, &vertex_source, NULL);
+  glCompileShader(vertexShaderId);
+  if (!check_shader(vertexShaderId)) {
+    return 0;
+  }
+
+  GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(fragmentShaderId, 1, &fragment_source, NULL);
   glCompileShader(fragmentShaderId);
   if (!check_shader(fragmentShaderId)) {
+    glDeleteShader(vertexShaderId);
     return 0;
   }
 
   GLuint programId = glCreateProgram();
   glAttachShader(programId, vertexShaderId);
   glAttachShader(programId, fragmentShaderId);
+  if (_binaryCacheSupported > 0) {
+    // Some drivers only keep the binary around when asked to before linking
+    glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+  }
 
   glLinkProgram(programId);
   // It's safe to delete these shaders once they have been linked
@@ -47,12 +101,134 @@ GLuint ShaderManager::create_shader()
     return 0;
   }
 
-  glUseProgram(programId);
-  _programs.PushBack(programId);
+  return programId;
+}
+
+static uint64_t fnv1a(uint64_t hash, const char* str) {
+  if (str == NULL) {
+    str = "";
+  }
+  // The terminator is hashed too, so ("ab", "c") and ("a", "bc") differ
+  do {
+    hash ^= static_cast<unsigned char>(*str);
+    hash *= 0x100000001b3ULL;
+  } while (*str++ != '\0');
+  return hash;
+}
+
+uint64_t ShaderManager::program_key(const char* vertex_source, const char* fragment_source) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  hash = fnv1a(hash, vertex_source);
+  hash = fnv1a(hash, fragment_source);
+  // A binary is only valid for the driver that produced it
+  hash = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+  hash = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+  hash = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+  return hash;
+}
+
+/**
+ * Layout of a cached program file
+ */
+struct ProgramBinaryHeader {
+  static const uint32_t MAGIC = 0x42505346; ///< "FSPB"
+  static const uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint64_t key;
+  uint32_t format; ///< Driver specific binary format
+  uint32_t length;
+};
+
+static std::string cached_program_path(uint64_t key) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+  return std::string(LAppDefinitions::ShaderCachePath) + name;
+}
+
+GLuint ShaderManager::load_cached_program(uint64_t key) {
+  const std::string path = cached_program_path(key);
+  FILE* file = fopen(path.c_str(), "rb");
+  if (file == NULL) {
+    return 0;
+  }
+
+  ProgramBinaryHeader header;
+  std::vector<char> binary;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+    header.magic == ProgramBinaryHeader::MAGIC &&
+    header.version == ProgramBinaryHeader::VERSION &&
+    header.key == key &&
+    header.length > 0;
+  if (valid) {
+    binary.resize(header.length);
+    valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+  }
+  fclose(file);
+
+  if (!valid) {
+    LAppUtil::print_log("[APP] discarding malformed shader cache %s", path.c_str());
+    std::remove(path.c_str());
+    return 0;
+  }
+
+  GLuint programId = glCreateProgram();
+  glProgramBinary(programId, header.format, binary.data(), header.length);
+  GLint status = GL_FALSE;
+  glGetProgramiv(programId, GL_LINK_STATUS, &status);
+  if (status == GL_FALSE) {
+    // Usually a driver update, compiling again replaces the file
+    LAppUtil::print_log("[APP] driver rejected shader cache %s, recompiling", path.c_str());
+    glDeleteProgram(programId);
+    std::remove(path.c_str());
+    return 0;
+  }
 
   return programId;
 }
 
+void ShaderManager::save_cached_program(GLuint programId, uint64_t key) {
+  GLint length = 0;
+  glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+  if (length <= 0) {
+    return;
+  }
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  glGetProgramBinary(programId, length, &length, &format, binary.data());
+
+  std::error_code error;
+  std::filesystem::create_directories(LAppDefinitions::ShaderCachePath, error);
+
+  // Written under a temporary name so a crash never leaves a truncated cache behind
+  const std::string path = cached_program_path(key);
+  const std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == NULL) {
+    LAppUtil::print_log("[APP] could not write shader cache %s", temp_path.c_str());
+    return;
+  }
+
+  ProgramBinaryHeader header;
+  header.magic = ProgramBinaryHeader::MAGIC;
+  header.version = ProgramBinaryHeader::VERSION;
+  header.key = key;
+  header.format = format;
+  header.length = static_cast<uint32_t>(length);
+  const bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(binary.data(), 1, length, file) == static_cast<size_t>(length);
+  fclose(file);
+
+  if (written) {
+    std::filesystem::rename(temp_path, path, error);
+  }
+  if (!written || error) {
+    std::remove(temp_path.c_str());
+  }
+}
+
 bool ShaderManager::check_shader(GLuint shaderId)
 {
   GLint status;
@@ -94,7 +270,9 @@ bool ShaderManager::check_program(GLuint programId) {
 }
 
 ShaderManager::ShaderManager()
-  : _programs()
+  : _programs(),
+  _programKeys(),
+  _binaryCacheSupported(-1)
 {
   // Pass
 }
@@ -109,4 +287,5 @@ void ShaderManager::release_shaders() {
   }
 
   _programs.Clear();
+  _programKeys.Clear();
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #ifndef LIVE2D_SHADER_MANAGER
 #define LIVE2D_SHADER_MANAGER
 
+#include <stdint.h>
 #include <gl/glew.h>
 #include <CubismFramework.hpp>
 #include <Type/csmVector.hpp>
@@ -17,9 +18,24 @@ public:
   ~ShaderManager();
 
   /**
-   * @brief Creates a new shader
+   * @brief Creates the program used to draw sprites
    */
   GLuint create_shader();
+
+  /**
+   * @brief Get a linked program for the given sources
+   *
+   * Identical sources share one program. Linked programs are saved as driver
+   * binaries under LAppDefinitions::ShaderCachePath and reloaded from there on
+   * later runs, falling back to compiling when the binary is missing or the
+   * driver rejects it.
+   *
+   * @param[in] vertex_source
+   * @param[in] fragment_source
+   * @return The program id, or 0 if compiling failed
+   */
+  GLuint create_program(const char* vertex_source, const char* fragment_source);
+
   /**
    * @brief Releases all shaders created by this instance
    */
@@ -28,7 +44,18 @@ public:
 private:
   bool check_shader(GLuint shaderId);
   bool check_program(GLuint programId);
+
+  /**
+   * @brief Hash of the sources and the driver that would compile them
+   */
+  uint64_t program_key(const char* vertex_source, const char* fragment_source);
+  GLuint compile_program(const char* vertex_source, const char* fragment_source);
+  GLuint load_cached_program(uint64_t key);
+  void save_cached_program(GLuint programId, uint64_t key);
+
   Csm::csmVector<GLuint> _programs;
+  Csm::csmVector<uint64_t> _programKeys; ///< Key of each program in _programs
+  int _binaryCacheSupported; ///< -1 until checked
 };
 
 #endif /* LIVE2D_SHADER_MANAGER */
\ No newline at end of file
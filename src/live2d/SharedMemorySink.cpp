@@ -0,0 +1,188 @@
+#include "SharedMemorySink.hpp"
+
+#include <string.h>
+#include <new>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Util.hpp"
+
+static const size_t SLOT_ALIGNMENT = 64;
+
+static size_t align_up(size_t value, size_t alignment) {
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+SharedMemorySink::SharedMemorySink() :
+  _memory(NULL),
+  _size(0),
+  _header(NULL),
+  _nextSlot(0),
+  _publishedFrames(0),
+  _skippedFrames(0),
+#ifdef _WIN32
+  _mapping(NULL)
+#else
+  _fd(-1)
+#endif
+{
+  // Pass
+}
+
+SharedMemorySink::~SharedMemorySink() {
+  release();
+}
+
+bool SharedMemorySink::initialize(const std::string& name, int slot_count, int max_width, int max_height) {
+  release();
+
+  if (slot_count < 2 || max_width <= 0 || max_height <= 0) {
+    LAppUtil::print_log("Error: invalid shared memory ring of %d slots for %d x %d frames", slot_count, max_width, max_height);
+    return false;
+  }
+
+  const size_t capacity = align_up(static_cast<size_t>(max_width) * max_height * 4, SLOT_ALIGNMENT);
+  const size_t slot_stride = sizeof(SharedFrameSlot) + capacity;
+  const size_t header_size = align_up(sizeof(SharedFrameHeader), SLOT_ALIGNMENT);
+  const size_t size = header_size + slot_stride * slot_count;
+
+#ifdef _WIN32
+  _name = name;
+  HANDLE mapping = CreateFileMappingA(
+    INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+    static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32),
+    static_cast<DWORD>(size & 0xFFFFFFFF),
+    _name.c_str()
+  );
+  if (mapping == NULL) {
+    LAppUtil::print_log("Error creating shared memory %s: %lu", _name.c_str(), GetLastError());
+    return false;
+  }
+  _mapping = mapping;
+
+  void* memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (memory == NULL) {
+    LAppUtil::print_log("Error mapping shared memory %s: %lu", _name.c_str(), GetLastError());
+    release();
+    return false;
+  }
+#else
+  // POSIX names need exactly one leading slash
+  _name = name[0] == '/' ? name : "/" + name;
+  _fd = shm_open(_name.c_str(), O_CREAT | O_RDWR, 0600);
+  if (_fd < 0) {
+    LAppUtil::print_log("Error creating shared memory %s", _name.c_str());
+    return false;
+  }
+  if (ftruncate(_fd, static_cast<off_t>(size)) != 0) {
+    LAppUtil::print_log("Error sizing shared memory %s to %zu bytes", _name.c_str(), size);
+    release();
+    return false;
+  }
+
+  void* memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+  if (memory == MAP_FAILED) {
+    LAppUtil::print_log("Error mapping shared memory %s", _name.c_str());
+    release();
+    return false;
+  }
+#endif
+
+  _memory = static_cast<uint8_t*>(memory);
+  _size = size;
+
+  // Slots go first so a reader never sees a valid magic with garbage slots
+  for (int i = 0; i < slot_count; i++) {
+    SharedFrameSlot* slot = new (_memory + header_size + slot_stride * i) SharedFrameSlot();
+    slot->sequence.store(0, std::memory_order_relaxed);
+    slot->format = SharedFrameSlot::FORMAT_BGRA8;
+  }
+
+  _header = new (_memory) SharedFrameHeader();
+  _header->version = SharedFrameHeader::VERSION;
+  _header->header_size = static_cast<uint32_t>(header_size);
+  _header->slot_count = static_cast<uint32_t>(slot_count);
+  _header->slot_stride = slot_stride;
+  _header->slot_capacity = capacity;
+  _header->latest_slot.store(0, std::memory_order_relaxed);
+  _header->latest_frame_id.store(0, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _header->magic = SharedFrameHeader::MAGIC;
+
+  _nextSlot = 0;
+  LAppUtil::print_log("[APP] publishing frames to shared memory %s (%d slots, %zu bytes)", _name.c_str(), slot_count, size);
+  return true;
+}
+
+void SharedMemorySink::release() {
+#ifdef _WIN32
+  if (_memory != NULL) {
+    UnmapViewOfFile(_memory);
+  }
+  if (_mapping != NULL) {
+    CloseHandle(static_cast<HANDLE>(_mapping));
+    _mapping = NULL;
+  }
+#else
+  if (_memory != NULL) {
+    munmap(_memory, _size);
+  }
+  if (_fd >= 0) {
+    close(_fd);
+    shm_unlink(_name.c_str());
+    _fd = -1;
+  }
+#endif
+
+  _memory = NULL;
+  _header = NULL;
+  _size = 0;
+}
+
+void SharedMemorySink::consume(const ReadbackFrame& frame) {
+  if (_header == NULL) {
+    return;
+  }
+  if (frame.size > _header->slot_capacity) {
+    // Bigger than the ring was sized for, consumers couldn't read it anyway
+    if (_skippedFrames == 0) {
+      LAppUtil::print_log("[APP] skipping %d x %d frames, too big for shared memory %s", frame.width, frame.height, _name.c_str());
+    }
+    _skippedFrames++;
+    return;
+  }
+
+  const uint32_t slot_index = _nextSlot;
+  _nextSlot = (_nextSlot + 1) % _header->slot_count;
+
+  uint8_t* slot_base = _memory + _header->header_size + _header->slot_stride * slot_index;
+  SharedFrameSlot* slot = reinterpret_cast<SharedFrameSlot*>(slot_base);
+
+  // Odd sequence: readers back off until the slot is complete again
+  const uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  slot->format = SharedFrameSlot::FORMAT_BGRA8;
+  slot->flags = SharedFrameSlot::FLAG_BOTTOM_UP;
+  slot->width = static_cast<uint32_t>(frame.width);
+  slot->height = static_cast<uint32_t>(frame.height);
+  slot->stride = static_cast<uint32_t>(frame.stride);
+  slot->frame_id = frame.frame_id;
+  slot->timestamp_ns = static_cast<uint64_t>(frame.timestamp * 1e9);
+  slot->size = frame.size;
+  memcpy(slot_base + sizeof(SharedFrameSlot), frame.data, frame.size);
+
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+
+  _header->latest_slot.store(slot_index, std::memory_order_relaxed);
+  _header->latest_frame_id.store(frame.frame_id, std::memory_order_release);
+  _publishedFrames++;
+}
@@ -0,0 +1,110 @@
+#ifndef LIVE2D_SHARED_MEMORY_SINK_HPP
+#define LIVE2D_SHARED_MEMORY_SINK_HPP
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+#include "FrameReadback.hpp"
+
+/**
+ * Layout of the shared memory region, for consumers in other processes:
+ *
+ *   SharedFrameHeader
+ *   slot_count x [SharedFrameSlot, slot_capacity bytes of pixels]   (each slot is slot_stride bytes)
+ *
+ * Slots are written round robin and each one is protected by a sequence lock:
+ * `sequence` is odd while the producer is writing. A reader copies a slot and
+ * keeps the copy only if `sequence` was even and unchanged before and after.
+ * `latest_slot`/`latest_frame_id` point at the most recently completed frame.
+ */
+struct SharedFrameHeader {
+  static const uint32_t MAGIC = 0x4D485346; ///< "FSHM"
+  static const uint32_t VERSION = 1;
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;   ///< sizeof(SharedFrameHeader)
+  uint32_t slot_count;
+  uint64_t slot_stride;   ///< Bytes from one SharedFrameSlot to the next
+  uint64_t slot_capacity; ///< Bytes of pixel data following each SharedFrameSlot
+  std::atomic<uint32_t> latest_slot;
+  uint32_t reserved;
+  std::atomic<uint64_t> latest_frame_id;
+};
+
+struct SharedFrameSlot {
+  enum Format : uint32_t {
+    FORMAT_BGRA8 = 1,
+  };
+  enum Flags : uint32_t {
+    FLAG_BOTTOM_UP = 1, ///< First row of the data is the bottom of the image
+  };
+
+  std::atomic<uint32_t> sequence;
+  uint32_t format;
+  uint32_t flags;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint64_t frame_id;
+  uint64_t timestamp_ns; ///< SDL_GetPerformanceCounter in nanoseconds, the same clock as LAppUtil::get_time_seconds
+  uint64_t size;
+  uint8_t padding[16]; ///< Keeps the pixel data 64 byte aligned
+};
+
+static_assert(sizeof(SharedFrameSlot) == 64, "SharedFrameSlot must stay 64 bytes");
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "Shared memory atomics must be lock free");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared memory atomics must be lock free");
+
+/**
+ * @brief Publishes rendered frames into a named shared memory ring buffer
+ *
+ * The only CPU copy is the one from the mapped readback buffer into the ring.
+ */
+class SharedMemorySink : public FrameSink {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  SharedMemorySink();
+  ~SharedMemorySink();
+
+  /**
+   * @brief Create (or replace) the shared memory region
+   *
+   * @param[in] name Name of the region, e.g. "facestuff"
+   * @param[in] slot_count Number of frames kept in the ring
+   * @param[in] max_width Widest frame that will fit
+   * @param[in] max_height Tallest frame that will fit
+   * @return true iff the region is mapped and ready
+   */
+  bool initialize(const std::string& name, int slot_count, int max_width, int max_height);
+
+  /**
+   * @brief Unmap and remove the shared memory region
+   */
+  void release();
+
+  virtual void consume(const ReadbackFrame& frame);
+
+  unsigned long long get_published_frames() const { return _publishedFrames; }
+  unsigned long long get_skipped_frames() const { return _skippedFrames; }
+
+private:
+  std::string _name;
+  uint8_t* _memory;
+  size_t _size;
+  SharedFrameHeader* _header;
+  uint32_t _nextSlot;
+  unsigned long long _publishedFrames;
+  unsigned long long _skippedFrames;
+
+#ifdef _WIN32
+  void* _mapping; ///< HANDLE
+#else
+  int _fd;
+#endif
+};
+
+#endif /* LIVE2D_SHARED_MEMORY_SINK_HPP */
@@ -1,6 +1,7 @@
 #include "Sprite.hpp"
 #include "Definitions.hpp"
 #include "Util.hpp"
+#include "Logger.hpp"
 
 Sprite::Sprite(GLuint texture_id, GLuint program_id) :
   _rect(),
@@ -73,7 +74,7 @@ bool Sprite::render_immediate(SDL_Window* window, SDL_Rect area, GLuint texture_
     _rect.right / half_width, _rect.bottom / half_height,
   };
 
-  fprintf(stderr, "(%f, %f), (%f, %f), (%f, %f), (%f, %f)\n", position_vertex[0], position_vertex[1], position_vertex[2], position_vertex[3], position_vertex[4], position_vertex[5], position_vertex[6], position_vertex[7]);
+  APP_LOG_VERBOSE("(%f, %f), (%f, %f), (%f, %f), (%f, %f)", position_vertex[0], position_vertex[1], position_vertex[2], position_vertex[3], position_vertex[4], position_vertex[5], position_vertex[6], position_vertex[7]);
 
   // Set the vertex paramaters from our computations
   glVertexAttribPointer(_positionLocation, 2, GL_FLOAT, GL_FALSE, 0, position_vertex);
@@ -83,7 +84,7 @@ bool Sprite::render_immediate(SDL_Window* window, SDL_Rect area, GLuint texture_
   // Set up properties for the texture
   glUniform1i(_textureLocation, 0);
   glActiveTexture(GL_TEXTURE0 + 0);
-  glBindTexture(GL_TEXTURE_2D, _textureId);
+  glBindTexture(GL_TEXTURE_2D, texture_id);
 
   // Finally, draw the texture
   glDrawArrays(GL_TRIANGLE_FAN, 0, 4);
@@ -0,0 +1,124 @@
+#include "StartupProfiler.hpp"
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Util.hpp"
+
+struct Phase {
+  const char* name;
+  std::string detail;
+  int depth;
+  double start; ///< Seconds since StartupProfiler::start
+  double duration; ///< Negative while still running
+};
+
+static std::mutex phases_mutex;
+static std::vector<Phase> phases;
+static std::atomic<bool> recording{ false };
+static std::thread::id startup_thread;
+static double start_time = 0.0;
+static double finish_time = 0.0;
+static int depth = 0; ///< Scopes open, only touched from startup_thread
+
+StartupProfiler::Scope::Scope(const char* name, const std::string& detail) :
+  _phase(-1)
+{
+  if (!recording.load(std::memory_order_relaxed) || std::this_thread::get_id() != startup_thread) {
+    return;
+  }
+
+  Phase phase = { name, detail, depth, LAppUtil::get_time_seconds() - start_time, -1.0 };
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  _phase = static_cast<int>(phases.size());
+  phases.push_back(phase);
+  depth++;
+}
+
+StartupProfiler::Scope::~Scope() {
+  if (_phase < 0) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  phases[_phase].duration = LAppUtil::get_time_seconds() - start_time - phases[_phase].start;
+  depth--;
+}
+
+void StartupProfiler::start() {
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  phases.clear();
+  depth = 0;
+  startup_thread = std::this_thread::get_id();
+  start_time = LAppUtil::get_time_seconds();
+  finish_time = start_time;
+  recording.store(true);
+}
+
+void StartupProfiler::finish() {
+  if (recording.exchange(false)) {
+    finish_time = LAppUtil::get_time_seconds();
+  }
+}
+
+void StartupProfiler::report(const char* label) {
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  LAppUtil::print_log("[%s] startup took %.1f ms", label, (finish_time - start_time) * 1000.0);
+  for (size_t i = 0; i < phases.size(); i++) {
+    const Phase& phase = phases[i];
+    LAppUtil::print_log("[%s] %8.1f ms %*s%s%s%s", label, phase.duration * 1000.0, phase.depth * 2 + 1, "",
+      phase.name, phase.detail.empty() ? "" : " ", phase.detail.c_str());
+  }
+}
+
+/**
+ * @brief Write a string as a JSON string literal
+ */
+static void write_json_string(FILE* file, const std::string& value) {
+  fputc('"', file);
+  for (size_t i = 0; i < value.size(); i++) {
+    const unsigned char c = static_cast<unsigned char>(value[i]);
+    if (c == '"' || c == '\\') {
+      fputc('\\', file);
+      fputc(c, file);
+    }
+    else if (c < 0x20) {
+      fprintf(file, "\\u%04x", c);
+    }
+    else {
+      fputc(c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+bool StartupProfiler::write_json(const std::string& path) {
+  FILE* file = fopen(path.c_str(), "w");
+  if (file == NULL) {
+    LAppUtil::print_log("Error: could not write startup report %s", path.c_str());
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(phases_mutex);
+  fprintf(file, "{\n  \"total_ms\": %.3f,\n  \"phases\": [", (finish_time - start_time) * 1000.0);
+  for (size_t i = 0; i < phases.size(); i++) {
+    const Phase& phase = phases[i];
+    fprintf(file, "%s\n    { \"name\": ", i == 0 ? "" : ",");
+    write_json_string(file, phase.name);
+    fprintf(file, ", \"detail\": ");
+    write_json_string(file, phase.detail);
+    fprintf(file, ", \"depth\": %d, \"start_ms\": %.3f, \"duration_ms\": %.3f }",
+      phase.depth, phase.start * 1000.0, phase.duration * 1000.0);
+  }
+  fprintf(file, "\n  ]\n}\n");
+
+  const bool written = ferror(file) == 0;
+  if (fclose(file) != 0 || !written) {
+    LAppUtil::print_log("Error: could not write startup report %s", path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,58 @@
+#ifndef LIVE2D_STARTUP_PROFILER_HPP
+#define LIVE2D_STARTUP_PROFILER_HPP
+
+#include <string>
+
+/**
+ * @brief Times the phases of startup, nested, for tracking cold start across releases
+ *
+ * Phases are timed on the thread that starts the app. Scopes opened on
+ * other threads, or after finish, aren't recorded.
+ */
+class StartupProfiler {
+public:
+  /**
+   * @brief Times a phase for as long as it lives
+   *
+   * Scopes opened while another is open are its sub-phases.
+   */
+  class Scope {
+  public:
+    /**
+     * @param[in] name Has to outlive the profiler, a string literal
+     * @param[in] detail Tells apart phases of the same name, like the model or file they're for
+     */
+    explicit Scope(const char* name, const std::string& detail = std::string());
+    ~Scope();
+
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+  private:
+    int _phase; ///< -1 if not recorded
+  };
+
+  /**
+   * @brief Record phases from now on, on the calling thread
+   */
+  static void start();
+
+  /**
+   * @brief Stop recording, startup is over
+   */
+  static void finish();
+
+  /**
+   * @brief Print every phase, indented by depth, with how long it took
+   */
+  static void report(const char* label);
+
+  /**
+   * @brief Write every phase to a JSON file
+   *
+   * @return false if the file couldn't be written
+   */
+  static bool write_json(const std::string& path);
+};
+
+#endif /* LIVE2D_STARTUP_PROFILER_HPP */
@@ -0,0 +1,216 @@
+#include "TextureCache.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <filesystem>
+
+#include "Util.hpp"
+#include "Definitions.hpp"
+#include "ModelBundle.hpp"
+
+static const uint8_t KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+static const uint32_t KTX_ENDIANNESS = 0x04030201;
+static const char* SOURCE_KEY_NAME = "FaceStuff.source";
+
+/**
+ * Layout of a KTX 1.1 file, followed by key/value data and then every mip level
+ */
+struct KtxHeader {
+  uint8_t identifier[12];
+  uint32_t endianness;
+  uint32_t gl_type;            ///< 0 for compressed textures
+  uint32_t gl_type_size;
+  uint32_t gl_format;          ///< 0 for compressed textures
+  uint32_t gl_internal_format;
+  uint32_t gl_base_internal_format;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t array_elements;
+  uint32_t faces;
+  uint32_t mip_levels;
+  uint32_t key_value_bytes;
+};
+
+static uint32_t pad4(uint32_t size) {
+  return (size + 3) & ~3u;
+}
+
+static uint64_t fnv1a(const std::string& str) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < str.size(); i++) {
+    hash ^= static_cast<unsigned char>(str[i]);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string TextureCache::get_path(const std::string& filename) {
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.ktx", static_cast<unsigned long long>(fnv1a(filename)));
+  return std::string(LAppDefinitions::TextureCachePath) + name;
+}
+
+std::string TextureCache::get_source_key(const std::string& filename) {
+#ifdef PREMULTIPLIED_ALPHA_ENABLE
+  const char* premultiplied = ":1";
+#else
+  const char* premultiplied = ":0";
+#endif
+
+  // Bundles are read before the disk, so they're checked first here too
+  const std::string bundle_key = ModelBundle::get_asset_key(filename);
+  if (!bundle_key.empty()) {
+    return bundle_key + premultiplied;
+  }
+
+  struct stat stat_buf;
+  if (stat(filename.c_str(), &stat_buf) != 0) {
+    return "";
+  }
+
+  char key[96];
+  snprintf(key, sizeof(key), "%lld:%lld%s",
+    static_cast<long long>(stat_buf.st_size), static_cast<long long>(stat_buf.st_mtime), premultiplied);
+  return key;
+}
+
+bool TextureCache::read(const std::string& path, const std::string& source_key, GLenum format, Entry& entry) {
+  if (!entry.file.open(path)) {
+    return false;
+  }
+
+  const uint8_t* data = entry.file.get_data();
+  const size_t size = entry.file.get_size();
+  KtxHeader header;
+  bool valid = size >= sizeof(header);
+  if (valid) {
+    memcpy(&header, data, sizeof(header));
+    valid = memcmp(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) == 0 &&
+      header.endianness == KTX_ENDIANNESS &&
+      header.gl_type == 0 &&
+      header.faces == 1 &&
+      header.pixel_depth == 0 &&
+      header.mip_levels > 0 &&
+      header.pixel_width > 0 && header.pixel_height > 0 &&
+      sizeof(header) + header.key_value_bytes <= size;
+  }
+  if (!valid) {
+    entry.file.close();
+    LAppUtil::print_log("[APP] discarding malformed texture cache %s", path.c_str());
+    std::remove(path.c_str());
+    return false;
+  }
+  if (header.gl_internal_format != format) {
+    // Written on a machine with other extensions, rewritten once the image is decoded again
+    entry.file.close();
+    return false;
+  }
+
+  // Every key/value pair is a size, then a null terminated key and value, padded to 4 bytes
+  bool source_matches = false;
+  size_t offset = sizeof(header);
+  const size_t key_value_end = offset + header.key_value_bytes;
+  while (offset + 4 <= key_value_end) {
+    uint32_t pair_size;
+    memcpy(&pair_size, data + offset, 4);
+    offset += 4;
+    if (offset + pair_size > key_value_end) {
+      break;
+    }
+    const char* pair = reinterpret_cast<const char*>(data + offset);
+    const size_t key_length = strnlen(pair, pair_size);
+    if (key_length < pair_size && strcmp(pair, SOURCE_KEY_NAME) == 0) {
+      const std::string value(pair + key_length + 1, strnlen(pair + key_length + 1, pair_size - key_length - 1));
+      source_matches = value == source_key;
+    }
+    offset += pad4(pair_size);
+  }
+  if (!source_matches) {
+    entry.file.close();
+    return false;
+  }
+
+  offset = key_value_end;
+  entry.levels.clear();
+  for (uint32_t i = 0; i < header.mip_levels; i++) {
+    uint32_t level_size;
+    if (offset + 4 > size) {
+      break;
+    }
+    memcpy(&level_size, data + offset, 4);
+    offset += 4;
+    if (offset + level_size > size) {
+      break;
+    }
+    Level level = { data + offset, level_size };
+    entry.levels.push_back(level);
+    offset += pad4(level_size);
+  }
+  if (entry.levels.size() != header.mip_levels) {
+    entry.file.close();
+    LAppUtil::print_log("[APP] discarding truncated texture cache %s", path.c_str());
+    std::remove(path.c_str());
+    return false;
+  }
+
+  entry.width = static_cast<int>(header.pixel_width);
+  entry.height = static_cast<int>(header.pixel_height);
+  return true;
+}
+
+bool TextureCache::write(const std::string& path, const std::string& source_key, GLenum format,
+                         int width, int height, const std::vector<std::vector<uint8_t>>& levels) {
+  std::error_code error;
+  std::filesystem::create_directories(LAppDefinitions::TextureCachePath, error);
+
+  // Written under a temporary name so a crash never leaves a truncated cache behind
+  const std::string temp_path = path + ".tmp";
+  FILE* file = fopen(temp_path.c_str(), "wb");
+  if (file == NULL) {
+    LAppUtil::print_log("[APP] could not write texture cache %s", temp_path.c_str());
+    return false;
+  }
+
+  const uint32_t pair_size = static_cast<uint32_t>(strlen(SOURCE_KEY_NAME) + 1 + source_key.size() + 1);
+  static const uint8_t padding[4] = { 0, 0, 0, 0 };
+
+  KtxHeader header;
+  memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+  header.endianness = KTX_ENDIANNESS;
+  header.gl_type = 0;
+  header.gl_type_size = 1;
+  header.gl_format = 0;
+  header.gl_internal_format = format;
+  header.gl_base_internal_format = GL_RGBA;
+  header.pixel_width = static_cast<uint32_t>(width);
+  header.pixel_height = static_cast<uint32_t>(height);
+  header.pixel_depth = 0;
+  header.array_elements = 0;
+  header.faces = 1;
+  header.mip_levels = static_cast<uint32_t>(levels.size());
+  header.key_value_bytes = 4 + pad4(pair_size);
+
+  bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(&pair_size, 4, 1, file) == 1 &&
+    fwrite(SOURCE_KEY_NAME, 1, strlen(SOURCE_KEY_NAME) + 1, file) == strlen(SOURCE_KEY_NAME) + 1 &&
+    fwrite(source_key.c_str(), 1, source_key.size() + 1, file) == source_key.size() + 1 &&
+    fwrite(padding, 1, pad4(pair_size) - pair_size, file) == pad4(pair_size) - pair_size;
+  for (size_t i = 0; written && i < levels.size(); i++) {
+    const uint32_t level_size = static_cast<uint32_t>(levels[i].size());
+    written = fwrite(&level_size, 4, 1, file) == 1 &&
+      fwrite(levels[i].data(), 1, level_size, file) == level_size &&
+      fwrite(padding, 1, pad4(level_size) - level_size, file) == pad4(level_size) - level_size;
+  }
+  fclose(file);
+
+  if (written) {
+    std::filesystem::rename(temp_path, path, error);
+  }
+  if (!written || error) {
+    std::remove(temp_path.c_str());
+    return false;
+  }
+  return true;
+}
@@ -0,0 +1,67 @@
+#ifndef LIVE2D_TEXTURE_CACHE_HPP
+#define LIVE2D_TEXTURE_CACHE_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <gl/glew.h>
+
+#include "MappedFile.hpp"
+
+/**
+ * @brief Stores compressed textures with all their mip levels as KTX 1.1 files
+ *
+ * Each file records the size and modification time of the image it was made
+ * from, or of the bundle it came out of, so editing either invalidates it.
+ */
+class TextureCache {
+public:
+  struct Level {
+    const uint8_t* data; ///< Points into the mapped file
+    uint32_t size;
+  };
+
+  /**
+   * @brief A cached texture, valid as long as its file stays open
+   */
+  struct Entry {
+    MappedFile file;
+    int width = 0;
+    int height = 0;
+    std::vector<Level> levels;
+  };
+
+  /**
+   * @brief Where the compressed copy of an image goes
+   */
+  static std::string get_path(const std::string& filename);
+
+  /**
+   * @brief Identify the current contents of an image, for the cache to be checked against
+   *
+   * @return An empty string if the image can't be found
+   */
+  static std::string get_source_key(const std::string& filename);
+
+  /**
+   * @brief Map a cached texture
+   *
+   * @param[in] path
+   * @param[in] source_key Must match the one it was written with
+   * @param[in] format Compressed internal format the texture must be in
+   * @param[out] entry
+   * @return true iff the cache is valid, a malformed one is deleted
+   */
+  static bool read(const std::string& path, const std::string& source_key, GLenum format, Entry& entry);
+
+  /**
+   * @brief Write a compressed texture, replacing any previous one atomically
+   *
+   * @param[in] levels Compressed blocks of every mip level, largest first
+   * @return true iff the file was written
+   */
+  static bool write(const std::string& path, const std::string& source_key, GLenum format,
+                    int width, int height, const std::vector<std::vector<uint8_t>>& levels);
+};
+
+#endif /* LIVE2D_TEXTURE_CACHE_HPP */
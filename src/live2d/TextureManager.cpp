@@ -5,86 +5,343 @@
 #define STBI_ONLY_PNG
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
 
 #include "Util.hpp"
 #include "Definitions.hpp"
+#include "MappedFile.hpp"
+#include "ModelBundle.hpp"
+#include "PixelKernels.hpp"
+#include "StartupProfiler.hpp"
+
+TextureManager::TextureManager() :
+  _vramBytes(0),
+  _vramBudget(0),
+  _uses(0),
+  _unpackBuffer(0),
+  _compressedFormat(0)
+{
+  _decodePool.initialize();
+}
+
+// Bytes of texture data reloads upload per frame, a 2048 x 2048 texture takes around twenty
+static const size_t RELOAD_BYTES_PER_FRAME = 1024 * 1024;
+
+static const char* format_name(GLenum format) {
+  switch (format) {
+  case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:
+    return "BC7";
+  case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+    return "BC3";
+  case GL_COMPRESSED_RGBA8_ETC2_EAC:
+    return "ETC2";
+  default:
+    return "RGBA8";
+  }
+}
+
+/**
+ * @brief Box filter an RGBA image down to 1 x 1, each level half the size of the one before
+ */
+static void build_mip_chain(const uint8_t* base, int width, int height, std::vector<std::vector<uint8_t>>& mips) {
+  const uint8_t* src = base;
+  int w = width;
+  int h = height;
+  while (w > 1 || h > 1) {
+    const int mip_w = w > 1 ? w / 2 : 1;
+    const int mip_h = h > 1 ? h / 2 : 1;
+    std::vector<uint8_t> level(static_cast<size_t>(mip_w) * mip_h * 4);
+    for (int y = 0; y < mip_h; y++) {
+      // Odd sizes drop their last row/column, like glGenerateMipmap
+      const uint8_t* row0 = src + static_cast<size_t>(y * 2) * w * 4;
+      const uint8_t* row1 = h > 1 ? row0 + static_cast<size_t>(w) * 4 : row0;
+      uint8_t* out = level.data() + static_cast<size_t>(y) * mip_w * 4;
+      for (int x = 0; x < mip_w; x++) {
+        const int x0 = x * 2 * 4;
+        const int x1 = w > 1 ? x0 + 4 : x0;
+        for (int c = 0; c < 4; c++) {
+          out[x * 4 + c] = static_cast<uint8_t>((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) >> 2);
+        }
+      }
+    }
+    mips.push_back(std::move(level));
+    src = mips.back().data();
+    w = mip_w;
+    h = mip_h;
+  }
+}
+
+bool TextureManager::enable_compression() {
+  if (GLEW_ARB_texture_compression_bptc) {
+    _compressedFormat = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+  }
+  else if (GLEW_EXT_texture_compression_s3tc) {
+    _compressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  }
+  else if (GLEW_ARB_ES3_compatibility) {
+    _compressedFormat = GL_COMPRESSED_RGBA8_ETC2_EAC;
+  }
+  else {
+    LAppUtil::print_log("[APP] no compressed texture format supported, textures stay uncompressed");
+    _compressedFormat = 0;
+    return false;
+  }
+
+  LAppUtil::print_log("[APP] compressing textures as %s", format_name(_compressedFormat));
+  return true;
+}
 
-TextureManager::TextureManager() { }
 TextureManager::~TextureManager() {
   release_textures();
+  _decodePool.release();
+}
+
+void TextureManager::set_vram_budget(size_t bytes) {
+  _vramBudget = bytes;
+  evict_textures();
+}
+
+void TextureManager::report(const char* label) const {
+  size_t unreferenced = 0;
+  for (auto iter = _texturesById.begin(); iter != _texturesById.end(); ++iter) {
+    if (iter->second->references == 0) {
+      unreferenced++;
+    }
+  }
+  LAppUtil::print_log("[%s] textures: %zu resident, %zu unreferenced, %.2f MB VRAM",
+    label, _texturesById.size(), unreferenced, _vramBytes / (1024.0 * 1024.0));
+}
+
+TextureManager::TextureInfo* TextureManager::find_texture(const std::string& filename) const {
+  auto texture = _texturesByPath.find(filename);
+  return texture != _texturesByPath.end() ? texture->second : NULL;
+}
+
+void TextureManager::add_texture(TextureInfo* texture_info) {
+  if (!texture_info->filename.empty()) {
+    _texturesByPath[texture_info->filename] = texture_info;
+  }
+  _texturesById[texture_info->id] = texture_info;
+  _vramBytes += texture_info->vram_bytes;
+}
+
+void TextureManager::delete_texture(TextureInfo* texture_info) {
+  glDeleteTextures(1, &texture_info->id);
+  if (!texture_info->filename.empty()) {
+    _texturesByPath.erase(texture_info->filename);
+  }
+  _texturesById.erase(texture_info->id);
+  _vramBytes -= texture_info->vram_bytes;
+  delete texture_info;
+}
+
+void TextureManager::release_reference(TextureInfo* texture_info) {
+  if (texture_info->references > 0) {
+    texture_info->references--;
+  }
+  if (texture_info->references > 0) {
+    return;
+  }
+
+  if (_vramBudget == 0) {
+    delete_texture(texture_info);
+  }
+  else {
+    evict_textures();
+  }
+}
+
+void TextureManager::evict_textures() {
+  if (_vramBudget == 0) {
+    return;
+  }
+
+  while (_vramBytes > _vramBudget) {
+    // Only ever a few dozen textures, not worth keeping them in LRU order
+    TextureInfo* oldest = NULL;
+    for (auto iter = _texturesById.begin(); iter != _texturesById.end(); ++iter) {
+      TextureInfo* texture_info = iter->second;
+      if (texture_info->references == 0 && (oldest == NULL || texture_info->last_used < oldest->last_used)) {
+        oldest = texture_info;
+      }
+    }
+    if (oldest == NULL) {
+      // Everything left is in use
+      return;
+    }
+    delete_texture(oldest);
+  }
+}
+
+void TextureManager::preload_png(const std::string& filename) {
+  if (find_texture(filename) != NULL) {
+    return;
+  }
+  for (size_t i = 0; i < _pending.size(); i++) {
+    if (_pending[i].filename == filename) {
+      return;
+    }
+  }
+
+  PendingDecode pending;
+  pending.filename = filename;
+  pending.image = _decodePool.submit([this, filename] { return decode_png(filename); });
+  _pending.push_back(std::move(pending));
 }
 
 TextureManager::TextureInfo* TextureManager::create_texture_from_png(std::string filename) {
   // Search for an existing loaded texture with that filename
-  for (Csm::csmUint32 i = 0; i < _textures.GetSize(); i++) {
-    if (_textures[i]->filename == filename) {
-      return _textures[i];
+  TextureInfo* texture_info = find_texture(filename);
+  if (texture_info == NULL) {
+    StartupProfiler::Scope scope("texture", filename);
+    preload_png(filename);
+    for (size_t i = 0; i < _pending.size(); i++) {
+      if (_pending[i].filename == filename) {
+        DecodedImage image;
+        {
+          StartupProfiler::Scope wait_scope("wait for decode");
+          image = _pending[i].image.get();
+        }
+        _pending.erase(_pending.begin() + i);
+        StartupProfiler::Scope upload_scope("upload");
+        texture_info = upload_png(filename, image);
+        break;
+      }
+    }
+    if (texture_info == NULL) {
+      return NULL;
     }
   }
 
-  GLuint texture_id;
-  int width, height, channels;
-  unsigned int size;
-  unsigned char* raw_data;
-  unsigned char* png_data;
+  texture_info->references++;
+  texture_info->last_used = ++_uses;
+  // Referenced first so the new texture itself can't be evicted
+  evict_textures();
+  return texture_info;
+}
+
+TextureManager::DecodedImage TextureManager::decode_png(const std::string& filename) {
+  const double start = LAppUtil::get_time_seconds();
+  DecodedImage image;
+
+  if (_compressedFormat != 0) {
+    image.source_key = TextureCache::get_source_key(filename);
+    if (!image.source_key.empty() &&
+        TextureCache::read(TextureCache::get_path(filename), image.source_key, _compressedFormat, image.cached)) {
+      image.width = image.cached.width;
+      image.height = image.cached.height;
+      // Page faults belong on this thread, not in the upload
+      image.cached.file.prefetch();
+      image.decode_ms = (LAppUtil::get_time_seconds() - start) * 1000.0;
+      return image;
+    }
+  }
 
-  raw_data = LAppUtil::load_file_as_bytes(filename, &size);
-  if (raw_data == NULL) {
+  MappedFile file;
+  if (!ModelBundle::open_asset(file, filename)) {
     if (LAppDefinitions::DebugLogEnable) {
       LAppUtil::print_log("Error: unable to load texture file %s", filename.c_str());
     }
-    return NULL;
+    return image;
   }
 
-  png_data = stbi_load_from_memory(
-    raw_data, static_cast<int>(size),
-    &width, &height, &channels,
+  int channels;
+  image.pixels = stbi_load_from_memory(
+    file.get_data(), static_cast<int>(file.get_size()),
+    &image.width, &image.height, &channels,
     STBI_rgb_alpha
     );
 
-  if (png_data == NULL) {
+  if (image.pixels == NULL) {
     if (LAppDefinitions::DebugLogEnable) {
       LAppUtil::print_log("Error: loading texture file %s as PNG failed", filename.c_str());
     }
-    LAppUtil::release_bytes(raw_data);
-    return NULL;
+    return image;
   }
 
 #ifdef PREMULTIPLIED_ALPHA_ENABLE
-  // Pre-multiply the PNG image by its alpha channel
-  FULL_COLOR_TYPE* colors = reinterpret_cast<FULL_COLOR_TYPE*>(png_data);
-  for (int i = 0; i < width * height; i++) {
-    unsigned char* p = png_data + i * 4;
-    colors[i] = premultiply(p[0], p[1], p[2], p[3]);
-  }
+  // Pre-multiply the PNG image by its alpha channel, same results as premultiply()
+  PixelKernels::premultiply_alpha(image.pixels, static_cast<size_t>(image.width) * image.height);
 #endif
 
+  if (_compressedFormat != 0) {
+    // Compressed formats can't be rendered to, so glGenerateMipmap can't make their levels
+    build_mip_chain(image.pixels, image.width, image.height, image.mips);
+  }
+
+  image.decode_ms = (LAppUtil::get_time_seconds() - start) * 1000.0;
+  return image;
+}
+
+TextureManager::TextureInfo* TextureManager::upload_png(const std::string& filename, DecodedImage& image) {
+  if (image.pixels == NULL && image.cached.levels.empty()) {
+    return NULL;
+  }
+
+  const double start = LAppUtil::get_time_seconds();
+
   // Below code using OpenGL API to load the texture
+  GLuint texture_id;
   glGenTextures(1, &texture_id);
   glBindTexture(GL_TEXTURE_2D, texture_id);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, png_data);
 
-  // Generate Mipmap (for performant scaling) and set the blending modes
-  glGenerateMipmap(GL_TEXTURE_2D);
+  size_t vram_bytes = 0;
+  const char* source = "png";
+  GLenum format = _compressedFormat;
+  if (!image.cached.levels.empty()) {
+    if (!upload_cached(image, &vram_bytes)) {
+      // Usually a driver update, decoding the PNG again replaces the file
+      LAppUtil::print_log("[APP] driver rejected texture cache for %s, decoding it again", filename.c_str());
+      glBindTexture(GL_TEXTURE_2D, 0);
+      glDeleteTextures(1, &texture_id);
+      image.cached.file.close();
+      std::remove(TextureCache::get_path(filename).c_str());
+      DecodedImage decoded = decode_png(filename);
+      return upload_png(filename, decoded);
+    }
+    source = "cache";
+  }
+  else if (format == 0 || !upload_compressed(filename, image, &vram_bytes)) {
+    format = 0;
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.pixels);
+    // Generate Mipmap (for performant scaling)
+    glGenerateMipmap(GL_TEXTURE_2D);
+    // The mip chain adds a third
+    vram_bytes = static_cast<size_t>(image.width) * image.height * 4 * 4 / 3;
+  }
+
+  // Set the blending modes
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
   // Unbind the current texture and release all intermediate data
   glBindTexture(GL_TEXTURE_2D, 0);
-  stbi_image_free(png_data);
-  png_data = NULL;
-  LAppUtil::release_bytes(raw_data);
-  raw_data = NULL;
+  if (image.pixels != NULL) {
+    stbi_image_free(image.pixels);
+    image.pixels = NULL;
+  }
+  image.mips.clear();
+  image.cached.file.close();
+
+  LAppUtil::print_log("[APP] texture %s: %d x %d %s from %s, %.1f ms decoding, %.1f ms uploading, %.2f MB VRAM",
+    filename.c_str(), image.width, image.height, format_name(format), source,
+    image.decode_ms, (LAppUtil::get_time_seconds() - start) * 1000.0, vram_bytes / (1024.0 * 1024.0));
 
   // Now, add all requisite infomation into our internal texture list
   TextureManager::TextureInfo* texture_info = new TextureManager::TextureInfo();
   if (texture_info != NULL) {
     texture_info->filename = filename;
-    texture_info->width = width;
-    texture_info->height = height;
+    texture_info->width = image.width;
+    texture_info->height = image.height;
     texture_info->id = texture_id;
+    texture_info->vram_bytes = vram_bytes;
 
-    _textures.PushBack(texture_info);
+    add_texture(texture_info);
   }
   else if (LAppDefinitions::DebugLogEnable) {
     LAppUtil::print_log("Error allocating memory to load texture from %s", filename.c_str());
@@ -93,6 +350,385 @@ TextureManager::TextureInfo* TextureManager::create_texture_from_png(std::string
   return texture_info;
 }
 
+bool TextureManager::upload_cached(DecodedImage& image, size_t* vram_bytes) {
+  const std::vector<TextureCache::Level>& levels = image.cached.levels;
+  int width = image.width;
+  int height = image.height;
+  for (size_t level = 0; level < levels.size(); level++) {
+    glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), _compressedFormat,
+      width, height, 0, static_cast<GLsizei>(levels[level].size), levels[level].data);
+    *vram_bytes += levels[level].size;
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size()) - 1);
+
+  GLint compressed = GL_FALSE;
+  GLint stored_width = 0;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &stored_width);
+  return compressed == GL_TRUE && stored_width == image.width;
+}
+
+bool TextureManager::upload_compressed(const std::string& filename, DecodedImage& image, size_t* vram_bytes) {
+  const int level_count = 1 + static_cast<int>(image.mips.size());
+  int width = image.width;
+  int height = image.height;
+  for (int level = 0; level < level_count; level++) {
+    const uint8_t* pixels = level == 0 ? image.pixels : image.mips[level - 1].data();
+    glTexImage2D(GL_TEXTURE_2D, level, _compressedFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    width = width > 1 ? width / 2 : 1;
+    height = height > 1 ? height / 2 : 1;
+  }
+
+  GLint compressed = GL_FALSE;
+  glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+  if (compressed != GL_TRUE) {
+    return false;
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+
+  // Read the driver's blocks back so later runs skip both the decode and the compression
+  std::shared_ptr<std::vector<std::vector<uint8_t>>> blocks = std::make_shared<std::vector<std::vector<uint8_t>>>(level_count);
+  for (int level = 0; level < level_count; level++) {
+    GLint size = 0;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    if (size <= 0) {
+      return true;
+    }
+    (*blocks)[level].resize(size);
+    glGetCompressedTexImage(GL_TEXTURE_2D, level, (*blocks)[level].data());
+    *vram_bytes += size;
+  }
+
+  cache_blocks(filename, image, blocks);
+  return true;
+}
+
+void TextureManager::cache_blocks(const std::string& filename, const DecodedImage& image,
+                                  std::shared_ptr<std::vector<std::vector<uint8_t>>> blocks) {
+  if (image.source_key.empty()) {
+    return;
+  }
+
+  const std::string path = TextureCache::get_path(filename);
+  const std::string source_key = image.source_key;
+  const GLenum format = _compressedFormat;
+  const int base_width = image.width;
+  const int base_height = image.height;
+  _decodePool.submit([path, source_key, format, base_width, base_height, blocks] {
+    return TextureCache::write(path, source_key, format, base_width, base_height, *blocks);
+  });
+}
+
+bool TextureManager::reload_png(const std::string& filename) {
+  if (find_texture(filename) == NULL) {
+    return false;
+  }
+  for (size_t i = 0; i < _reloads.size(); i++) {
+    if (_reloads[i].filename == filename) {
+      // Already on its way, and will read the file as it is by then
+      return true;
+    }
+  }
+
+  PendingDecode pending;
+  pending.filename = filename;
+  pending.image = _decodePool.submit([this, filename] {
+    DecodedImage image = decode_png(filename);
+    // Reloads upload every level themselves, glGenerateMipmap would stall the frame
+    if (image.pixels != NULL && image.mips.empty()) {
+      build_mip_chain(image.pixels, image.width, image.height, image.mips);
+    }
+    return image;
+  });
+  _reloads.push_back(std::move(pending));
+  return true;
+}
+
+void TextureManager::update_reloads() {
+  for (size_t i = 0; i < _reloads.size();) {
+    if (_reloads[i].image.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      i++;
+      continue;
+    }
+
+    DecodedImage image = _reloads[i].image.get();
+    // Evicted meanwhile, the next load reads the new file anyway
+    TextureInfo* texture_info = find_texture(_reloads[i].filename);
+    if (texture_info != NULL && (image.pixels != NULL || !image.cached.levels.empty())) {
+      stage_reload(texture_info, image);
+    }
+    else if (image.pixels != NULL) {
+      stbi_image_free(image.pixels);
+    }
+    _reloads.erase(_reloads.begin() + i);
+  }
+
+  size_t budget = RELOAD_BYTES_PER_FRAME;
+  for (size_t i = 0; i < _staged.size();) {
+    TextureInfo* texture_info = find_texture(_staged[i].filename);
+    if (texture_info == NULL || texture_info->id != _staged[i].target) {
+      discard_reload(i);
+      continue;
+    }
+    // Ones uploading straight into their resident texture were already cleared, they can't wait
+    if (budget == 0 && _staged[i].texture != _staged[i].target) {
+      i++;
+      continue;
+    }
+    if (!continue_reload(_staged[i], &budget)) {
+      i++;
+      continue;
+    }
+    finish_reload(texture_info, _staged[i]);
+    discard_reload(i);
+  }
+}
+
+void TextureManager::stage_reload(TextureInfo* texture_info, DecodedImage& image) {
+  for (size_t i = 0; i < _staged.size(); i++) {
+    if (_staged[i].filename == texture_info->filename) {
+      discard_reload(i);
+      break;
+    }
+  }
+
+  StagedReload staged;
+  staged.filename = texture_info->filename;
+  staged.target = texture_info->id;
+  // Only set when compressing, cache hits included
+  staged.format = _compressedFormat;
+  staged.level_count = image.cached.levels.empty() ?
+    1 + static_cast<int>(image.mips.size()) : static_cast<int>(image.cached.levels.size());
+  staged.image = std::move(image);
+  if (GLEW_ARB_copy_image) {
+    glGenTextures(1, &staged.texture);
+  }
+  else {
+    // Uploaded straight into the resident texture in one go, half of one would show
+    staged.texture = staged.target;
+  }
+  allocate_levels(staged.texture, staged.format, staged.image.width, staged.image.height, staged.level_count);
+  _staged.push_back(std::move(staged));
+}
+
+bool TextureManager::continue_reload(StagedReload& staged, size_t* budget) {
+  const double start = LAppUtil::get_time_seconds();
+  const bool from_cache = !staged.image.cached.levels.empty();
+  size_t unlimited = SIZE_MAX;
+  if (staged.texture == staged.target) {
+    budget = &unlimited;
+  }
+
+  glBindTexture(GL_TEXTURE_2D, staged.texture);
+  while (*budget > 0 && staged.level < staged.level_count) {
+    const int width = std::max(1, staged.image.width >> staged.level);
+    const int height = std::max(1, staged.image.height >> staged.level);
+
+    if (staged.reading) {
+      std::vector<uint8_t>& blocks = (*staged.blocks)[staged.level];
+      if (!staged.level_queued) {
+        GLint size = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, staged.level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+        if (size <= 0) {
+          // Not cached then, the texture itself is fine
+          staged.blocks.reset();
+          staged.level = staged.level_count;
+          break;
+        }
+        blocks.resize(size);
+        if (staged.pack_buffer == 0) {
+          glGenBuffers(1, &staged.pack_buffer);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, staged.pack_buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, size, NULL, GL_STREAM_READ);
+        glGetCompressedTexImage(GL_TEXTURE_2D, staged.level, NULL);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        staged.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        staged.level_queued = true;
+        staged.copied = 0;
+        // The copy into the buffer has a frame to finish before it's mapped
+        break;
+      }
+      if (staged.fence != NULL) {
+        const GLenum status = glClientWaitSync(staged.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+          break;
+        }
+        glDeleteSync(staged.fence);
+        staged.fence = NULL;
+      }
+
+      const size_t size = std::min(*budget, blocks.size() - staged.copied);
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, staged.pack_buffer);
+      const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, staged.copied, size, GL_MAP_READ_BIT);
+      if (mapped != NULL) {
+        memcpy(blocks.data() + staged.copied, mapped, size);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+      }
+      glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+      if (mapped == NULL) {
+        staged.blocks.reset();
+        staged.level = staged.level_count;
+        break;
+      }
+      *budget -= size;
+      staged.copied += size;
+      if (staged.copied == blocks.size()) {
+        staged.level_queued = false;
+        staged.level++;
+      }
+      continue;
+    }
+
+    // Bands of whole rows, of whole 4 x 4 blocks when compressed
+    const int band_rows = staged.format != 0 ? 4 : 1;
+    const uint8_t* data;
+    size_t band_bytes;
+    if (from_cache) {
+      const TextureCache::Level& level = staged.image.cached.levels[staged.level];
+      data = level.data;
+      band_bytes = level.size / ((height + 3) / 4);
+    }
+    else {
+      data = staged.level == 0 ? staged.image.pixels : staged.image.mips[staged.level - 1].data();
+      band_bytes = static_cast<size_t>(width) * 4 * band_rows;
+    }
+    const int bands = static_cast<int>(std::max<size_t>(1, *budget / band_bytes));
+    const int rows = std::min(bands * band_rows, height - staged.row);
+    const size_t offset = staged.row / band_rows * band_bytes;
+    const size_t size = from_cache ? (rows + 3) / 4 * band_bytes : static_cast<size_t>(width) * 4 * rows;
+
+    if (_unpackBuffer == 0) {
+      glGenBuffers(1, &_unpackBuffer);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _unpackBuffer);
+    // Orphaned every band, so writing it never waits on the copy out of the last one
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+    const void* source = NULL;
+    void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+    if (mapped != NULL) {
+      memcpy(mapped, data + offset, size);
+      glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    }
+    else {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      source = data + offset;
+    }
+    if (from_cache) {
+      glCompressedTexSubImage2D(GL_TEXTURE_2D, staged.level, 0, staged.row, width, rows,
+        staged.format, static_cast<GLsizei>(size), source);
+    }
+    else {
+      glTexSubImage2D(GL_TEXTURE_2D, staged.level, 0, staged.row, width, rows, GL_RGBA, GL_UNSIGNED_BYTE, source);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    *budget -= std::min(*budget, size);
+
+    staged.row += rows;
+    if (staged.row < height) {
+      continue;
+    }
+    staged.row = 0;
+    staged.level++;
+    if (staged.level < staged.level_count || staged.format == 0 || from_cache) {
+      continue;
+    }
+
+    // Every level is in, now the driver's had its go at compressing them
+    GLint compressed = GL_FALSE;
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_COMPRESSED, &compressed);
+    if (compressed != GL_TRUE) {
+      LAppUtil::print_log("[APP] driver didn't compress reloaded texture %s, uploading it uncompressed", staged.filename.c_str());
+      staged.format = 0;
+      staged.level = 0;
+      allocate_levels(staged.texture, staged.format, staged.image.width, staged.image.height, staged.level_count);
+      glBindTexture(GL_TEXTURE_2D, staged.texture);
+    }
+    else if (!staged.image.source_key.empty()) {
+      // Read back like a first load, so the next run skips both the decode and the compression
+      staged.reading = true;
+      staged.level = 0;
+      staged.blocks = std::make_shared<std::vector<std::vector<uint8_t>>>(staged.level_count);
+    }
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  staged.upload_ms += (LAppUtil::get_time_seconds() - start) * 1000.0;
+  return staged.level == staged.level_count;
+}
+
+void TextureManager::finish_reload(TextureInfo* texture_info, StagedReload& staged) {
+  const double start = LAppUtil::get_time_seconds();
+  const DecodedImage& image = staged.image;
+
+  size_t vram_bytes = 0;
+  glBindTexture(GL_TEXTURE_2D, staged.texture);
+  for (int level = 0; level < staged.level_count; level++) {
+    GLint size = 0;
+    if (staged.format != 0) {
+      glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+    }
+    else {
+      size = std::max(1, image.width >> level) * std::max(1, image.height >> level) * 4;
+    }
+    vram_bytes += static_cast<size_t>(size);
+  }
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  if (staged.texture != staged.target) {
+    // The id stays, so every renderer it's bound to picks the new contents up
+    allocate_levels(staged.target, staged.format, image.width, image.height, staged.level_count);
+    for (int level = 0; level < staged.level_count; level++) {
+      glCopyImageSubData(staged.texture, GL_TEXTURE_2D, level, 0, 0, 0, staged.target, GL_TEXTURE_2D, level, 0, 0, 0,
+        std::max(1, image.width >> level), std::max(1, image.height >> level), 1);
+    }
+  }
+  if (staged.blocks) {
+    cache_blocks(staged.filename, image, staged.blocks);
+  }
+
+  _vramBytes -= texture_info->vram_bytes;
+  texture_info->width = image.width;
+  texture_info->height = image.height;
+  texture_info->vram_bytes = vram_bytes;
+  _vramBytes += vram_bytes;
+
+  LAppUtil::print_log("[APP] reloaded texture %s: %d x %d %s from %s, %.1f ms decoding, %.1f ms uploading, %.2f MB VRAM",
+    staged.filename.c_str(), image.width, image.height, format_name(staged.format),
+    image.cached.levels.empty() ? "png" : "cache", image.decode_ms,
+    staged.upload_ms + (LAppUtil::get_time_seconds() - start) * 1000.0, vram_bytes / (1024.0 * 1024.0));
+  evict_textures();
+}
+
+void TextureManager::discard_reload(size_t index) {
+  StagedReload& staged = _staged[index];
+  if (staged.texture != staged.target) {
+    glDeleteTextures(1, &staged.texture);
+  }
+  if (staged.fence != NULL) {
+    glDeleteSync(staged.fence);
+  }
+  if (staged.pack_buffer != 0) {
+    glDeleteBuffers(1, &staged.pack_buffer);
+  }
+  if (staged.image.pixels != NULL) {
+    stbi_image_free(staged.image.pixels);
+  }
+  _staged.erase(_staged.begin() + index);
+}
+
+void TextureManager::allocate_levels(GLuint texture, GLenum format, int width, int height, int level_count) {
+  glBindTexture(GL_TEXTURE_2D, texture);
+  for (int level = 0; level < level_count; level++) {
+    glTexImage2D(GL_TEXTURE_2D, level, format != 0 ? format : GL_RGBA,
+      std::max(1, width >> level), std::max(1, height >> level), 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level_count - 1);
+  glBindTexture(GL_TEXTURE_2D, 0);
+}
+
 TextureManager::TextureInfo* TextureManager::create_texture_from_dims(GLint width, GLint height) {
   if (width == 0 || height == 0) {
     // Invalid width/height was given
@@ -124,8 +760,13 @@ TextureManager::TextureInfo* TextureManager::create_texture_from_dims(GLint widt
     texture_info->width = width;
     texture_info->height = height;
     texture_info->id = texture_id;
+    // Drivers pad RGB out to 4 bytes a pixel
+    texture_info->vram_bytes = static_cast<size_t>(width) * height * 4 * 4 / 3;
+    texture_info->references = 1;
+    texture_info->last_used = ++_uses;
 
-    _textures.PushBack(texture_info);
+    add_texture(texture_info);
+    evict_textures();
   }
   else if (LAppDefinitions::DebugLogEnable) {
     LAppUtil::print_log("Error allocating memory for new blank (%d x %d) texture", width, height);
@@ -135,40 +776,55 @@ TextureManager::TextureInfo* TextureManager::create_texture_from_dims(GLint widt
 }
 
 void TextureManager::release_textures() {
-  for (Csm::csmUint32 i = 0; i < _textures.GetSize(); i++) {
-    delete _textures[i];
+  // Decodes nobody asked for in the end, the pool may still be writing into them
+  for (size_t i = 0; i < _pending.size(); i++) {
+    DecodedImage image = _pending[i].image.get();
+    if (image.pixels != NULL) {
+      stbi_image_free(image.pixels);
+    }
+  }
+  _pending.clear();
+  for (size_t i = 0; i < _reloads.size(); i++) {
+    DecodedImage image = _reloads[i].image.get();
+    if (image.pixels != NULL) {
+      stbi_image_free(image.pixels);
+    }
+  }
+  _reloads.clear();
+  while (!_staged.empty()) {
+    discard_reload(_staged.size() - 1);
+  }
+  if (_unpackBuffer != 0) {
+    glDeleteBuffers(1, &_unpackBuffer);
+    _unpackBuffer = 0;
+  }
+
+  for (auto iter = _texturesById.begin(); iter != _texturesById.end(); ++iter) {
+    glDeleteTextures(1, &iter->second->id);
+    delete iter->second;
   }
 
-  _textures.Clear();
+  _texturesById.clear();
+  _texturesByPath.clear();
+  _vramBytes = 0;
 }
 
 void TextureManager::release_texture(GLuint texture_id) {
-  for (Csm::csmUint32 i = 0; i < _textures.GetSize(); i++) {
-    if (_textures[i]->id == texture_id) {
-      delete _textures[i];
-      _textures.Remove(i);
-      i--;
-    }
+  TextureInfo* texture_info = get_texture_info_by_id(texture_id);
+  if (texture_info != NULL) {
+    release_reference(texture_info);
   }
 }
 
 void TextureManager::release_texture(std::string filename) {
-  for (Csm::csmUint32 i = 0; i < _textures.GetSize(); i++) {
-    if (_textures[i]->filename == filename) {
-      delete _textures[i];
-      _textures.Remove(i);
-      i--;
-    }
+  TextureInfo* texture_info = find_texture(filename);
+  if (texture_info != NULL) {
+    release_reference(texture_info);
   }
 }
 
 TextureManager::TextureInfo* TextureManager::get_texture_info_by_id(GLuint texture_id) const {
-  for (Csm::csmUint32 i = 0; i < _textures.GetSize(); i++) {
-    if (_textures[i]->id == texture_id) {
-      return _textures[i];
-    }
-  }
-
-  // No texture with that id
-  return NULL;
+  auto texture = _texturesById.find(texture_id);
+  // NULL if no texture has that id
+  return texture != _texturesById.end() ? texture->second : NULL;
 }
\ No newline at end of file
@@ -1,9 +1,15 @@
 #ifndef LIVE2D_TEXTURE_MANAGER_HPP
 #define LIVE2D_TEXTURE_MANAGER_HPP
 
+#include <future>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 #include <gl/glew.h>
-#include <Type/csmVector.hpp>
+
+#include "WorkerPool.hpp"
+#include "TextureCache.hpp"
 
 typedef uint32_t FULL_COLOR_TYPE;
 typedef uint8_t PART_COLOR_TYPE;
@@ -15,6 +21,9 @@ public:
     int width = -1;
     int height = -1;
     std::string filename;
+    size_t vram_bytes = 0; ///< Estimated size on the GPU, mip levels included
+    int references = 0; ///< Holders that haven't released it yet
+    unsigned long long last_used = 0; ///< TextureManager::_uses as of the last reference taken
   };
 
   /**
@@ -60,15 +69,81 @@ public:
       (static_cast<FULL_COLOR_TYPE>(alpha) << 24);
   }
 
+  /**
+   * @brief Store PNG textures compressed on the GPU, transcoding them once into a cache
+   *
+   * Picks BC7, BC3 or ETC2, whichever the driver supports first. Without any
+   * of them textures stay uncompressed. Needs a current GL context.
+   *
+   * @return true iff a compressed format is available
+   */
+  bool enable_compression();
+
+  /**
+   * @brief Keep textures nothing references any more on the GPU, up to a total size
+   *
+   * Past the budget, unreferenced textures are deleted least recently used
+   * first. Without one they're deleted as soon as their last reference goes.
+   *
+   * @param[in] bytes 0 for no budget
+   */
+  void set_vram_budget(size_t bytes);
+  size_t get_vram_bytes() const { return _vramBytes; }
+
+  /**
+   * @brief Print how many textures are resident and how much VRAM they take
+   */
+  void report(const char* label) const;
+
+  /**
+   * @brief Start decoding a PNG on a worker thread, for create_texture_from_png to pick up
+   *
+   * Preloading every texture of a model before creating any of them lets
+   * them all decode at once. Does nothing if the texture is already loaded
+   * or being decoded.
+   *
+   * @param[in] filename
+   */
+  void preload_png(const std::string& filename);
+
   /**
    * @brief Given a PNG, create a GL texture from it
+   *
+   * Waits for the PNG to be decoded, on a worker thread unless already
+   * preloaded, then uploads it on the calling thread. Loading a texture
+   * that's already resident just shares it. Either way the caller gets a
+   * reference, to hand back with release_texture.
    * 
    * @param[in] filename
    */
   TextureInfo* create_texture_from_png(std::string filename);
 
   /**
-   * @brief Allocate space for a texture of the specified dimensions
+   * @brief Decode a resident texture's file again, on a worker thread
+   *
+   * Goes through the texture cache and compression like the first load.
+   * update_reloads then swaps the new contents in under the same texture
+   * id, so every renderer it's bound to picks them up.
+   *
+   * @param[in] filename
+   * @return false if no resident texture was loaded from the file
+   */
+  bool reload_png(const std::string& filename);
+
+  /**
+   * @brief Carry on with the textures reload_png has decoded, without waiting for the rest
+   *
+   * Uploads a bounded slice of them per call, through a pixel buffer into a
+   * texture of their own, so a reload takes several frames rather than
+   * stalling one. A finished one is copied over the resident texture on
+   * the GPU. Drivers without ARB_copy_image get the whole upload at once.
+   * Blocks read back for the texture cache go through a fenced pixel buffer
+   * and come out of the same budget.
+   */
+  void update_reloads();
+
+  /**
+   * @brief Allocate space for a texture of the specified dimensions, referenced once
    * 
    * @param[in] width
    * @param[in] height
@@ -76,19 +151,19 @@ public:
   TextureInfo* create_texture_from_dims(GLint width, GLint height);
 
   /**
-   * @brief Release all created textures
+   * @brief Delete all created textures, referenced or not
    */
   void release_textures();
 
   /**
-   * @brief Release a specific texture by ID
+   * @brief Drop a reference to a texture by ID
    * 
    * @param[in] texture_id
    */
   void release_texture(GLuint texture_id);
 
   /**
-   * @brief Release a specific texture by loaded filename
+   * @brief Drop a reference to a texture by loaded filename
    * 
    * @param[in] filename
    */
@@ -103,7 +178,138 @@ public:
   TextureInfo* get_texture_info_by_id(GLuint texture_id) const;
 
 private:
-  Csm::csmVector<TextureInfo*> _textures;
+  /**
+   * @brief RGBA pixels straight out of the decoder, premultiplied if PREMULTIPLIED_ALPHA_ENABLE
+   *
+   * Or, with compression enabled and a valid cache, the compressed mip chain instead.
+   */
+  struct DecodedImage {
+    unsigned char* pixels = NULL; ///< NULL if decoding failed or the cache was used, freed by upload_png
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<uint8_t>> mips; ///< Levels from 1 down, only built for the driver to compress and for reloads
+    TextureCache::Entry cached;
+    std::string source_key; ///< Identifies the PNG in the cache, empty when not compressing
+    double decode_ms = 0.0;
+  };
+
+  struct PendingDecode {
+    std::string filename;
+    std::future<DecodedImage> image;
+  };
+
+  /**
+   * @brief A reloaded texture being uploaded over several calls to update_reloads
+   */
+  struct StagedReload {
+    std::string filename;
+    DecodedImage image; ///< With every mip level, uploaded as they are
+    GLuint target = 0; ///< Resident texture to replace
+    GLuint texture = 0; ///< Levels are uploaded here, target itself without ARB_copy_image
+    GLenum format = 0; ///< Of texture, 0 for uncompressed RGBA
+    int level_count = 0;
+    int level = 0; ///< Being uploaded or read back
+    int row = 0; ///< Next to upload of level
+    bool reading = false; ///< Reading the driver's compressed blocks back for the cache
+    std::shared_ptr<std::vector<std::vector<uint8_t>>> blocks; ///< Read back so far
+    GLuint pack_buffer = 0; ///< Level being read back, copied out a slice per frame once fence signals
+    GLsync fence = NULL;
+    bool level_queued = false; ///< Whether pack_buffer holds or will hold the level
+    size_t copied = 0; ///< Bytes of the level copied out of pack_buffer so far
+    double upload_ms = 0.0; ///< Spent on the GL thread so far
+  };
+
+  TextureInfo* find_texture(const std::string& filename) const;
+
+  /**
+   * @brief Start tracking a texture, unreferenced
+   */
+  void add_texture(TextureInfo* texture_info);
+
+  /**
+   * @brief Delete a texture from the GPU and stop tracking it
+   */
+  void delete_texture(TextureInfo* texture_info);
+
+  /**
+   * @brief Start uploading a decoded reload, replacing one of the same file still being uploaded
+   */
+  void stage_reload(TextureInfo* texture_info, DecodedImage& image);
+
+  /**
+   * @brief Upload or read back up to a budget of bytes of a staged reload
+   *
+   * @param[in,out] budget Reduced by the bytes handled
+   * @return true once every level is uploaded, and read back if it's to be cached
+   */
+  bool continue_reload(StagedReload& staged, size_t* budget);
+
+  /**
+   * @brief Swap a fully uploaded reload into its resident texture
+   */
+  void finish_reload(TextureInfo* texture_info, StagedReload& staged);
+
+  /**
+   * @brief Stop a staged reload, deleting its texture and pixels
+   */
+  void discard_reload(size_t index);
+
+  /**
+   * @brief Give every level of a texture storage, leaving its contents undefined
+   */
+  void allocate_levels(GLuint texture, GLenum format, int width, int height, int level_count);
+
+  /**
+   * @brief Write a texture's compressed levels to the texture cache, on the decode pool
+   */
+  void cache_blocks(const std::string& filename, const DecodedImage& image,
+                    std::shared_ptr<std::vector<std::vector<uint8_t>>> blocks);
+
+  /**
+   * @brief Drop a reference, deleting or evicting the texture once it was the last
+   */
+  void release_reference(TextureInfo* texture_info);
+
+  /**
+   * @brief Delete unreferenced textures, least recently used first, until within the VRAM budget
+   */
+  void evict_textures();
+
+  /**
+   * @brief Read and decode a PNG, safe to call from any thread
+   */
+  DecodedImage decode_png(const std::string& filename);
+
+  /**
+   * @brief Create a GL texture from a decoded image, on the thread with the GL context
+   */
+  TextureInfo* upload_png(const std::string& filename, DecodedImage& image);
+
+  /**
+   * @brief Upload a cached mip chain into the bound texture
+   *
+   * @return false if the driver didn't accept it
+   */
+  bool upload_cached(DecodedImage& image, size_t* vram_bytes);
+
+  /**
+   * @brief Have the driver compress every mip level into the bound texture, then cache the result
+   *
+   * @return false if the driver didn't compress it
+   */
+  bool upload_compressed(const std::string& filename, DecodedImage& image, size_t* vram_bytes);
+
+  std::unordered_map<std::string, TextureInfo*> _texturesByPath; ///< Textures loaded from files
+  std::unordered_map<GLuint, TextureInfo*> _texturesById; ///< Every texture
+  size_t _vramBytes; ///< Sum of every texture's vram_bytes
+  size_t _vramBudget;
+  unsigned long long _uses; ///< References taken so far
+  std::vector<PendingDecode> _pending; ///< Decodes started by preload_png that haven't been uploaded yet
+  std::vector<PendingDecode> _reloads; ///< Decodes started by reload_png that haven't been staged yet
+  std::vector<StagedReload> _staged; ///< Decoded reloads being uploaded, in the order they were decoded
+  GLuint _unpackBuffer; ///< Pixel buffer staged reloads upload through, 0 until the first
+  WorkerPool _decodePool; ///< Also writes the texture cache
+  GLenum _compressedFormat; ///< 0 keeps textures uncompressed
 };
 
 #endif /* LIVE2D_TEXTURE_MANAGER_HPP */
\ No newline at end of file
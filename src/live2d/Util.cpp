@@ -9,6 +9,7 @@
 #include <SDL.h>
 #include <Model/CubismMoc.hpp>
 #include "Definitions.hpp"
+#include "Logger.hpp"
 
 using std::endl;
 
@@ -16,6 +17,9 @@ double LAppUtil::current_frame = 0.0;
 double LAppUtil::last_frame = 0.0;
 double LAppUtil::delta_time = 0.0;
 
+static RealClock real_clock;
+Clock* LAppUtil::frame_clock = &real_clock;
+
 Csm::csmByte* LAppUtil::load_file_as_bytes(const std::string filePath, Csm::csmSizeInt* outSize) {
   const char* path = filePath.c_str();
 
@@ -33,16 +37,15 @@ Csm::csmByte* LAppUtil::load_file_as_bytes(const std::string filePath, Csm::csmS
   }
 
   std::fstream file;
-  char* buf = static_cast<char*>(malloc(size));
-
   file.open(path, std::ios::in | std::ios::binary);
   if (!file.is_open()) {
     if (LAppDefinitions::DebugLogEnable) {
-      LAppUtil::print_log("Error opening file %s", filePath);
+      LAppUtil::print_log("Error opening file %s", path);
     }
     return NULL;
   }
 
+  char* buf = static_cast<char*>(malloc(size));
   file.read(buf, size);
   file.close();
 
@@ -61,23 +64,35 @@ Csm::csmFloat32 LAppUtil::get_delta_time() {
 }
 
 void LAppUtil::update_time() {
-  current_frame = SDL_GetTicks();
-  current_frame /= 1000.0;
+  frame_clock->tick();
+  current_frame = frame_clock->now();
+  if (last_frame == 0.0) {
+    // First call, don't report the whole time since the counter started
+    last_frame = current_frame;
+  }
   delta_time = current_frame - last_frame;
   last_frame = current_frame;
 }
 
+void LAppUtil::set_clock(Clock* new_clock) {
+  frame_clock = new_clock != NULL ? new_clock : &real_clock;
+  current_frame = 0.0;
+  last_frame = 0.0;
+  delta_time = 0.0;
+}
+
+double LAppUtil::get_time_seconds() {
+  static const double frequency = static_cast<double>(SDL_GetPerformanceFrequency());
+  return static_cast<double>(SDL_GetPerformanceCounter()) / frequency;
+}
+
 void LAppUtil::print_log(const Csm::csmChar* format, ...) {
   va_list args;
-  Csm::csmChar buf[1024];
   va_start(args, format);
-  vsnprintf_s(buf, sizeof(buf), format, args);
-
-  std::cerr << buf << std::endl;
-
+  Logger::vlog(Logger::Info, format, args);
   va_end(args);
 }
 
 void LAppUtil::print_message(const Csm::csmChar* message) {
-  std::cerr << message << std::endl;
+  Logger::write(Logger::Info, message);
 }
\ No newline at end of file
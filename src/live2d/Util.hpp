@@ -4,10 +4,14 @@
 #include <CubismFramework.hpp>
 #include <string>
 
+#include "Clock.hpp"
+
 class LAppUtil {
 public:
   /**
    * @brief Load the contents of a file into memory
+   *
+   * Prefer MappedFile, which avoids the copy where it can
    * 
    * @param[in] filePath
    * @param[out] outSize. If NULL, this parameter is ignored
@@ -33,7 +37,21 @@ public:
   static void update_time();
 
   /**
-   * @brief Log a message with printf formatting
+   * @brief Replace the clock that update_time reads
+   *
+   * @param[in] clock Not owned, must outlive its use. NULL restores the real clock
+   */
+  static void set_clock(Clock* clock);
+
+  /**
+   * @brief Read the high resolution performance counter
+   *
+   * @return Seconds elapsed since an arbitrary fixed point
+   */
+  static double get_time_seconds();
+
+  /**
+   * @brief Log a message with printf formatting, queued at Logger::Info
    * 
    * @param[in] format The format string to print
    * @param[in] ... The variable arguments to the format string
@@ -48,6 +66,7 @@ public:
   static void print_message(const Csm::csmChar* message);
 
 private:
+  static Clock* frame_clock;
   static double current_frame;
   static double last_frame;
   static double delta_time;
@@ -3,10 +3,21 @@ extern "C" {
 #include <acgl/contracts.h>
 }
 #include "Definitions.hpp"
+#include "Util.hpp"
+#include "AllocTracker.hpp"
+#include "Logger.hpp"
 
 #include <math.h>
 #include <string>
-#include <iostream>
+
+// Steps taken at most in one frame with a fixed timestep
+static const int MAX_STEPS_PER_FRAME = 8;
+
+// Share of the window height a model must take up to get each level of detail
+static const float LOD_FULL_FRACTION = 0.25f;
+static const float LOD_REDUCED_FRACTION = 0.1f;
+
+static const char* LOD_NAMES[Model::NUM_LOD_LEVELS] = { "full", "reduced", "minimal", "paused" };
 
 
 LAppView::LAppView() :
@@ -15,7 +26,30 @@ LAppView::LAppView() :
   _cv_output(NULL),
   _cv_output_node(NULL),
   _model_node(NULL),
-  _model(NULL)
+  _models(),
+  _renderSprite(NULL),
+  _renderBufferArea(),
+  _modelUpdateRate(0.0f),
+  _modelElapsed(0.0f),
+  _profiler(NULL),
+  _cameraSection(-1),
+  _modelSection(-1),
+  _simRequested(false),
+  _simStop(false),
+  _simSteps(0),
+  _simDelta(0.0f),
+  _simAlpha(1.0f),
+  _simChanged(false),
+  _modelsChanged(true),
+  _fixedStep(0.0f),
+  _stepAccumulator(0.0f),
+  _deterministic(false),
+  _lodEnabled(false),
+  _loadPressure(Model::LodFull),
+  _hidden(false),
+  _offscreen(false),
+  _screenFraction(1.0f),
+  _textureManager(NULL)
 {
   _deviceToScreen = new Csm::CubismMatrix44();
   _viewMatrix = new Csm::CubismViewMatrix();
@@ -24,9 +58,16 @@ LAppView::LAppView() :
   _clearColor[1] = 1.0f;
   _clearColor[2] = 1.0f;
   _clearColor[3] = 0.0f;
+
+  for (int i = 0; i < Model::NUM_LOD_LEVELS; i++) {
+    _lodCounts[i] = 0;
+  }
 }
 
 LAppView::~LAppView() {
+  stop_simulation_thread();
+  stop_hot_reload();
+
   delete _deviceToScreen;
   _deviceToScreen = NULL;
   delete _viewMatrix;
@@ -42,10 +83,14 @@ LAppView::~LAppView() {
     _cv_output = NULL;
   }
 
-  if (_model != NULL) {
-    delete _model;
-    _model = NULL;
+  release_models();
+
+  if (_renderSprite != NULL) {
+    delete _renderSprite;
+    _renderSprite = NULL;
   }
+
+  _renderBuffer.DestroyOffscreenFrame();
 }
 
 void LAppView::initialize_matricies(SDL_Window* window) {
@@ -92,9 +137,14 @@ void LAppView::initialize_matricies(SDL_Window* window) {
   _deviceToScreen->ScaleRelative(-width * 0.5f, -height * 0.5f);
 }
 
-void LAppView::initialize_sprites(TextureManager* texture_manager, ShaderManager* shader_manager, const int cv_width, const int cv_height) {
+void LAppView::initialize_sprites(TextureManager* texture_manager, ShaderManager* shader_manager, const int cv_width, const int cv_height,
+                                  const std::vector<std::string>& model_names) {
   _programId = shader_manager->create_shader();
 
+  // Used to composite the offscreen model buffer, the texture is passed in when rendering
+  if (_renderSprite != NULL) { delete _renderSprite; }
+  _renderSprite = new Sprite(0, _programId);
+
   if (_cv_output != NULL) { delete _cv_output; }
   std::string background_path = LAppDefinitions::ResourcesPath;
   background_path = background_path + "/" + LAppDefinitions::BackImageName;
@@ -107,23 +157,39 @@ void LAppView::initialize_sprites(TextureManager* texture_manager, ShaderManager
   if (_cv_output_node != NULL) { ACGL_gui_node_destroy(_cv_output_node); }
   _cv_output_node = ACGL_gui_node_init(
     _gui,
-    OpenCVSprite::render,
+    LAppView::render_cv_output,
     NULL,
-    reinterpret_cast<void*>(_cv_output)
+    reinterpret_cast<void*>(this)
   );
   if (_cv_output_node == NULL) { return; }
 
-  std::string model_path = LAppDefinitions::ModelDir[0];
-  model_path = LAppDefinitions::ResourcesPath + model_path + "/";
-  std::string model_json = LAppDefinitions::ModelDir[0];
-  model_json = model_json + ".model3.json";
-
-  if (_model != NULL) {
-    delete _model;
+  release_models();
+  std::vector<std::string> names = model_names;
+  if (names.empty()) {
+    names.push_back(LAppDefinitions::ModelDir[0]);
+  }
+  const AllocTracker::Phase phase = AllocTracker::get_phase();
+  AllocTracker::set_phase(AllocTracker::ModelLoad);
+  for (size_t i = 0; i < names.size(); i++) {
+    bool known = false;
+    for (Csm::csmInt32 j = 0; j < LAppDefinitions::ModelDirSize; j++) {
+      known = known || names[i] == LAppDefinitions::ModelDir[j];
+    }
+    if (!known) {
+      LAppUtil::print_log("Error: unknown model %s, skipping it", names[i].c_str());
+      continue;
+    }
+
+    std::string model_path = LAppDefinitions::ResourcesPath + names[i] + "/";
+    std::string model_json = names[i] + ".model3.json";
+
+    // Models share textures through the texture manager, and the Cubism renderer shares its shaders
+    Model* model = new Model();
+    model->load_assets(texture_manager, model_path.c_str(), model_json.c_str());
+    _models.PushBack(model);
   }
-  _model = new Model();
-  if (_model == NULL) { return; }
-  _model->load_assets(texture_manager, model_path.c_str(), model_json.c_str());
+  AllocTracker::set_phase(phase);
+  if (_models.GetSize() == 0) { return; }
 
   if (_model_node != NULL) {
     ACGL_gui_node_destroy(_model_node);
@@ -158,7 +224,26 @@ void LAppView::update_cv(cv::Mat& frame) {
 
 bool LAppView::render_model(SDL_Window* window, SDL_Rect area, void* obj) {
   LAppView* view = reinterpret_cast<LAppView*>(obj);
-  return view->render_model(window, area);
+  if (view->_profiler == NULL) {
+    return view->render_model(window, area);
+  }
+
+  const int scope = view->_profiler->begin(view->_modelSection);
+  bool result = view->render_model(window, area);
+  view->_profiler->end(scope);
+  return result;
+}
+
+bool LAppView::render_cv_output(SDL_Window* window, SDL_Rect area, void* obj) {
+  LAppView* view = reinterpret_cast<LAppView*>(obj);
+  if (view->_profiler == NULL) {
+    return view->_cv_output->render(window, area);
+  }
+
+  const int scope = view->_profiler->begin(view->_cameraSection);
+  bool result = view->_cv_output->render(window, area);
+  view->_profiler->end(scope);
+  return result;
 }
 
 bool LAppView::render_model(SDL_Window* window, SDL_Rect area) {
@@ -174,28 +259,520 @@ bool LAppView::render_model(SDL_Window* window, SDL_Rect area) {
 
   Csm::CubismMatrix44 projection;
 
-  std::cout << "Rendering model" << std::endl;
-  std::cout << "x:" << x << ", y:" << x << std::endl;
+  APP_LOG_VERBOSE("Rendering model x:%f, y:%f, w:%f, sw:%f, h:%f, sh:%f", x, y, w, sw, h, sh);
   projection.Translate(x / screen_width, -y / screen_height);
-  std::cout << "w:" << w << ", sw:" << sw << ", h:" << h << ", sh:" << sh << std::endl;
   //projection.Scale(width / screen_width, height / screen_height);
 
   if (_viewMatrix != NULL) {
     projection.MultiplyByMatrix(_viewMatrix);
+    _screenFraction = h / sh * _viewMatrix->GetScaleY();
+  }
+  _hidden = false;
+  _offscreen = w <= 0.0f || h <= 0.0f || x + w <= 0.0f || y + h <= 0.0f || x >= sw || y >= sh;
+
+  if (_modelUpdateRate > 0.0f) {
+    return render_model_cached(window, projection, area, screen_width, screen_height);
+  }
+
+  update_models(LAppUtil::get_delta_time());
+  draw_models(projection);
+
+  return true;
+}
+
+void LAppView::update_models(float delta_time_seconds) {
+  int steps = 1;
+  float step = delta_time_seconds;
+  float alpha = 1.0f;
+  if (_fixedStep > 0.0f) {
+    _stepAccumulator += delta_time_seconds;
+    steps = static_cast<int>(_stepAccumulator / _fixedStep);
+    if (steps > MAX_STEPS_PER_FRAME) {
+      // Too far behind to catch up, let the models run slow for a moment instead
+      steps = MAX_STEPS_PER_FRAME;
+      _stepAccumulator = steps * _fixedStep;
+    }
+    _stepAccumulator -= steps * _fixedStep;
+    step = _fixedStep;
+    alpha = _stepAccumulator / _fixedStep;
+  }
+
+  if (_simThread.joinable()) {
+    wait_for_simulation();
+    apply_reloads();
+    _modelsChanged = _simChanged;
+    for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+      _models[i]->swap_snapshots();
+    }
+    update_lod();
+    schedule_motions(steps);
+
+    {
+      std::lock_guard<std::mutex> lock(_simMutex);
+      _simSteps = steps;
+      _simDelta = step;
+      _simAlpha = alpha;
+      _simRequested = true;
+    }
+    _simWake.notify_one();
+    return;
+  }
+
+  apply_reloads();
+  update_lod();
+  schedule_motions(steps);
+  _modelsChanged = step_models(steps, step, alpha);
+}
+
+void LAppView::schedule_motions(int steps) {
+  if (steps == 0) {
+    return;
+  }
+  // Starting a motion may parse it, which interns ids in the framework's id
+  // manager. That isn't thread safe, so it never happens on the sim thread.
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    _models[i]->schedule_motions();
+  }
+}
+
+void LAppView::update_lod() {
+  if (!_lodEnabled) {
+    return;
+  }
+
+  for (int i = 0; i < Model::NUM_LOD_LEVELS; i++) {
+    _lodCounts[i] = 0;
+  }
+
+  // Every model is drawn at the same size, so they all get the same level
+  const float fraction = _screenFraction * placement_scale();
+  int level = Model::LodMinimal;
+  if (fraction >= LOD_FULL_FRACTION) {
+    level = Model::LodFull;
+  }
+  else if (fraction >= LOD_REDUCED_FRACTION) {
+    level = Model::LodReduced;
+  }
+  if (_loadPressure > level) {
+    level = _loadPressure;
+  }
+  if (_hidden || _offscreen) {
+    level = Model::LodPaused;
+  }
+
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    _models[i]->set_lod(static_cast<Model::LodLevel>(level));
+    _lodCounts[level]++;
+  }
+}
+
+void LAppView::set_motion_budget(size_t bytes) {
+  // Motions are started from the simulation
+  wait_for_simulation();
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    _models[i]->set_motion_budget(bytes);
+  }
+}
+
+bool LAppView::enable_hot_reload(TextureManager* texture_manager) {
+  stop_hot_reload();
+  _textureManager = texture_manager;
+
+  std::vector<std::string> dirs;
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    if (_models[i]->is_bundled()) {
+      LAppUtil::print_log("[APP] %s is read from its bundle, not watching it for changes", _models[i]->get_home_dir());
+      continue;
+    }
+    dirs.push_back(_models[i]->get_home_dir());
+  }
+  if (dirs.empty() || !_watcher.start(dirs)) {
+    return false;
+  }
+
+  _reloadPool.initialize(1);
+  LAppUtil::print_log("[APP] watching %zu model directories for changes", dirs.size());
+  return true;
+}
+
+void LAppView::stop_hot_reload() {
+  _watcher.stop();
+  for (size_t i = 0; i < _reloads.size(); i++) {
+    _reloads[i].file.wait();
+  }
+  _reloads.clear();
+  _reloadPool.release();
+}
+
+void LAppView::apply_reloads() {
+  if (!_watcher.is_running()) {
+    return;
+  }
+
+  _textureManager->update_reloads();
+  for (size_t i = 0; i < _reloads.size();) {
+    PendingReload& reload = _reloads[i];
+    if (reload.file.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+      i++;
+      continue;
+    }
+
+    const MappedFile file = reload.file.get();
+    for (size_t j = 0; j < reload.models.size() && file.is_open(); j++) {
+      // Models replaced meanwhile don't get it
+      bool loaded = false;
+      for (Csm::csmUint32 k = 0; k < _models.GetSize() && !loaded; k++) {
+        loaded = _models[k] == reload.models[j];
+      }
+      if (loaded) {
+        // Models sharing a directory each get their copy
+        Model::ParsedAsset asset;
+        Model::parse_asset(reload.kind, file, asset);
+        reload.models[j]->reload_asset(reload.path, asset);
+      }
+    }
+    _reloads.erase(_reloads.begin() + i);
+  }
+
+  _changedPaths.clear();
+  _watcher.take_changes(_changedPaths);
+  for (size_t i = 0; i < _changedPaths.size(); i++) {
+    const std::string& path = _changedPaths[i];
+    if (path.ends_with(".png")) {
+      _textureManager->reload_png(path);
+      continue;
+    }
+
+    PendingReload reload;
+    reload.path = path;
+    reload.kind = Model::NoAsset;
+    for (Csm::csmUint32 j = 0; j < _models.GetSize(); j++) {
+      const Model::AssetKind kind = _models[j]->find_asset(path);
+      if (kind != Model::NoAsset) {
+        reload.kind = kind;
+        reload.models.push_back(_models[j]);
+      }
+    }
+    if (reload.kind == Model::NoAsset) {
+      continue;
+    }
+
+    reload.file = _reloadPool.submit([path] {
+      MappedFile file;
+      if (file.open(path)) {
+        // Parsing then only waits on memory, not the disk
+        file.prefetch();
+      }
+      return file;
+    });
+    _reloads.push_back(std::move(reload));
+  }
+}
+
+void LAppView::set_lod_enabled(bool enabled) {
+  _lodEnabled = enabled;
+  if (enabled) {
+    return;
+  }
+
+  // Levels are only changed between steps
+  wait_for_simulation();
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    _models[i]->set_lod(Model::LodFull);
+  }
+}
+
+void LAppView::set_load_pressure(int level) {
+  if (level < Model::LodFull) {
+    level = Model::LodFull;
   }
+  if (level > Model::LodMinimal) {
+    level = Model::LodMinimal;
+  }
+  _loadPressure = level;
+}
+
+void LAppView::set_hidden(bool hidden) {
+  if (!_lodEnabled || hidden == _hidden) {
+    return;
+  }
+
+  _hidden = hidden;
+  // Nothing is rendered while hidden, so the models are paused here rather than on the next update
+  wait_for_simulation();
+  update_lod();
+}
+
+void LAppView::report_lod(const char* label) const {
+  if (!_lodEnabled) {
+    return;
+  }
+
+  char counts[128];
+  int length = 0;
+  for (int i = 0; i < Model::NUM_LOD_LEVELS; i++) {
+    length += snprintf(counts + length, sizeof(counts) - length, "%s%d %s", i > 0 ? ", " : "", _lodCounts[i], LOD_NAMES[i]);
+  }
+  LAppUtil::print_log("[%s] lod %s, load pressure %s", label, counts, LOD_NAMES[_loadPressure]);
+}
+
+bool LAppView::step_models(int steps, float step, float alpha) {
+  const int count = static_cast<int>(_models.GetSize());
+  // rand() is shared by every model, so reproducible runs advance them in a fixed order
+  const bool parallel = count > 1 && !_deterministic;
+  const bool interpolate = _fixedStep > 0.0f;
+
+  for (int s = 0; s < steps; s++) {
+    // Advancing a model only touches that model
+    #pragma omp parallel for if(parallel)
+    for (int i = 0; i < count; i++) {
+      if (interpolate && s == steps - 1) {
+        _models[i]->save_previous_state();
+      }
+      _models[i]->update_parameters(step);
+    }
+  }
+
+  // Change tracking is only needed to refresh the offscreen cache
+  const bool track_changes = _modelUpdateRate > 0.0f;
+  bool changed = !track_changes;
+  #pragma omp parallel for if(parallel) reduction(||:changed)
+  for (int i = 0; i < count; i++) {
+    _models[i]->finish_update(alpha);
+    if (track_changes && _models[i]->parameters_changed()) {
+      changed = true;
+    }
+  }
+  return changed;
+}
+
+bool LAppView::models_changed() {
+  return _modelsChanged;
+}
+
+void LAppView::set_fixed_timestep(float rate) {
+  _fixedStep = rate > 0.0f ? 1.0f / rate : 0.0f;
+  _stepAccumulator = 0.0f;
+}
+
+void LAppView::draw_models(Csm::CubismMatrix44& projection) {
+  const int count = static_cast<int>(_models.GetSize());
+  if (count == 1) {
+    _models[0]->draw(projection);
+    return;
+  }
+
+  // Spread evenly across the logical screen
+  const float left = _viewMatrix->GetScreenLeft();
+  const float width = _viewMatrix->GetScreenRight() - left;
+  const float scale = placement_scale();
+
+  for (int i = 0; i < count; i++) {
+    Csm::CubismMatrix44 placement;
+    placement.Scale(scale, scale);
+    placement.Translate(left + width * (2 * i + 1) / (2.0f * count), 0.0f);
+
+    // draw() multiplies in the model's own matrix, so each model gets a copy
+    Csm::CubismMatrix44 matrix;
+    matrix.SetMatrix(projection.GetArray());
+    matrix.MultiplyByMatrix(&placement);
+    _models[i]->draw(matrix);
+  }
+}
+
+float LAppView::placement_scale() const {
+  const int count = static_cast<int>(_models.GetSize());
+  if (count <= 1) {
+    return 1.0f;
+  }
+
+  // Models that wouldn't fit side by side are shrunk
+  const float width = _viewMatrix->GetScreenRight() - _viewMatrix->GetScreenLeft();
+  return fminf(1.0f, width / (2.0f * count));
+}
+
+bool LAppView::start_simulation_thread(TextureManager* texture_manager) {
+  stop_simulation_thread();
+  if (_models.GetSize() == 0) {
+    return false;
+  }
+
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    if (!_models[i]->enable_snapshots(texture_manager)) {
+      return false;
+    }
+  }
+
+  _simRequested = false;
+  _simStop = false;
+  _modelsChanged = true;
+  _simThread = std::thread(&LAppView::run_simulation, this);
+  return true;
+}
+
+void LAppView::run_simulation() {
+  // Its ring now, not on the first record of some step
+  Logger::register_thread();
+  while (true) {
+    int steps;
+    float step, alpha;
+    {
+      std::unique_lock<std::mutex> lock(_simMutex);
+      _simWake.wait(lock, [this] { return _simRequested || _simStop; });
+      if (_simStop) {
+        return;
+      }
+      steps = _simSteps;
+      step = _simDelta;
+      alpha = _simAlpha;
+    }
+
+    const bool changed = step_models(steps, step, alpha);
+
+    {
+      std::lock_guard<std::mutex> lock(_simMutex);
+      _simChanged = changed;
+      _simRequested = false;
+    }
+    _simDone.notify_one();
+  }
+}
+
+void LAppView::wait_for_simulation() {
+  std::unique_lock<std::mutex> lock(_simMutex);
+  _simDone.wait(lock, [this] { return !_simRequested; });
+}
+
+void LAppView::stop_simulation_thread() {
+  if (!_simThread.joinable()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_simMutex);
+    _simStop = true;
+  }
+  _simWake.notify_one();
+  _simThread.join();
+}
+
+void LAppView::release_models() {
+  stop_simulation_thread();
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    Model::destroy(_models[i]);
+  }
+  _models.Clear();
+}
+
+void LAppView::set_profiler(GpuProfiler* profiler) {
+  _profiler = profiler;
+  int draw_section = -1;
+  if (_profiler != NULL) {
+    _cameraSection = _profiler->add_section("camera");
+    _modelSection = _profiler->add_section("model");
+    draw_section = _profiler->add_section("DrawModel");
+  }
+  for (Csm::csmUint32 i = 0; i < _models.GetSize(); i++) {
+    _models[i]->set_profiler(_profiler, draw_section);
+  }
+}
+
+void LAppView::set_model_update_rate(float fps) {
+  _modelUpdateRate = fps > 0.0f ? fps : 0.0f;
+  _modelElapsed = 0.0f;
+}
+
+bool LAppView::ensure_render_buffer(int screen_width, int screen_height) {
+  // Render at the drawable size, but never above the configured render target size
+  float scale = 1.0f;
+  if (screen_width > LAppDefinitions::RenderTargetWidth) {
+    scale = static_cast<float>(LAppDefinitions::RenderTargetWidth) / screen_width;
+  }
+  if (screen_height * scale > LAppDefinitions::RenderTargetHeight) {
+    scale = static_cast<float>(LAppDefinitions::RenderTargetHeight) / screen_height;
+  }
+  const Csm::csmUint32 width = static_cast<Csm::csmUint32>(screen_width * scale);
+  const Csm::csmUint32 height = static_cast<Csm::csmUint32>(screen_height * scale);
+
+  if (_renderBuffer.IsValid() && _renderBuffer.GetBufferWidth() == width && _renderBuffer.GetBufferHeight() == height) {
+    return false;
+  }
+
+  _renderBuffer.DestroyOffscreenFrame();
+  if (!_renderBuffer.CreateOffscreenFrame(width, height)) {
+    LAppUtil::print_log("Error: unable to create %u x %u offscreen model buffer", width, height);
+  }
+  return true;
+}
+
+bool LAppView::render_model_cached(SDL_Window* window, Csm::CubismMatrix44& projection, SDL_Rect area, int screen_width, int screen_height) {
+  bool dirty = ensure_render_buffer(screen_width, screen_height);
+  if (!_renderBuffer.IsValid()) {
+    // Couldn't get an offscreen buffer, draw directly instead
+    update_models(LAppUtil::get_delta_time());
+    draw_models(projection);
+    return true;
+  }
+
+  if (area.x != _renderBufferArea.x || area.y != _renderBufferArea.y || \
+      area.w != _renderBufferArea.w || area.h != _renderBufferArea.h) {
+    _renderBufferArea = area;
+    dirty = true;
+  }
+
+  // Only simulate the model at its own rate, carrying the skipped time over
+  _modelElapsed += LAppUtil::get_delta_time();
+  if (_modelElapsed >= 1.0f / _modelUpdateRate) {
+    update_models(_modelElapsed);
+    _modelElapsed = 0.0f;
+
+    if (models_changed()) {
+      dirty = true;
+    }
+  }
+
+  if (dirty) {
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    _renderBuffer.BeginDraw();
+    glViewport(0, 0, _renderBuffer.GetBufferWidth(), _renderBuffer.GetBufferHeight());
+    // Cleared premultiplied, the buffer is composited with premultiplied blending
+    _renderBuffer.Clear(
+      _clearColor[0] * _clearColor[3],
+      _clearColor[1] * _clearColor[3],
+      _clearColor[2] * _clearColor[3],
+      _clearColor[3]
+    );
+    draw_models(projection);
+    _renderBuffer.EndDraw();
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+  }
+
+  // Framebuffer textures are stored bottom row first
+  static const GLfloat uv_vertex_flipped[8] = {
+    1.0f, 1.0f,
+    0.0f, 1.0f,
+    0.0f, 0.0f,
+    1.0f, 0.0f
+  };
+  SDL_Rect full_screen = { 0, 0, screen_width, screen_height };
 
-  _model->update();
-  _model->draw(projection);
+  glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+  _renderSprite->render_immediate(window, full_screen, _renderBuffer.GetColorBuffer(), uv_vertex_flipped);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
   return true;
 }
 
 void LAppView::render() {
-  std::cerr << "OpenGL Error Before View::render: " << gluErrorString(glGetError()) << std::endl;
+  AllocTracker::FrameScope frame_scope("LAppView::render");
+  APP_LOG_VERBOSE("OpenGL Error Before View::render: %s", reinterpret_cast<const char*>(gluErrorString(glGetError())));
   // Always forcing updates b/c GL swaps framebuffers always, nothing is persistent
   ACGL_gui_force_update(_gui);
   ACGL_gui_render(_gui);
-  std::cerr << "OpenGL Error After View::render: " << gluErrorString(glGetError()) << std::endl;
+  APP_LOG_VERBOSE("OpenGL Error After View::render: %s", reinterpret_cast<const char*>(gluErrorString(glGetError())));
 }
 
 float LAppView::device_to_view_x(float device_x) const {
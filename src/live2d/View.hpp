@@ -1,6 +1,12 @@
 #ifndef LIVE2D_VIEW_HPP
 #define LIVE2D_VIEW_HPP
 
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 #include <gl/glew.h>
 #include <GLFW/glfw3.h>
 #include <Math/CubismMatrix44.hpp>
@@ -9,6 +15,10 @@
 
 #include "Sprite.hpp"
 #include "Model.hpp"
+#include "GpuProfiler.hpp"
+#include "FileWatcher.hpp"
+#include "MappedFile.hpp"
+#include "WorkerPool.hpp"
 
 #include "../OpenCVSprite.hpp"
 extern "C" {
@@ -36,8 +46,12 @@ public:
 
   /**
    * @brief Initializes all internal sprites
+   *
+   * @param[in] model_names Directories under the resources path of the models to show side by side,
+   *                        the first of LAppDefinitions::ModelDir if empty
    */
-  void initialize_sprites(TextureManager* texture_manager, ShaderManager* shader_manager, const int cv_width, const int cv_height);
+  void initialize_sprites(TextureManager* texture_manager, ShaderManager* shader_manager, const int cv_width, const int cv_height,
+                          const std::vector<std::string>& model_names = std::vector<std::string>());
 
   /**
    * @brief static callback to render just the Live2D model
@@ -45,6 +59,11 @@ public:
   static bool render_model(SDL_Window* window, SDL_Rect area, void* obj);
   bool render_model(SDL_Window* window, SDL_Rect area);
 
+  /**
+   * @brief static callback to render the camera feed
+   */
+  static bool render_cv_output(SDL_Window* window, SDL_Rect area, void* obj);
+
   /**
  * @brief Render the view
  *
@@ -98,6 +117,105 @@ public:
    */
   void update_cv(cv::Mat& frame);
 
+  /**
+   * @brief Cap how often the model is simulated and redrawn
+   *
+   * With a positive rate, the model is rendered into an offscreen buffer at
+   * most `fps` times per second, and only if its parameters changed. Every
+   * other frame composites the cached buffer instead of redrawing the model.
+   *
+   * @param[in] fps Model updates per second, or 0 to draw the model directly every frame
+   */
+  void set_model_update_rate(float fps);
+
+  /**
+   * @brief Time the camera and model nodes, and the model's draw calls, on the GPU
+   *
+   * @pre initialize_sprites has been called
+   * @param[in] profiler NULL to stop profiling
+   */
+  void set_profiler(GpuProfiler* profiler);
+
+  /**
+   * @brief Simulate the models on a worker thread while the render thread draws
+   *
+   * Each frame draws the state simulated during the previous frame, from a
+   * snapshot of the model, while the worker advances the models for the next
+   * one. Trades a frame of model latency for taking motions and physics off
+   * the render thread.
+   *
+   * @pre initialize_sprites has been called
+   * @param[in] texture_manager
+   * @return true iff the worker is running
+   */
+  bool start_simulation_thread(TextureManager* texture_manager);
+
+  /**
+   * @brief Advance the models in fixed steps, independent of the frame rate
+   *
+   * Frame time accumulates until there's enough for a whole step. What's
+   * drawn is interpolated between the last two steps by the time left over.
+   *
+   * @param[in] rate Steps per second, or 0 to step once per frame by the frame time
+   */
+  void set_fixed_timestep(float rate);
+
+  /**
+   * @brief Advance models one after another instead of in parallel
+   *
+   * Motions and eye blinks draw from the shared rand(), so only a fixed
+   * order gives the same results from the same seed.
+   */
+  void set_deterministic(bool deterministic) { _deterministic = deterministic; }
+
+  /**
+   * @brief Simulate models less often and in less detail the less they matter
+   *
+   * Each frame a model gets the lowest level of detail its on-screen size,
+   * the load pressure and the window's visibility allow. Models whose node
+   * is clipped out of the window entirely are paused.
+   */
+  void set_lod_enabled(bool enabled);
+
+  /**
+   * @brief Cap the parsed motions each model keeps once they stop playing
+   *
+   * @param[in] bytes Measured in motion3.json
+   */
+  void set_motion_budget(size_t bytes);
+
+  /**
+   * @brief Watch the models' directories, reloading their assets as they're written
+   *
+   * Changed files are read, and textures decoded, on worker threads. Between
+   * frames motions, expressions and physics are parsed and swapped in.
+   * Models read from a bundle aren't watched.
+   *
+   * @pre initialize_sprites has been called
+   * @param[in] texture_manager Reloads the textures
+   * @return true iff any model's directory is being watched
+   */
+  bool enable_hot_reload(TextureManager* texture_manager);
+
+  /**
+   * @brief Keep every model at or below a level of detail, to stay within a frame budget
+   *
+   * @param[in] level A Model::LodLevel, LodFull lifts the limit
+   */
+  void set_load_pressure(int level);
+
+  /**
+   * @brief Pause every model while the window can't be seen
+   *
+   * Cleared by the next render.
+   */
+  void set_hidden(bool hidden);
+
+  /**
+   * @brief Print how many models are at each level of detail
+   */
+  void report_lod(const char* label) const;
+
   ACGL_gui_t* get_gui() const { return _gui; }
 
 private:
@@ -108,12 +226,140 @@ private:
   OpenCVSprite* _cv_output;
   ACGL_gui_object_t* _cv_output_node;
 
-  Model* _model;
+  Csm::csmVector<Model*> _models;
   ACGL_gui_object_t* _model_node;
   
   ACGL_gui_t* _gui;
   Csm::Rendering::CubismOffscreenFrame_OpenGLES2 _renderBuffer;
+  Sprite* _renderSprite;
+  SDL_Rect _renderBufferArea;
+  float _modelUpdateRate;
+  float _modelElapsed;
   float _clearColor[4];
+
+  GpuProfiler* _profiler;
+  int _cameraSection;
+  int _modelSection;
+
+  std::thread _simThread;
+  std::mutex _simMutex;
+  std::condition_variable _simWake; ///< Signals the worker that a step was requested or it should stop
+  std::condition_variable _simDone; ///< Signals the render thread that the requested step finished
+  bool _simRequested;
+  bool _simStop;
+  int _simSteps;
+  float _simDelta;
+  float _simAlpha;
+  bool _simChanged;    ///< Whether the step in flight changed any model
+  bool _modelsChanged; ///< Whether the models now being drawn differ from the ones before
+
+  float _fixedStep; ///< Seconds per simulation step, 0 steps once per frame by the frame time
+  float _stepAccumulator;
+  bool _deterministic;
+
+  bool _lodEnabled;
+  int _loadPressure;
+  bool _hidden;
+  bool _offscreen; ///< Whether the model node lay wholly outside the window last frame
+  float _screenFraction; ///< Share of the window height the model node took up last frame
+  int _lodCounts[Model::NUM_LOD_LEVELS]; ///< Models at each level, as of the last update_lod
+
+  struct PendingReload {
+    std::string path;
+    Model::AssetKind kind;
+    std::vector<Model*> models; ///< Using the file when it changed
+    std::future<MappedFile> file; ///< Not open if it couldn't be read
+  };
+
+  FileWatcher _watcher;
+  WorkerPool _reloadPool; ///< Reads changed files
+  TextureManager* _textureManager; ///< Reloads changed textures
+  std::vector<PendingReload> _reloads; ///< Files being read
+  std::vector<std::string> _changedPaths; ///< Taken from _watcher, kept to reuse its storage
+
+  /**
+   * @brief Swap in the files that finished reading, then start reading the ones changed since
+   *
+   * Files are read on _reloadPool but parsed here, since parsing registers
+   * ids with the framework's id manager. Textures upload a slice per call.
+   * Must not run while the worker is stepping the models.
+   */
+  void apply_reloads();
+  void stop_hot_reload();
+
+  /**
+   * @brief Pick each model's level of detail for the coming step
+   *
+   * Must not run while the worker is stepping the models.
+   */
+  void update_lod();
+
+  /**
+   * @brief Queue idle motions on models that ran out, ahead of a frame's steps
+   *
+   * Must not run while the worker is stepping the models.
+   *
+   * @param[in] steps Steps about to run, nothing is queued for none
+   */
+  void schedule_motions(int steps);
+
+  /**
+   * @brief How much each model is scaled down to fit next to the others
+   */
+  float placement_scale() const;
+
+  /**
+   * @brief Advance every model by a number of steps, then deform them for drawing
+   *
+   * @param[in] steps
+   * @param[in] step Seconds per step
+   * @param[in] alpha How far into the next step to interpolate the drawn state
+   * @return Whether the drawn models changed, always true unless the offscreen cache needs to know
+   */
+  bool step_models(int steps, float step, float alpha);
+
+  /**
+   * @brief Worker loop, advances every model and publishes their snapshots
+   */
+  void run_simulation();
+
+  /**
+   * @brief Wait until the worker has finished the step in flight, if any
+   */
+  void wait_for_simulation();
+  void stop_simulation_thread();
+
+  /**
+   * @brief Advance every model, in parallel when there are several
+   *
+   * With the simulation thread running, this instead starts the next step
+   * on the worker, after swapping in the snapshots of the step before.
+   */
+  void update_models(float delta_time_seconds);
+
+  /**
+   * @brief Check whether the last update_models changed how any model is drawn
+   */
+  bool models_changed();
+
+  /**
+   * @brief Draw all models in one pass, spread out side by side
+   */
+  void draw_models(Csm::CubismMatrix44& projection);
+
+  void release_models();
+
+  /**
+   * @brief Draw the model through the offscreen cache, refreshing it if needed
+   */
+  bool render_model_cached(SDL_Window* window, Csm::CubismMatrix44& projection, SDL_Rect area, int screen_width, int screen_height);
+
+  /**
+   * @brief (Re)create the offscreen buffer to match the drawable size
+   *
+   * @return true iff the buffer was recreated and needs to be redrawn
+   */
+  bool ensure_render_buffer(int screen_width, int screen_height);
 };
 
 #endif /* LIVE2D_VIEW_HPP */
\ No newline at end of file
@@ -0,0 +1,72 @@
+#include "WorkerPool.hpp"
+
+#include <system_error>
+
+#include "Util.hpp"
+
+WorkerPool::WorkerPool() :
+  _stop(false)
+{
+  // Pass
+}
+
+WorkerPool::~WorkerPool() {
+  release();
+}
+
+bool WorkerPool::initialize(int thread_count) {
+  release();
+
+  if (thread_count <= 0) {
+    // The render thread keeps a core to itself
+    thread_count = static_cast<int>(std::thread::hardware_concurrency()) - 1;
+    if (thread_count < 1) {
+      thread_count = 1;
+    }
+  }
+
+  _stop = false;
+  for (int i = 0; i < thread_count; i++) {
+    try {
+      _threads.push_back(std::thread(&WorkerPool::run, this));
+    }
+    catch (const std::system_error& e) {
+      LAppUtil::print_log("Error starting worker thread %d: %s", i, e.what());
+      break;
+    }
+  }
+  return !_threads.empty();
+}
+
+void WorkerPool::release() {
+  if (_threads.empty()) {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _wake.notify_all();
+  for (size_t i = 0; i < _threads.size(); i++) {
+    _threads[i].join();
+  }
+  _threads.clear();
+}
+
+void WorkerPool::run() {
+  while (true) {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(_mutex);
+      _wake.wait(lock, [this] { return _stop || !_tasks.empty(); });
+      // Queued tasks still run when stopping, someone may be waiting on them
+      if (_tasks.empty()) {
+        return;
+      }
+      task = std::move(_tasks.front());
+      _tasks.pop_front();
+    }
+    task();
+  }
+}
@@ -0,0 +1,85 @@
+#ifndef LIVE2D_WORKER_POOL_HPP
+#define LIVE2D_WORKER_POOL_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+/**
+ * @brief A fixed set of threads running tasks in the order they're submitted
+ *
+ * Meant for blocking work like file reads and image decodes that shouldn't
+ * hold up the render thread. Results come back through futures.
+ */
+class WorkerPool {
+public:
+  /**
+   * @brief Custom constructor/destructor
+   */
+  WorkerPool();
+  ~WorkerPool();
+
+  /**
+   * @brief Start the threads, stopping any that are already running
+   *
+   * @param[in] thread_count 0 for one less than the number of cores, but at least one
+   * @return true iff at least one thread started
+   */
+  bool initialize(int thread_count = 0);
+
+  /**
+   * @brief Run every task still queued, then stop the threads
+   */
+  void release();
+
+  /**
+   * @brief Queue a task
+   *
+   * Without running threads the task runs right away on the calling thread.
+   *
+   * @param[in] task Callable without arguments
+   * @return The task's result, once it's done
+   */
+  template <typename F>
+  std::future<std::invoke_result_t<F>> submit(F&& task) {
+    typedef std::invoke_result_t<F> Result;
+    // std::function needs to be copyable, which a packaged_task isn't
+    std::shared_ptr<std::packaged_task<Result()>> packaged =
+      std::make_shared<std::packaged_task<Result()>>(std::forward<F>(task));
+    std::future<Result> result = packaged->get_future();
+
+    if (_threads.empty()) {
+      (*packaged)();
+      return result;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _tasks.push_back([packaged] { (*packaged)(); });
+    }
+    _wake.notify_one();
+    return result;
+  }
+
+  int get_thread_count() const { return static_cast<int>(_threads.size()); }
+
+private:
+  /**
+   * @brief Worker loop
+   */
+  void run();
+
+  std::vector<std::thread> _threads;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::deque<std::function<void()>> _tasks;
+  bool _stop;
+};
+
+#endif /* LIVE2D_WORKER_POOL_HPP */